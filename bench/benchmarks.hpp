@@ -0,0 +1,32 @@
+#pragma once
+
+#include <thread_pool.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Every benchmark writes a human readable table to out and returns false if it could not run.
+bool bench_mipgen(ThreadPool& pool, std::ostream& out);
+bool bench_codec(ThreadPool& pool, std::ostream& out);
+bool bench_convert(ThreadPool& pool, std::ostream& out);
+bool bench_png(ThreadPool& pool, std::ostream& out);
+
+// Smooth gradients with some noise on top, roughly like a photographed texture.
+std::vector<unsigned char> synthetic_image(uint32_t width, uint32_t height, uint32_t channels);
+
+// Runs fn repeatedly for at least min_seconds (and at least once), and returns the average duration of one run in seconds.
+template<typename F>
+double time_average(F&& fn, double min_seconds = 0.5) {
+	using clock = std::chrono::high_resolution_clock;
+	auto const start = clock::now();
+	size_t runs = 0;
+	double elapsed = 0.0;
+	do {
+		fn();
+		++runs;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < min_seconds);
+	return elapsed / static_cast<double>(runs);
+}
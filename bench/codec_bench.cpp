@@ -0,0 +1,179 @@
+#include "benchmarks.hpp"
+
+#include <codec.hpp>
+#include <cpu_mipgen.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <string>
+
+namespace fs = std::filesystem;
+
+struct CorpusFile {
+	std::string name;
+	std::vector<unsigned char> data;
+	// Independently compressed parts, like mip levels
+	std::vector<size_t> sections;
+};
+
+static CorpusFile synthetic_texture(ThreadPool& pool, uint32_t size) {
+	std::vector<unsigned char> pixels = synthetic_image(size, size, 4);
+	mipgen::ImageInfo info;
+	info.extents[0] = size;
+	info.extents[1] = size;
+	info.format = mipgen::ImageFormat::RGBA8;
+	info.pixels = pixels.data();
+
+	CorpusFile file;
+	file.name = "texture " + std::to_string(size) + "^2";
+	file.data.resize(cpu_mipgen::output_buffer_size(info));
+	cpu_mipgen::generate_mipmap(pool, info, cpu_mipgen::Filter::Box, file.data.data());
+	for (uint32_t level = 0; level < cpu_mipgen::get_mip_count(info); ++level) {
+		uint32_t const extent = std::max(size >> level, 1u);
+		file.sections.push_back(static_cast<size_t>(extent) * extent * 4);
+	}
+	return file;
+}
+
+// Wavy grid with PNTV32 vertices (44 bytes) and 32-bit indices, like a terrain or cloth mesh.
+static CorpusFile synthetic_mesh(uint32_t size) {
+	struct Vertex {
+		float position[3], normal[3], tangent[3], uv[2];
+	};
+	std::vector<Vertex> vertices;
+	for (uint32_t y = 0; y <= size; ++y) {
+		for (uint32_t x = 0; x <= size; ++x) {
+			float const u = static_cast<float>(x) / size;
+			float const v = static_cast<float>(y) / size;
+			float const height = 0.05f * std::sin(u * 20.0f) * std::cos(v * 17.0f);
+			vertices.push_back({ { u, height, v }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { u, v } });
+		}
+	}
+	std::vector<uint32_t> indices;
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			uint32_t const i = y * (size + 1) + x;
+			for (uint32_t index : { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 }) indices.push_back(index);
+		}
+	}
+
+	CorpusFile file;
+	file.name = "mesh " + std::to_string(size) + "^2";
+	size_t const vertex_bytes = vertices.size() * sizeof(Vertex);
+	size_t const index_bytes = indices.size() * sizeof(uint32_t);
+	file.data.resize(vertex_bytes + index_bytes);
+	memcpy(file.data.data(), vertices.data(), vertex_bytes);
+	memcpy(file.data.data() + vertex_bytes, indices.data(), index_bytes);
+	file.sections = { vertex_bytes, index_bytes };
+	return file;
+}
+
+// Files in the directory named by ASSETTOOL_BENCH_CORPUS, so real assets can be measured too.
+static void load_corpus_directory(std::vector<CorpusFile>& corpus, std::ostream& out) {
+	char const* directory = std::getenv("ASSETTOOL_BENCH_CORPUS");
+	if (directory == nullptr) return;
+
+	std::error_code ec;
+	for (fs::directory_entry const& entry : fs::directory_iterator(directory, ec)) {
+		if (!entry.is_regular_file()) continue;
+		std::ifstream stream(entry.path(), std::ios::binary);
+		CorpusFile file;
+		file.name = entry.path().filename().generic_string();
+		file.data.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+		file.sections = { file.data.size() };
+		if (!file.data.empty()) corpus.push_back(std::move(file));
+	}
+	if (ec) out << "Could not read corpus directory " << directory << ": " << ec.message() << "\n";
+}
+
+static std::vector<codec::Section> make_sections(CorpusFile const& file, bool chunked) {
+	if (!chunked) return { { file.data.data(), file.data.size() } };
+	std::vector<codec::Section> sections;
+	size_t offset = 0;
+	for (size_t size : file.sections) {
+		sections.push_back({ file.data.data() + offset, size });
+		offset += size;
+	}
+	return sections;
+}
+
+bool bench_codec(ThreadPool& pool, std::ostream& out) {
+	std::vector<CorpusFile> corpus;
+	corpus.push_back(synthetic_texture(pool, 1024));
+	corpus.push_back(synthetic_mesh(256));
+	load_corpus_directory(corpus, out);
+
+	struct Candidate {
+		const char* name;
+		codec::Settings settings;
+	};
+	Candidate const candidates[] = {
+		{ "lz4", { codec::Codec::LZ4, 0 } },
+		{ "lz4hc:9", { codec::Codec::LZ4HC, 9 } },
+		{ "lz4hc:12", { codec::Codec::LZ4HC, 12 } },
+		{ "zstd:3", { codec::Codec::Zstd, 3 } },
+		{ "zstd:19", { codec::Codec::Zstd, 19 } },
+	};
+
+	out << std::left << std::setw(20) << "file" << std::setw(10) << "codec" << std::setw(9) << "layout"
+		<< std::right << std::setw(10) << "ratio" << std::setw(14) << "encode MB/s" << std::setw(14) << "decode MB/s" << "\n";
+
+	bool success = true;
+	for (CorpusFile const& file : corpus) {
+		double const megabytes = static_cast<double>(file.data.size()) / (1024.0 * 1024.0);
+		for (Candidate const& candidate : candidates) {
+			for (bool chunked : { false, true }) {
+				std::vector<codec::Section> const sections = make_sections(file, chunked);
+				size_t const max_chunk_size = chunked ? codec::default_chunk_size : std::numeric_limits<size_t>::max();
+
+				std::vector<char> blob;
+				std::vector<codec::Chunk> chunks;
+				bool compressed = true;
+				// Slow codecs would take minutes at the default measuring time, one run is accurate enough for those.
+				double const encode_seconds = time_average([&]() {
+					compressed = codec::compress_chunks(pool, candidate.settings, sections, max_chunk_size, blob, chunks);
+				}, 0.1);
+				if (!compressed) {
+					out << std::left << std::setw(20) << file.name << std::setw(10) << candidate.name << "failed to compress\n";
+					success = false;
+					continue;
+				}
+
+				// Decode like a loader would: every chunk into its place in the final buffer, in parallel.
+				std::vector<size_t> offsets(chunks.size());
+				for (size_t i = 1; i < chunks.size(); ++i) offsets[i] = offsets[i - 1] + chunks[i - 1].size;
+				std::vector<unsigned char> decoded(file.data.size());
+				std::atomic<bool> decoded_all = true;
+				double const decode_seconds = time_average([&]() {
+					pool.parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+						for (size_t i = begin; i < end; ++i) {
+							if (!codec::decompress(candidate.settings.codec, blob.data() + chunks[i].compressed_offset, chunks[i].compressed_size,
+												   decoded.data() + offsets[i], chunks[i].size)) {
+								decoded_all = false;
+							}
+						}
+					});
+				});
+				if (!decoded_all || decoded != file.data) {
+					out << std::left << std::setw(20) << file.name << std::setw(10) << candidate.name << "round trip mismatch\n";
+					success = false;
+					continue;
+				}
+
+				out << std::left << std::setw(20) << file.name << std::setw(10) << candidate.name << std::setw(9) << (chunked ? "chunked" : "single")
+					<< std::right << std::fixed << std::setprecision(2)
+					<< std::setw(10) << static_cast<double>(file.data.size()) / static_cast<double>(std::max<size_t>(blob.size(), 1))
+					<< std::setw(14) << megabytes / encode_seconds << std::setw(14) << megabytes / decode_seconds << "\n";
+			}
+		}
+	}
+	return success;
+}
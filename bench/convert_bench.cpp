@@ -0,0 +1,224 @@
+#include "benchmarks.hpp"
+
+#include <mesh_convert.hpp>
+#include <options.hpp>
+#include <profile.hpp>
+#include <texture_convert.hpp>
+
+#include <assimp/Importer.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Uncompressed 32-bit TGA, which stb_image decodes without any entropy decoding in the way.
+static bool write_tga(fs::path const& path, uint32_t size) {
+	std::vector<unsigned char> const pixels = synthetic_image(size, size, 4);
+	unsigned char header[18] = {};
+	header[2] = 2; // uncompressed true color
+	header[12] = static_cast<unsigned char>(size & 0xFF);
+	header[13] = static_cast<unsigned char>(size >> 8);
+	header[14] = static_cast<unsigned char>(size & 0xFF);
+	header[15] = static_cast<unsigned char>(size >> 8);
+	header[16] = 32;
+	header[17] = 8 | 0x20; // alpha bits, rows stored top to bottom
+
+	std::vector<unsigned char> bgra(pixels.size());
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		bgra[i + 0] = pixels[i + 2];
+		bgra[i + 1] = pixels[i + 1];
+		bgra[i + 2] = pixels[i + 0];
+		bgra[i + 3] = pixels[i + 3];
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<char const*>(header), sizeof(header));
+	file.write(reinterpret_cast<char const*>(bgra.data()), static_cast<std::streamsize>(bgra.size()));
+	return file.good();
+}
+
+// Wavy grid of size x size quads, with positions, normals and uvs like an exported terrain or cloth mesh.
+static bool write_obj(fs::path const& path, uint32_t size) {
+	std::string text;
+	char line[128];
+	for (uint32_t y = 0; y <= size; ++y) {
+		for (uint32_t x = 0; x <= size; ++x) {
+			float const u = static_cast<float>(x) / size;
+			float const v = static_cast<float>(y) / size;
+			float const height = 0.05f * std::sin(u * 20.0f) * std::cos(v * 17.0f);
+			text.append(line, std::snprintf(line, sizeof(line), "v %f %f %f\nvt %f %f\nvn 0 1 0\n", u, height, v, u, v));
+		}
+	}
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			// OBJ indices start at 1.
+			uint32_t const a = y * (size + 1) + x + 1;
+			uint32_t const b = a + size + 1;
+			text.append(line, std::snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\nf %u/%u/%u %u/%u/%u %u/%u/%u\n",
+											a, a, a, b, b, b, a + 1, a + 1, a + 1, a + 1, a + 1, a + 1, b, b, b, b + 1, b + 1, b + 1));
+		}
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	file.write(text.data(), static_cast<std::streamsize>(text.size()));
+	return file.good();
+}
+
+struct CorpusEntry {
+	fs::path path;
+	fs::path output;
+	bool texture;
+};
+
+static bool generate_corpus(fs::path const& directory, std::vector<CorpusEntry>& corpus, std::ostream& out) {
+	uint32_t const texture_sizes[] = { 256, 256, 256, 256, 1024, 1024, 2048 };
+	uint32_t const mesh_sizes[] = { 32, 32, 128, 384 };
+
+	std::error_code ec;
+	fs::create_directories(directory, ec);
+	for (size_t i = 0; i < std::size(texture_sizes); ++i) {
+		fs::path const path = directory / ("texture" + std::to_string(i) + ".tga");
+		if (!write_tga(path, texture_sizes[i])) {
+			out << "Could not write " << path.generic_string() << "\n";
+			return false;
+		}
+		corpus.push_back({ path, fs::path(path).replace_extension(".tx"), true });
+	}
+	for (size_t i = 0; i < std::size(mesh_sizes); ++i) {
+		fs::path const path = directory / ("mesh" + std::to_string(i) + ".obj");
+		if (!write_obj(path, mesh_sizes[i])) {
+			out << "Could not write " << path.generic_string() << "\n";
+			return false;
+		}
+		corpus.push_back({ path, fs::path(path).replace_extension(".mesh"), false });
+	}
+	return true;
+}
+
+struct Preset {
+	const char* name;
+	void (*apply)(Options& options);
+};
+
+// Defaults of the command line, with mips on the CPU so the benchmark runs on machines without a GPU.
+static Options default_options() {
+	Options options = {};
+	options.colorspace = assetlib::ColorSpace::RGB;
+	options.channels = 4;
+	options.mip_method = MipMethod::CPU;
+	options.mip_filter = cpu_mipgen::Filter::Box;
+	options.block_format = block_compress::Format::None;
+	options.block_quality = block_compress::Quality::High;
+	options.mesh_optimization = MeshOptimization::VertexCache;
+	options.vertex_format = OutputVertexFormat::PNTV32;
+	options.lod_error = 0.01f;
+	return options;
+}
+
+static void print_stages(std::vector<profile::StageSummary> const& stages, double total_ms, std::ostream& out) {
+	out << "  " << std::left << std::setw(16) << "stage" << std::right << std::setw(7) << "calls" << std::setw(12) << "total ms"
+		<< std::setw(8) << "share" << std::setw(12) << "in MB/s" << std::setw(12) << "max RSS MB" << "\n";
+	for (profile::StageSummary const& stage : stages) {
+		double const seconds = stage.total_ms / 1000.0;
+		out << "  " << std::left << std::setw(16) << stage.name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(7) << stage.calls << std::setw(12) << stage.total_ms
+			<< std::setw(7) << (total_ms > 0.0 ? 100.0 * stage.total_ms / total_ms : 0.0) << "%";
+		if (stage.bytes_in != 0 && seconds > 0.0) out << std::setw(12) << static_cast<double>(stage.bytes_in) / (1024.0 * 1024.0) / seconds;
+		else out << std::setw(12) << "-";
+		out << std::setw(12) << static_cast<double>(stage.max_rss) / (1024.0 * 1024.0) << "\n";
+	}
+}
+
+// Converts a generated corpus of textures and meshes with a few option presets and prints the time spent in every
+// stage. Set ASSETTOOL_BENCH_PROFILE to a directory to also get a trace file per preset.
+bool bench_convert(ThreadPool& pool, std::ostream& out) {
+	Preset const presets[] = {
+		{ "uncompressed", [](Options& options) {
+			options.mesh_optimization = MeshOptimization::None;
+			options.compression = { codec::Codec::None, 0 };
+		} },
+		{ "default", [](Options&) {} },
+		{ "streamed", [](Options& options) {
+			options.memory_budget_mb = 16;
+		} },
+		{ "release", [](Options& options) {
+			options.mip_filter = cpu_mipgen::Filter::Kaiser;
+			options.block_format = block_compress::Format::BC7;
+			options.block_quality = block_compress::Quality::Fast;
+			options.mesh_optimization = MeshOptimization::Overdraw;
+			options.vertex_format = OutputVertexFormat::Compact;
+			options.lod_ratios = { 0.5f, 0.25f };
+			options.meshlets = true;
+			options.compression = { codec::Codec::Zstd, 0 };
+			options.chunked = true;
+		} },
+	};
+
+	fs::path const directory = fs::temp_directory_path() / "assettool_bench_corpus";
+	std::vector<CorpusEntry> corpus;
+	if (!generate_corpus(directory, corpus, out)) return false;
+	char const* profile_directory = std::getenv("ASSETTOOL_BENCH_PROFILE");
+
+	Assimp::Importer importer;
+	bool success = true;
+	for (Preset const& preset : presets) {
+		Options options = default_options();
+		preset.apply(options);
+		profile::reset();
+		profile::enable();
+
+		uint64_t bytes_in = 0;
+		uint64_t bytes_out = 0;
+		auto const start = std::chrono::steady_clock::now();
+		for (CorpusEntry const& entry : corpus) {
+			std::ostringstream log;
+			std::string error;
+			MappedFile in = MappedFile::open(entry.path, error);
+			bool converted = in.is_open();
+			if (converted) {
+				profile::Scope scope("convert", entry.path.filename().generic_string());
+				scope.bytes_in(in.size());
+				bytes_in += in.size();
+				asset_ext::Output output = asset_ext::Output::file(entry.output);
+				converted = entry.texture ? convert_texture(nullptr, pool, options, in, output, log)
+										  : convert_mesh(importer, pool, options, in, output, log);
+			}
+			if (!converted) {
+				out << preset.name << ": " << entry.path.filename().generic_string() << " failed. " << error << log.str() << "\n";
+				success = false;
+				continue;
+			}
+			std::error_code ec;
+			bytes_out += fs::file_size(entry.output, ec);
+		}
+		double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::vector<profile::StageSummary> const stages = profile::summarize();
+		double total_ms = 0.0;
+		for (profile::StageSummary const& stage : stages) {
+			if (stage.name == "convert") total_ms = stage.total_ms;
+		}
+		out << std::fixed << std::setprecision(2) << preset.name << ": " << corpus.size() << " files, "
+			<< static_cast<double>(bytes_in) / (1024.0 * 1024.0) << " MB in, " << static_cast<double>(bytes_out) / (1024.0 * 1024.0) << " MB out, "
+			<< seconds << "s, " << static_cast<double>(bytes_in) / (1024.0 * 1024.0) / seconds << " MB/s\n";
+		print_stages(stages, total_ms, out);
+
+		if (profile_directory != nullptr) {
+			std::string error;
+			fs::path const path = fs::path(profile_directory) / (std::string("convert_") + preset.name + ".json");
+			if (!profile::write(path, error)) out << error << "\n";
+		}
+	}
+
+	std::error_code ec;
+	fs::remove_all(directory, ec);
+	return success;
+}
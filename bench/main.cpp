@@ -0,0 +1,35 @@
+#include "benchmarks.hpp"
+
+#include <string>
+
+// Usage: assettool_bench [benchmark...]
+// Runs every benchmark when none are named.
+int main(int argc, char** argv) {
+	ThreadPool pool;
+	std::ostream& out = std::cout;
+
+	struct Benchmark {
+		const char* name;
+		bool (*run)(ThreadPool&, std::ostream&);
+	};
+	Benchmark const benchmarks[] = {
+		{ "mipgen", &bench_mipgen },
+		{ "codec", &bench_codec },
+		{ "png", &bench_png },
+		{ "convert", &bench_convert },
+	};
+
+	bool success = true;
+	for (Benchmark const& benchmark : benchmarks) {
+		bool selected = argc <= 1;
+		for (int i = 1; i < argc; ++i) {
+			if (std::string(argv[i]) == benchmark.name) selected = true;
+		}
+		if (!selected) continue;
+
+		out << "== " << benchmark.name << " (" << pool.size() << " threads) ==\n";
+		success = benchmark.run(pool, out) && success;
+		out << "\n";
+	}
+	return success ? 0 : 1;
+}
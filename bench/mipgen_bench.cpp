@@ -0,0 +1,82 @@
+#include "benchmarks.hpp"
+
+#include <cpu_mipgen.hpp>
+#include <mipgen/mipgen.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <vector>
+
+std::vector<unsigned char> synthetic_image(uint32_t width, uint32_t height, uint32_t channels) {
+	std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> noise(-24, 24);
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			for (uint32_t c = 0; c < channels; ++c) {
+				int const base = static_cast<int>((x * (c + 1) + y * (channels - c)) * 255 / (width + height));
+				pixels[(static_cast<size_t>(y) * width + x) * channels + c] = static_cast<unsigned char>(std::clamp(base + noise(rng), 0, 255));
+			}
+		}
+	}
+	return pixels;
+}
+
+bool bench_mipgen(ThreadPool& pool, std::ostream& out) {
+	// The GPU path needs a device. Build machines without one still get the CPU numbers.
+	std::unique_ptr<mipgen::Context> gpu;
+	try {
+		gpu = std::make_unique<mipgen::Context>(mipgen::GenerationMethod::ImageBlit);
+	} catch (std::exception const& e) {
+		out << "GPU mip generation unavailable (" << e.what() << "), only measuring the CPU path.\n";
+	}
+
+	struct Method {
+		const char* name;
+		bool cpu;
+		cpu_mipgen::Filter filter;
+	};
+	Method const methods[] = {
+		{ "gpu blit", false, cpu_mipgen::Filter::Box },
+		{ "cpu box", true, cpu_mipgen::Filter::Box },
+		{ "cpu kaiser", true, cpu_mipgen::Filter::Kaiser },
+		{ "cpu lanczos", true, cpu_mipgen::Filter::Lanczos },
+	};
+
+	out << std::left << std::setw(10) << "size" << std::setw(8) << "format" << std::setw(14) << "method"
+		<< std::right << std::setw(12) << "ms" << std::setw(12) << "MPix/s" << "\n";
+
+	for (uint32_t size : { 1024u, 2048u, 4096u }) {
+		for (mipgen::ImageFormat format : { mipgen::ImageFormat::RGBA8, mipgen::ImageFormat::sRGBA8 }) {
+			std::vector<unsigned char> pixels = synthetic_image(size, size, 4);
+
+			mipgen::ImageInfo info;
+			info.extents[0] = size;
+			info.extents[1] = size;
+			info.format = format;
+			info.pixels = pixels.data();
+
+			std::vector<unsigned char> output(cpu_mipgen::output_buffer_size(info));
+			for (Method const& method : methods) {
+				if (!method.cpu && !gpu) continue;
+
+				double const seconds = time_average([&]() {
+					if (method.cpu) cpu_mipgen::generate_mipmap(pool, info, method.filter, output.data());
+					else gpu->generate_mipmap(info, output.data());
+				});
+
+				double const megapixels = static_cast<double>(size) * size / 1e6;
+				out << std::left << std::setw(10) << (std::to_string(size) + "^2")
+					<< std::setw(8) << (format == mipgen::ImageFormat::sRGBA8 ? "sRGBA8" : "RGBA8")
+					<< std::setw(14) << method.name
+					<< std::right << std::fixed << std::setprecision(2)
+					<< std::setw(12) << seconds * 1000.0 << std::setw(12) << megapixels / seconds << "\n";
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,129 @@
+#include "benchmarks.hpp"
+
+#include <png.hpp>
+
+#include <libdeflate.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <string>
+
+static void append_u32(std::vector<unsigned char>& out, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<unsigned char>(value >> shift));
+}
+
+static void append_chunk(std::vector<unsigned char>& out, const char* type, unsigned char const* data, size_t size) {
+	append_u32(out, static_cast<uint32_t>(size));
+	size_t const start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	append_u32(out, libdeflate_crc32(0, out.data() + start, size + 4));
+}
+
+// Filters a row with every filter type and keeps the one with the smallest sum of absolute differences, the
+// heuristic libpng uses.
+static void filter_row(unsigned char const* row, unsigned char const* prior, size_t size, uint32_t bpp, unsigned char* out) {
+	std::vector<unsigned char> candidate(size);
+	uint64_t best = UINT64_MAX;
+	for (unsigned char filter = 0; filter < 5; ++filter) {
+		uint64_t cost = 0;
+		for (size_t i = 0; i < size; ++i) {
+			int const a = i >= bpp ? row[i - bpp] : 0;
+			int const b = prior[i];
+			int const c = i >= bpp ? prior[i - bpp] : 0;
+			int predicted = 0;
+			if (filter == 1) predicted = a;
+			else if (filter == 2) predicted = b;
+			else if (filter == 3) predicted = (a + b) / 2;
+			else if (filter == 4) {
+				int const p = a + b - c;
+				int const pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+				predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+			}
+			candidate[i] = static_cast<unsigned char>(row[i] - predicted);
+			cost += static_cast<uint64_t>(std::abs(static_cast<signed char>(candidate[i])));
+		}
+		if (cost < best) {
+			best = cost;
+			out[0] = filter;
+			memcpy(out + 1, candidate.data(), size);
+		}
+	}
+}
+
+// 8-bit PNG of a synthetic image, compressed at libdeflate's default level like a typical exporter would.
+static std::vector<unsigned char> encode_png(std::vector<unsigned char> const& pixels, uint32_t width, uint32_t height, uint32_t channels) {
+	png::ColorType const types[] = { png::ColorType::Grey, png::ColorType::GreyAlpha, png::ColorType::RGB, png::ColorType::RGBA };
+	size_t const row_size = static_cast<size_t>(width) * channels;
+	std::vector<unsigned char> filtered(height * (row_size + 1));
+	std::vector<unsigned char> const zeros(row_size, 0);
+	for (uint32_t y = 0; y < height; ++y) {
+		unsigned char const* prior = y == 0 ? zeros.data() : pixels.data() + (y - 1) * row_size;
+		filter_row(pixels.data() + y * row_size, prior, row_size, channels, filtered.data() + y * (row_size + 1));
+	}
+
+	std::unique_ptr<libdeflate_compressor, void (*)(libdeflate_compressor*)> compressor(libdeflate_alloc_compressor(6), &libdeflate_free_compressor);
+	std::vector<unsigned char> stream(libdeflate_zlib_compress_bound(compressor.get(), filtered.size()));
+	stream.resize(libdeflate_zlib_compress(compressor.get(), filtered.data(), filtered.size(), stream.data(), stream.size()));
+
+	std::vector<unsigned char> file = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	std::vector<unsigned char> header;
+	append_u32(header, width);
+	append_u32(header, height);
+	header.insert(header.end(), { 8, static_cast<unsigned char>(types[channels - 1]), 0, 0, 0 });
+	append_chunk(file, "IHDR", header.data(), header.size());
+	// Exporters split the image data into small chunks, which the decoder has to join again.
+	constexpr size_t idat_size = 8192;
+	for (size_t offset = 0; offset < stream.size(); offset += idat_size) {
+		append_chunk(file, "IDAT", stream.data() + offset, std::min(idat_size, stream.size() - offset));
+	}
+	append_chunk(file, "IEND", nullptr, 0);
+	return file;
+}
+
+// Decodes generated PNG files with stb_image and with the png decoder, and checks that both produce the same texels.
+bool bench_png(ThreadPool& pool, std::ostream& out) {
+	out << std::left << std::setw(16) << "image" << std::setw(10) << "decoder"
+		<< std::right << std::setw(12) << "ms" << std::setw(12) << "MPix/s" << std::setw(12) << "in MB/s" << "\n";
+
+	stbi_set_flip_vertically_on_load_thread(true);
+	bool success = true;
+	for (uint32_t size : { 512u, 2048u, 4096u }) {
+		for (uint32_t channels : { 1u, 3u, 4u }) {
+			std::vector<unsigned char> const file = encode_png(synthetic_image(size, size, channels), size, size, channels);
+			std::string const name = std::to_string(size) + "^2 x" + std::to_string(channels);
+
+			std::vector<unsigned char> reference;
+			double const stb_seconds = time_average([&]() {
+				int width, height, file_channels;
+				unsigned char* pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &file_channels, channels);
+				if (pixels) reference.assign(pixels, pixels + static_cast<size_t>(size) * size * channels);
+				stbi_image_free(pixels);
+			});
+
+			std::unique_ptr<unsigned char[]> pixels;
+			bool decoded = false;
+			double const png_seconds = time_average([&]() {
+				png::Info info;
+				decoded = png::decode(pool, file.data(), file.size(), channels, true, info, pixels);
+			});
+			if (!decoded || reference.empty() || memcmp(reference.data(), pixels.get(), reference.size()) != 0) {
+				out << std::left << std::setw(16) << name << "png decoder does not match stb_image\n";
+				success = false;
+				continue;
+			}
+
+			double const megapixels = static_cast<double>(size) * size / 1e6;
+			double const megabytes = static_cast<double>(file.size()) / (1024.0 * 1024.0);
+			for (auto [decoder, seconds] : { std::pair{ "stb_image", stb_seconds }, std::pair{ "png", png_seconds } }) {
+				out << std::left << std::setw(16) << name << std::setw(10) << decoder << std::right << std::fixed << std::setprecision(2)
+					<< std::setw(12) << seconds * 1000.0 << std::setw(12) << megapixels / seconds << std::setw(12) << megabytes / seconds << "\n";
+			}
+		}
+	}
+	return success;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <mapped_file.hpp>
+#include <thread_pool.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Single file holding many converted assets, so a game opens and maps one file instead of one per asset.
+//
+// Layout, all integers little endian:
+//   Header     at offset 0, the rest of the first page is unused
+//   Payloads   every one starts on a page boundary and holds a complete asset file (.tx, .mesh) byte for byte
+//   TOC        starts on a page boundary: slot_count Slots, followed by the names they point into
+// The TOC is an open addressing hash table of the names, probed linearly from hash64(name) & (slot_count - 1). It is
+// at most half full, so a lookup touches one or two slots on average and needs nothing but the mapping.
+//
+// Updates append changed payloads and a new TOC behind the current one, and write the header last, so an interrupted
+// update leaves the previous archive intact. Replaced payloads and old TOCs stay behind as unused space, until it
+// outgrows the live data and the archive is rewritten.
+namespace archive {
+
+constexpr uint32_t page_size = 4096;
+constexpr char magic[4] = { 'A', 'T', 'P', 'K' };
+constexpr uint32_t version = 1;
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	uint64_t toc_offset;
+	uint64_t toc_size;
+	uint32_t entry_count;
+	// Power of two
+	uint32_t slot_count;
+	uint64_t reserved[4];
+};
+static_assert(sizeof(Header) == 64);
+
+struct Slot {
+	uint64_t name_hash;
+	uint64_t offset;
+	uint64_t size;
+	// hash64 of the payload, used to skip unchanged assets and to find duplicates
+	uint64_t content_hash;
+	// Relative to the end of the slots. Names are never empty, a name_size of 0 marks an empty slot.
+	uint32_t name_offset;
+	uint32_t name_size;
+};
+static_assert(sizeof(Slot) == 40);
+
+struct Entry {
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	uint64_t content_hash = 0;
+};
+
+// Read access to a mapped archive. Lookups allocate nothing and are safe to call from multiple threads at once.
+class Reader {
+public:
+	// On failure, the reader is not open and error describes why.
+	bool open(fs::path const& path, std::string& error);
+	bool is_open() const { return file.is_open(); }
+
+	// Finds an asset by the name it was stored under. Returns false if there is none.
+	bool find(std::string_view name, Entry& entry) const;
+	// The asset file of an entry, inside the mapping.
+	unsigned char const* data(Entry const& entry) const { return file.data() + entry.offset; }
+
+	uint32_t entry_count() const { return header.entry_count; }
+	uint32_t slot_count() const { return header.slot_count; }
+	// Reads a slot of the table, for iterating all entries. Returns false for empty slots.
+	bool slot(uint32_t index, std::string_view& name, Entry& entry) const;
+	// Where the next payload goes: the first page behind the TOC.
+	uint64_t data_end() const;
+
+private:
+	MappedFile file;
+	Header header = {};
+	unsigned char const* names = nullptr;
+	uint64_t names_size = 0;
+};
+
+struct Asset {
+	// Name to store the asset under, like the path of the output relative to the directory of the archive
+	std::string name;
+	// Converted asset file
+	fs::path file;
+	// The file may differ from the stored copy. Unchanged assets that are already stored are not read at all.
+	bool changed = true;
+};
+
+struct UpdateSettings {
+	// Drop stored assets that are not in the list, instead of keeping them
+	bool remove_missing = false;
+	// Store assets with identical contents once
+	bool dedup = false;
+	// Always write a compacted archive instead of appending
+	bool rewrite = false;
+};
+
+// Brings the archive at path up to date with the given assets, creating it if it does not exist. Only payloads that
+// changed are written.
+bool update(fs::path const& path, ThreadPool& pool, std::vector<Asset> const& assets, UpdateSettings const& settings, std::ostream& log);
+
+} // namespace archive
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <assetlib/asset_file.hpp>
+#include <assetlib/mesh.hpp>
+#include <assetlib/texture.hpp>
+#include <codec.hpp>
+#include <json_writer.hpp>
+#include <mapped_file.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// assetlib only describes the data layouts it ships with. Anything assettool writes beyond that is described in an
+// "assettool" object in the json header of the asset file, which readers that do not know about it ignore.
+namespace asset_ext {
+
+constexpr const char* metadata_key = "assettool";
+
+// Adds the given (finished) JSON object to the header of the asset file. Empty objects are not written.
+void attach_metadata(assetlib::AssetFile& file, JsonWriter const& object);
+void attach_metadata(std::string& header, JsonWriter const& object);
+
+// Destination of a converted asset: a new file, or a buffer owned by the caller. Writers reserve an upper bound of
+// the size, fill it in place and keep the part they used, so neither destination costs an extra copy.
+class Output {
+public:
+	// Writes a memory mapped file. A file that is never finished is deleted.
+	static Output file(fs::path path);
+	// Replaces the contents of the buffer with the asset.
+	static Output memory(std::vector<unsigned char>& buffer);
+
+	bool is_file() const { return buffer == nullptr; }
+	fs::path const& path() const { return file_path; }
+	std::vector<unsigned char>* memory_buffer() const { return buffer; }
+	// The path of a file output, for messages.
+	std::string name() const;
+
+	// Reserves capacity bytes and returns where they start. Returns null on failure, with error set.
+	unsigned char* reserve(uint64_t capacity, std::string& error);
+	// Keeps the first size bytes of the reservation.
+	bool finish(uint64_t size, std::string& error);
+
+private:
+	fs::path file_path;
+	std::vector<unsigned char>* buffer = nullptr;
+	MappedOutputFile mapped;
+};
+
+// Writes the asset file in the layout of assetlib::save_binary_file, straight into a reservation of the exact size.
+bool save_binary_file(Output& output, assetlib::AssetFile const& file, std::ostream& log);
+
+// Writes a mesh whose vertex format assetlib does not know. Produces the same header fields as assetlib::pack_mesh,
+// with the format set to Unknown and the extension metadata attached, followed by LZ4 compressed vertex and index
+// data. The data is compressed straight into the output, no AssetFile is built in memory.
+// The caller is expected to describe the real vertex layout in the extension metadata.
+// indices holds info.index_count indices, followed by detail_bytes of data that is not part of the full detail mesh,
+// like levels of detail and meshlets, which the caller describes in the extension metadata as well.
+bool save_mesh(Output& output, assetlib::MeshInfo const& info, size_t vertex_stride, void const* vertices, void const* indices,
+			   size_t detail_bytes, JsonWriter const& ext, std::ostream& log);
+
+// assetlib can only read payloads that are stored raw or as a single LZ4 block. Other codecs and chunked payloads
+// are compressed by assettool and described in the extension metadata, see write_compression(). An unchunked LZ4HC
+// payload is a standard LZ4 block.
+bool needs_extended_compression(codec::Settings const& settings, bool chunked);
+
+// Whether assettool compresses the payload with codec::compress_chunks instead of leaving it to assetlib: for
+// extended compression, and for LZ4HC, which assetlib reads but cannot write.
+bool compresses_payload(codec::Settings const& settings, bool chunked);
+
+// Compression mode for the assetlib header when needs_extended_compression() is false. LZ4 for both LZ4 and LZ4HC.
+assetlib::CompressionMode compression_mode(codec::Settings const& settings);
+
+// Describes a payload compressed with codec::compress_chunks:
+//   "compression": { "codec": "Zstd", "level": 19, "chunks": { "section": [...], "size": [...], "compressed_offset": [...], "compressed_size": [...] } }
+// Every chunk decompresses on its own, so readers can decode them in parallel or only the sections they need.
+void write_compression(JsonWriter& ext, codec::Settings const& settings, std::vector<codec::Chunk> const& chunks);
+
+// Writes a mesh like save_mesh, but with a blob the caller already compressed. The header states the compression and
+// format of info: a single LZ4 block keeps both, blobs described in the extension metadata need no compression and
+// the format set to Unknown, so readers without the extension reject the file.
+bool save_mesh_blob(Output& output, assetlib::MeshInfo const& info, size_t vertex_stride, size_t detail_bytes, std::vector<char> const& blob,
+					JsonWriter const& ext, std::ostream& log);
+
+// Name of the format as assetlib writes it into texture headers.
+const char* texture_format_name(assetlib::TextureFormat format);
+
+// Name of the format as assetlib writes it into mesh headers.
+const char* vertex_format_name(assetlib::VertexFormat format);
+
+// Header of a texture whose payload is not written through assetlib::pack_texture. Produces the same fields as
+// pack_texture, with the extension metadata attached.
+std::string texture_header(assetlib::TextureInfo const& info, JsonWriter const& ext);
+
+// Writes a texture with a blob the caller already compressed, under the header texture_header() produces for info.
+// Unlike going through assetlib::pack_texture, the uncompressed payload is never copied.
+bool save_texture_blob(Output& output, assetlib::TextureInfo const& info, std::vector<char> const& blob, JsonWriter const& ext, std::ostream& log);
+
+// Writes an asset whose payload is produced a piece at a time, so it never has to be in memory as a whole. Data goes
+// to the output as it is appended, and the header is written last, into space reserved in front of the blob. The JSON
+// header is padded with spaces to the reserved size. Files are written to <path>.tmp and renamed over the output when
+// finished. A file that is never finished is deleted, and the previous output is left untouched.
+class StreamedAssetWriter {
+public:
+	StreamedAssetWriter() = default;
+	~StreamedAssetWriter();
+
+	StreamedAssetWriter(StreamedAssetWriter const&) = delete;
+	StreamedAssetWriter& operator=(StreamedAssetWriter const&) = delete;
+
+	// Starts a new output, with room for a JSON header of up to max_json_size bytes. The output must
+	// outlive the writer.
+	bool open(Output& output, size_t max_json_size, std::string& error);
+	// Appends data to the blob. offset receives its position within the blob.
+	bool append(void const* data, size_t size, uint64_t& offset, std::string& error);
+	bool finish(char const* type, uint32_t version, std::string const& json, std::string& error);
+
+private:
+	fs::path path;
+	fs::path temp_path;
+	std::ofstream file;
+	// Set instead of the file for memory outputs
+	std::vector<unsigned char>* buffer = nullptr;
+	size_t json_capacity = 0;
+	uint64_t blob_size = 0;
+	bool finished = false;
+};
+
+} // namespace asset_ext
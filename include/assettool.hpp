@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mapped_file.hpp>
+#include <mipgen/mipgen.hpp>
+#include <options.hpp>
+#include <thread_pool.hpp>
+#include <assimp/Importer.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Library interface of the converters, for tools that convert assets in process instead of running assettool.
+//
+// Every call takes its settings as an argument and shares no mutable state with other calls, so any amount of
+// conversions with different options can run at the same time, as long as each thread uses its own Context. The
+// pool may be shared between all of them. The only process-wide state is the profiler, which is off unless
+// profile::enable() is called, and is safe to use from multiple threads.
+namespace assettool {
+
+enum class AssetType {
+	Unknown,
+	Texture, // .png, .bmp, .jpg, .tga
+	Mesh // .obj
+};
+
+// Type of an asset, from the extension of its source file.
+AssetType asset_type(fs::path const& path);
+
+// Path of the converted asset: the source path with the extension replaced by .tx or .mesh.
+fs::path output_path(fs::path const& source);
+
+// State that is expensive to create and can be reused across conversions. Not safe to use from more than one
+// thread at once, create one per thread that converts.
+class Context {
+public:
+	// Created on first use, so contexts that only ever see meshes never initialize the blit backend.
+	// Returns null when options.mip_method is not MipMethod::GPU.
+	mipgen::Context* mipgen(Options const& options);
+	Assimp::Importer& importer() { return assimp_importer; }
+
+private:
+	std::unique_ptr<mipgen::Context> mipgen_ctx;
+	Assimp::Importer assimp_importer;
+};
+
+// Converts an asset held in memory and replaces the contents of output with the converted asset file. The source
+// bytes are only read, and must stay valid during the call. On failure, output is left empty.
+bool convert(Context& ctx, ThreadPool& pool, Options const& options, AssetType type, unsigned char const* data, size_t size,
+			 std::vector<unsigned char>& output, std::ostream& log);
+
+// Converts the file at source and writes the converted asset file to output. The source is memory mapped and never
+// copied as a whole.
+bool convert_file(Context& ctx, ThreadPool& pool, Options const& options, fs::path const& source, fs::path const& output,
+				  std::ostream& log);
+
+// Like convert_file, for a source the caller already mapped, for example to hash it before converting.
+bool convert_mapped(Context& ctx, ThreadPool& pool, Options const& options, AssetType type, MappedFile const& source,
+					fs::path const& output, std::ostream& log);
+
+} // namespace assettool
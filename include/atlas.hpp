@@ -0,0 +1,89 @@
+#pragma once
+
+#include <mipgen/mipgen.hpp>
+#include <options.hpp>
+#include <thread_pool.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Packs many small textures into a few large ones: atlas pages, or the layers of a texture array.
+namespace atlas {
+
+struct Rect {
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+enum class Heuristic {
+	BestShortSideFit, // Free rectangle with the smallest leftover on its shorter side
+	BestLongSideFit, // Free rectangle with the smallest leftover on its longer side
+	BestAreaFit, // Smallest free rectangle
+	BottomLeft // Lowest position, then leftmost (Tetris style)
+};
+
+// MaxRects bin packer (Jylänki, "A Thousand Ways to Pack the Bin"). Keeps every maximal free rectangle of the
+// bin, so rectangles are placed without rotation into any free space left by earlier ones.
+class MaxRects {
+public:
+	MaxRects(uint32_t width, uint32_t height);
+
+	// Finds a place for a rectangle of the given size and reserves it. Returns false if it does not fit.
+	bool insert(uint32_t width, uint32_t height, Heuristic heuristic, Rect& placed);
+
+	// Smallest size that covers every rectangle placed so far
+	uint32_t used_width() const { return used_right; }
+	uint32_t used_height() const { return used_bottom; }
+
+private:
+	std::vector<Rect> free_rects;
+	uint32_t used_right = 0;
+	uint32_t used_bottom = 0;
+
+	void split_free_rects(Rect const& used);
+	void remove_contained_free_rects();
+};
+
+enum class PackMode {
+	Atlas, // Bin pack textures into atlas pages
+	Array // Stack textures of the same size into the layers of a texture array
+};
+
+struct PackSettings {
+	PackMode mode = PackMode::Atlas;
+	// The packed textures and their lookup table are written next to this path, with its extension replaced.
+	fs::path output;
+	// Largest width and height of an atlas page
+	uint32_t atlas_size = 2048;
+	// Texels around every sprite in an atlas, copied from the edges of the sprite
+	uint32_t padding = 4;
+};
+
+struct Input {
+	fs::path path;
+	// Name of the sprite in the lookup table, like its path relative to the input directory
+	std::string name;
+};
+
+// Packs the inputs according to settings.mode, converts them with the given options, and writes the textures and a
+// lookup table next to settings.output:
+//  - Atlas: sprites are bin packed into pages of at most settings.atlas_size, written as <output>_<page>.tx.
+//    Every sprite is surrounded by settings.padding texels copied from its edges, and the mip chain of the
+//    pages stops at the level where that gutter shrinks to a single texel, so filtering never mixes sprites. Pages
+//    are always downsampled with the box filter, whatever options.mip_filter says, since the wider filters would
+//    reach past the gutter.
+//  - Array: every input becomes a layer of <output>.tx, with a full mip chain. All inputs must have the same size.
+// The table, <output>.json, lists every sprite with its page or layer, its texel rectangle and its UV rectangle.
+// UVs follow the rows of the payload, which start at the bottom of the images.
+// mipgen_ctx is only used when options.mip_method is MipMethod::GPU, and may be null otherwise.
+bool pack_textures(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, PackSettings const& settings, std::vector<Input> const& inputs,
+				   std::ostream& log);
+
+} // namespace atlas
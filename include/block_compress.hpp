@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class ThreadPool;
+
+// Block compression (BCn) of texture mip chains. Every 4x4 block of texels is encoded independently, blocks on the
+// edge of a level that is not a multiple of 4 in size repeat the last row/column.
+namespace block_compress {
+
+enum class Format {
+	None, // Keep texels uncompressed
+	BC1, // RGB, 4 bits per texel
+	BC3, // RGBA, 8 bits per texel
+	BC4, // R, 4 bits per texel
+	BC5, // RG, 8 bits per texel
+	BC7 // RGBA, 8 bits per texel, highest quality
+};
+
+enum class Quality {
+	Fast, // Principal axis endpoints only. Meant for iteration builds.
+	High // Refines endpoints iteratively and searches around them. Meant for release builds.
+};
+
+const char* format_name(Format format);
+
+// Bytes per 4x4 block
+size_t block_size(Format format);
+
+// Size in bytes of a compressed mip chain of the given base size.
+size_t compressed_size(Format format, uint32_t width, uint32_t height, uint32_t mip_levels);
+
+// Compresses a mip chain laid out like mipgen's output (levels tightly packed, largest first) with the given amount
+// of 8-bit channels per texel. Missing color channels are treated as 0, a missing alpha channel as fully opaque.
+// Output must be at least compressed_size() bytes. Blocks are compressed in parallel on the pool.
+void compress_mip_chain(ThreadPool& pool, unsigned char const* pixels, uint32_t channels, uint32_t width, uint32_t height,
+						uint32_t mip_levels, Format format, Quality quality, unsigned char* output);
+
+// Compresses a band of row_count texel rows of one level, starting at a row that is a multiple of 4. Gives the same
+// blocks as compress_mip_chain(), as long as only the band at the bottom of a level has a row count that is not a
+// multiple of 4. Output receives ceil(row_count / 4) rows of blocks.
+void compress_rows(ThreadPool& pool, unsigned char const* rows, uint32_t channels, uint32_t width, uint32_t row_count,
+				   Format format, Quality quality, unsigned char* output);
+
+} // namespace block_compress
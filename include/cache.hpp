@@ -0,0 +1,63 @@
+#pragma once
+
+#include <options.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// Bump whenever the converters produce different output for the same input and options.
+constexpr uint32_t converter_version = 4;
+
+// Fingerprint of every setting that influences the converted output, including the tool and asset versions.
+uint64_t hash_options(Options const& options);
+
+// Persistent manifest of previous conversions, stored next to the converted assets.
+// An output is considered up to date when it still exists unmodified and was produced from the same source bytes
+// with the same options. Source size and modification time are checked first, so unchanged files are never read.
+class ConversionCache {
+public:
+	struct Lookup {
+		bool up_to_date = false;
+		// The output is still valid, but the timestamp of the source changed. Its contents may be identical, which
+		// matches_contents() tells from their hash.
+		bool check_contents = false;
+	};
+
+	static constexpr const char* manifest_name = ".assettool-cache";
+
+	// Loads the manifest in the given directory. A missing or unreadable manifest yields an empty cache.
+	explicit ConversionCache(fs::path directory);
+
+	// All member functions are safe to call from multiple threads at once.
+	// Only looks at file sizes and timestamps, the source is never read.
+	Lookup lookup(fs::path const& source, fs::path const& output, uint64_t options_hash);
+	// Whether the source still has the contents its output was produced from. If so, its new timestamp is
+	// remembered, so the next lookup is up to date without hashing it again.
+	bool matches_contents(fs::path const& source, uint64_t content_hash);
+	void record(fs::path const& source, fs::path const& output, uint64_t options_hash, uint64_t content_hash);
+
+	// Writes the manifest back to disk if anything changed.
+	bool save();
+
+private:
+	struct Entry {
+		uint64_t content_hash = 0;
+		uint64_t options_hash = 0;
+		int64_t source_time = 0;
+		uintmax_t source_size = 0;
+		int64_t output_time = 0;
+		uintmax_t output_size = 0;
+	};
+
+	fs::path directory;
+	std::mutex mutex;
+	std::unordered_map<std::string, Entry> entries;
+	bool dirty = false;
+
+	std::string key(fs::path const& source) const;
+};
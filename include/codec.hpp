@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// General purpose compression of asset payloads, either as one block or as independently compressed chunks.
+namespace codec {
+
+enum class Codec {
+	None,
+	LZ4, // Fastest to decode. Readable by every assetlib reader.
+	LZ4HC, // Slower to encode, same format and decode speed as LZ4
+	Zstd // Densest, decodes slower than LZ4
+};
+
+struct Settings {
+	Codec codec = Codec::LZ4;
+	// Compression level, 0 selects the default: 9 for LZ4HC, 19 for Zstd. Ignored for None and LZ4.
+	int level = 0;
+};
+
+// Chunked payloads are split at section boundaries (mip levels, vertex and index data) and at most this many bytes.
+constexpr size_t default_chunk_size = 256 * 1024;
+
+struct Chunk {
+	// Index of the section the chunk belongs to, see compress_chunks()
+	uint32_t section = 0;
+	// Uncompressed size. Chunks are stored in payload order, so uncompressed offsets are the sum of previous sizes.
+	uint64_t size = 0;
+	uint64_t compressed_offset = 0;
+	uint64_t compressed_size = 0;
+};
+
+const char* codec_name(Codec codec);
+
+// Parses "none", "lz4", "lz4hc" or "zstd", optionally followed by ":level". Returns false for unknown codecs and
+// levels out of range.
+bool parse_settings(std::string const& str, Settings& settings);
+
+// Level that is used for the settings, with 0 resolved to the codec default.
+int effective_level(Settings const& settings);
+
+// Upper bound of the compressed size of size bytes.
+size_t compress_bound(Codec codec, size_t size);
+
+// Compresses one block. Returns the compressed size, or 0 on failure.
+size_t compress(Settings const& settings, void const* src, size_t size, void* dst, size_t capacity);
+
+// Decompresses one block of exactly size bytes. Returns false on corrupt input.
+bool decompress(Codec codec, void const* src, size_t compressed_size, void* dst, size_t size);
+
+// Contiguous part of a payload, like a mip level or the vertex data of a mesh.
+struct Section {
+	void const* data = nullptr;
+	size_t size = 0;
+};
+
+// Splits the sections into chunks of at most max_chunk_size bytes and compresses them in parallel. Chunks never cross
+// a section boundary. The compressed chunks are stored back to back in blob, in section order.
+// Returns false if a chunk could not be compressed.
+bool compress_chunks(ThreadPool& pool, Settings const& settings, std::vector<Section> const& sections, size_t max_chunk_size,
+					 std::vector<char>& blob, std::vector<Chunk>& chunks);
+
+} // namespace codec
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <mipgen/mipgen.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+// Mip chain generation on the CPU, for machines without a GPU.
+// Produces the same output layout as mipgen: every level tightly packed after the previous one, starting with the
+// unmodified source image. Levels of sRGB formats are filtered in linear space. Alpha is always treated as linear.
+namespace cpu_mipgen {
+
+enum class Filter {
+	Box, // 2x2 average
+	Kaiser, // Kaiser-windowed sinc, sharper than box with little ringing
+	Lanczos // Lanczos-3, sharpest, may ring around hard edges
+};
+
+uint32_t get_mip_count(mipgen::ImageInfo const& info);
+
+// Size in bytes of the full mip chain. Equal to mipgen::output_buffer_size() for the same image.
+size_t output_buffer_size(mipgen::ImageInfo const& info);
+
+// Writes the full mip chain to output, which must be at least output_buffer_size(info) bytes.
+// Rows of each level are filtered in parallel on the given pool.
+void generate_mipmap(ThreadPool& pool, mipgen::ImageInfo const& info, Filter filter, unsigned char* output);
+
+// Builds the same mip chain as generate_mipmap() from rows of the source image that arrive a strip at a time, from the
+// first row to the last. Only the rows the filters still need are kept, so memory use depends on the image width and
+// strip height, but not on the image height.
+class MipStream {
+public:
+	// Receives finished rows of a level, level 0 included. Rows of each level arrive in order.
+	using RowSink = std::function<void(uint32_t level, unsigned char const* rows, uint32_t row_count)>;
+
+	// info.pixels is not used.
+	MipStream(mipgen::ImageInfo const& info, Filter filter);
+	~MipStream();
+
+	MipStream(MipStream const&) = delete;
+	MipStream& operator=(MipStream const&) = delete;
+
+	// Feeds the next row_count rows of the source image. Every row that can be completed with them is passed to
+	// sink before this returns. Rows are filtered in parallel on the pool.
+	void push(ThreadPool& pool, unsigned char const* rows, uint32_t row_count, RowSink const& sink);
+
+private:
+	struct Level;
+
+	uint32_t width;
+	uint32_t channels;
+	uint32_t srgb_channels;
+	std::vector<std::unique_ptr<Level>> levels;
+
+	void feed(ThreadPool& pool, size_t index, void const* rows, uint32_t row_count, RowSink const& sink);
+};
+
+} // namespace cpu_mipgen
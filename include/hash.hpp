@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast non-cryptographic 64-bit hash (XXH64). Used to fingerprint asset sources and conversion settings.
+uint64_t hash64(void const* data, size_t size, uint64_t seed = 0);
+
+// Feeds a trivially copyable value into a running hash.
+template<typename T>
+uint64_t hash_combine(uint64_t seed, T const& value) {
+	return hash64(&value, sizeof(T), seed);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+// Row by row decoding of images, for textures too large to decode as a whole. Readers work straight on the encoded
+// file, and produce rows like stb_image does: converted to the requested channel count with the same rules, and
+// bottom row first when flipped, like stbi_set_flip_vertically_on_load(true).
+namespace image_rows {
+
+class Reader;
+
+// Returns a reader for files that can be decoded a row at a time: uncompressed TGA (8-bit grey, 24 and 32-bit color)
+// and uncompressed 24-bit BMP. Returns null for every other file, which then has to be decoded as a whole.
+// The data must outlive the reader. With release_rows, which is only valid for read-only file mappings, the pages of
+// every row are dropped from memory once the row is read.
+std::unique_ptr<Reader> open(unsigned char const* data, uint64_t size, uint32_t channels, bool flip_vertically, bool release_rows);
+
+class Reader {
+public:
+	virtual ~Reader() = default;
+
+	uint32_t width() const { return image_width; }
+	uint32_t height() const { return image_height; }
+
+	// Decodes the next row_count rows into dst, tightly packed. Returns false if the file is truncated or corrupt.
+	virtual bool read(unsigned char* dst, uint32_t row_count) = 0;
+
+protected:
+	uint32_t image_width = 0;
+	uint32_t image_height = 0;
+	// Channels in the file, and in the rows handed out
+	uint32_t file_channels = 0;
+	uint32_t channels = 0;
+	bool flip = false;
+	bool release_rows = false;
+
+	friend std::unique_ptr<Reader> open(unsigned char const* data, uint64_t size, uint32_t channels, bool flip_vertically, bool release_rows);
+};
+
+// Converts count texels between channel counts the way stb_image does.
+void convert_channels(unsigned char const* src, uint32_t src_channels, unsigned char* dst, uint32_t dst_channels, uint32_t count);
+
+} // namespace image_rows
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Minimal streaming JSON writer. Commas between members and array elements are inserted automatically.
+//  JsonWriter json;
+//  json.begin_object().key("size").value(16).key("name").value("tex").end_object();
+class JsonWriter {
+public:
+	JsonWriter& begin_object();
+	JsonWriter& end_object();
+	JsonWriter& begin_array();
+	JsonWriter& end_array();
+
+	JsonWriter& key(std::string_view name);
+
+	JsonWriter& value(std::string_view str);
+	JsonWriter& value(const char* str);
+	JsonWriter& value(bool b);
+	JsonWriter& value(double number);
+	JsonWriter& value(float number);
+	JsonWriter& value(int64_t number);
+	JsonWriter& value(uint64_t number);
+	JsonWriter& value(int32_t number);
+	JsonWriter& value(uint32_t number);
+
+	// Writes an array with all values in the range.
+	template<typename T>
+	JsonWriter& array(T const* values, size_t count) {
+		begin_array();
+		for (size_t i = 0; i < count; ++i) {
+			value(values[i]);
+		}
+		return end_array();
+	}
+
+	std::string const& str() const;
+
+private:
+	std::string out;
+	// One entry per open object or array, true while nothing was written into it yet.
+	std::vector<bool> empty_scope;
+	bool after_key = false;
+
+	void separator();
+	void write_string(std::string_view str);
+};
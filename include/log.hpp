@@ -0,0 +1,31 @@
+#pragma once
+
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// Thread-safe log output. Each conversion writes to its own LogBuffer, which hands its contents to the sink
+// in one piece when it is flushed or destroyed. This keeps the output of concurrent conversions from interleaving.
+class LogSink {
+public:
+	explicit LogSink(std::ostream& out);
+
+	void write(std::string const& text);
+
+private:
+	std::mutex mutex;
+	std::ostream& out;
+};
+
+class LogBuffer : public std::ostringstream {
+public:
+	explicit LogBuffer(LogSink& sink);
+	~LogBuffer();
+
+	// Sends everything written so far to the sink.
+	void flush_to_sink();
+
+private:
+	LogSink& sink;
+};
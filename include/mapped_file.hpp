@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Read-only memory mapping of a whole file. Pages are only read from disk when touched, so decoders can work
+// straight from the page cache without copying the file into memory first.
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+	MappedFile(MappedFile&& rhs) noexcept;
+	MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+	// On failure, the returned file is not open and error describes why. Empty files are open with a size of 0.
+	static MappedFile open(fs::path const& path, std::string& error);
+
+	bool is_open() const { return opened; }
+	unsigned char const* data() const { return memory; }
+	uint64_t size() const { return bytes; }
+
+private:
+	void close();
+
+	unsigned char const* memory = nullptr;
+	uint64_t bytes = 0;
+	bool opened = false;
+};
+
+// Drops pages of a read-only mapping from the memory of the process. They stay in the page cache and are read again
+// if touched, so this only saves memory for data that is read once, like the rows of a texture that is streamed.
+void release_pages(void const* data, size_t size);
+
+// Source bytes of a conversion: a mapped file, or a buffer owned by the caller. Converters only release the pages of
+// mapped sources, caller buffers are never touched beyond reading them.
+struct InputData {
+	unsigned char const* data = nullptr;
+	uint64_t size = 0;
+	bool mapped = false;
+
+	InputData() = default;
+	InputData(unsigned char const* data, uint64_t size) : data(data), size(size) {}
+	InputData(MappedFile const& file) : data(file.data()), size(file.size()), mapped(true) {}
+};
+
+// Writable memory mapping of a new file with a fixed capacity, for outputs whose size is only bounded up front.
+// The data goes to <path>.tmp. finish() truncates it to the amount of bytes actually written and renames it over
+// path. A file that is never finished is deleted, so failed conversions neither leave truncated outputs behind nor
+// destroy the previous output.
+class MappedOutputFile {
+public:
+	MappedOutputFile() = default;
+	~MappedOutputFile();
+
+	MappedOutputFile(MappedOutputFile const&) = delete;
+	MappedOutputFile& operator=(MappedOutputFile const&) = delete;
+	MappedOutputFile(MappedOutputFile&& rhs) noexcept;
+	MappedOutputFile& operator=(MappedOutputFile&& rhs) noexcept;
+
+	// Creates the temporary file and reserves disk space for the whole capacity, so a full disk is reported here
+	// rather than while writing. On failure, the returned file is not open and error describes why.
+	static MappedOutputFile create(fs::path const& path, uint64_t capacity, std::string& error);
+
+	bool is_open() const { return opened; }
+	unsigned char* data() { return memory; }
+	uint64_t capacity() const { return bytes; }
+
+	// Unmaps the file, truncates it to size bytes, which must not exceed the capacity, and moves it to its path.
+	bool finish(uint64_t size, std::string& error);
+
+private:
+	void close();
+	// Closes and deletes an unfinished file.
+	void discard();
+
+	fs::path path;
+	fs::path temp_path;
+	unsigned char* memory = nullptr;
+	uint64_t bytes = 0;
+	bool opened = false;
+#ifdef _WIN32
+	void* file = nullptr;
+#else
+	int file = -1;
+#endif
+};
@@ -1,6 +1,12 @@
 #pragma once
 
-#include <plib/stream.hpp>
+#include <asset_ext.hpp>
+#include <mapped_file.hpp>
+#include <options.hpp>
+#include <assimp/Importer.hpp>
+#include <thread_pool.hpp>
 #include <iostream>
 
-bool convert_mesh(plib::binary_input_stream& in, plib::binary_output_stream& out, std::ostream& log);
\ No newline at end of file
+// Converts every mesh in the scene into one shared vertex and index buffer, with a table of submesh ranges.
+bool convert_mesh(Assimp::Importer& importer, ThreadPool& pool, Options const& options, InputData const& in, asset_ext::Output& output,
+				  std::ostream& log);
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Reordering and welding of indexed triangle lists for faster rendering.
+// Vertices are treated as opaque blobs of `stride` bytes, so every function works with any vertex format.
+namespace mesh_optimize {
+
+// Size of the simulated FIFO post-transform cache used for statistics.
+constexpr uint32_t stats_cache_size = 16;
+
+struct Stats {
+	// Average cache miss ratio: transformed vertices per triangle. 0.5 is the optimum for large regular grids, 3 the worst case.
+	float acmr = 0.0f;
+	// Average transform to vertex ratio: transformed vertices per unique vertex. 1 is optimal.
+	float atvr = 0.0f;
+};
+
+Stats analyze_vertex_cache(uint32_t const* indices, size_t index_count, size_t vertex_count);
+
+// Merges bitwise identical vertices and rewrites the indices to match. Returns the new vertex count,
+// the first that many vertices of the buffer are valid afterwards.
+size_t deduplicate_vertices(void* vertices, size_t vertex_count, size_t stride, uint32_t* indices, size_t index_count);
+
+// Reorders triangles for post-transform cache locality, using Tom Forsyth's linear-speed algorithm.
+void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count);
+
+// Reorders clusters of triangles so that outward facing clusters are drawn first, which reduces overdraw.
+// Clusters are split where the cache optimized order already starts over, so cache efficiency is mostly preserved.
+// Positions are three floats at the start of every vertex.
+void optimize_overdraw(uint32_t* indices, size_t index_count, void const* vertices, size_t vertex_count, size_t stride);
+
+// Reorders vertices in the order the index buffer first references them, and rewrites the indices.
+// Unreferenced vertices are removed. Returns the new vertex count.
+size_t optimize_vertex_fetch(void* vertices, size_t vertex_count, size_t stride, uint32_t* indices, size_t index_count);
+
+} // namespace mesh_optimize
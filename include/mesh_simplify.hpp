@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Mesh simplification for LOD generation.
+namespace mesh_simplify {
+
+// Simplifies an indexed triangle list with quadric error metrics (Garland & Heckbert 1997).
+// Edges are collapsed onto one of their existing endpoints, so the result still indexes the original vertex buffer.
+// All vertices sharing a position move together, each onto the vertex at the other end it shares a triangle with.
+// Positions on open borders, and seams, never move, which keeps cracks and texture seams from opening up. A seam is a
+// position whose vertices differ in the seam_size bytes at seam_offset, like their texture coordinates. Vertices
+// that only differ in other attributes, like the normals of flat shaded meshes, are not seams.
+//
+// Stops once the index count is at most target_index_count, or when the next collapse would exceed target_error.
+// Errors are relative to the size of the mesh: 0.01 means 1% of its bounding box diagonal.
+// Positions are three floats at the start of every vertex. Writes the result to destination, which may alias indices
+// and needs room for index_count indices. Returns the new index count, and the error reached in result_error.
+size_t simplify(uint32_t* destination, uint32_t const* indices, size_t index_count, void const* vertices, size_t vertex_count, size_t stride,
+				size_t seam_offset, size_t seam_size, size_t target_index_count, float target_error, float* result_error = nullptr);
+
+} // namespace mesh_simplify
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits indexed triangle lists into small clusters for mesh shaders and cluster culling.
+namespace meshlet {
+
+// Limits recommended for mesh shaders on current hardware. 124 triangles leave room for a 4-byte
+// count in a 128 * 3 byte primitive buffer.
+constexpr size_t max_vertices = 64;
+constexpr size_t max_triangles = 124;
+
+struct Meshlet {
+	// Range in Meshlets::vertices
+	uint32_t vertex_offset = 0;
+	uint32_t vertex_count = 0;
+	// Range in Meshlets::triangles, in triangles
+	uint32_t triangle_offset = 0;
+	uint32_t triangle_count = 0;
+
+	// Bounding sphere
+	float center[3] = {};
+	float radius = 0.0f;
+
+	// Cone around the normals of all triangles. Every triangle is backfacing, and the meshlet can be culled, when
+	//   dot(center - camera_position, cone_axis) >= cone_cutoff * length(center - camera_position) + radius
+	// cone_cutoff is 1 when the normals are spread too far for a cone to be useful, which fails the test.
+	float cone_axis[3] = {};
+	float cone_cutoff = 1.0f;
+};
+
+struct Meshlets {
+	std::vector<Meshlet> meshlets;
+	// Vertices used by each meshlet, as indices into the vertex buffer.
+	std::vector<uint32_t> vertices;
+	// Three indices into the vertices of its meshlet per triangle.
+	std::vector<uint8_t> triangles;
+};
+
+// Groups consecutive triangles into meshlets. Run optimize_vertex_cache on the indices first: the
+// resulting locality is what keeps meshlets small and tightly bounded.
+// Positions are three floats at the start of every vertex.
+Meshlets build(uint32_t const* indices, size_t index_count, void const* vertices, size_t vertex_count, size_t stride);
+
+} // namespace meshlet
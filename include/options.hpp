@@ -2,14 +2,55 @@
 
 #include <assetlib/texture.hpp>
 #include <assetlib/mesh.hpp>
+#include <cpu_mipgen.hpp>
+#include <block_compress.hpp>
+#include <codec.hpp>
 #include <filesystem>
+#include <vector>
 
 namespace fs = std::filesystem;
 
-struct Options {
-    fs::path file;
-    assetlib::ColorSpace colorspace;
-    int channels;
+enum class MipMethod {
+    GPU, // mipgen image blits, requires a GPU
+    CPU // cpu_mipgen, works on headless machines
+};
+
+enum class MeshOptimization {
+    None, // Keep vertices and triangles in source order
+    VertexCache, // Weld duplicate vertices, reorder for vertex cache and vertex fetch locality
+    Overdraw // VertexCache, and also reorder triangle clusters to reduce overdraw
 };
 
-extern Options g_options;
\ No newline at end of file
+enum class OutputVertexFormat {
+    PNTV32, // 32-bit floats for everything
+    Compact // vertex_quantize::PNTVQVertex
+};
+
+// Settings of a conversion. Every converter takes them as an argument, so conversions with different settings can run
+// at the same time. The defaults are those of the command line tool.
+struct Options {
+    // Unknown picks the color space per file: from the sRGB and gAMA chunks of PNG files, linear RGB otherwise.
+    assetlib::ColorSpace colorspace = assetlib::ColorSpace::Unknown;
+    int channels = 4;
+    MipMethod mip_method = MipMethod::GPU;
+    // Only used with MipMethod::CPU
+    cpu_mipgen::Filter mip_filter = cpu_mipgen::Filter::Box;
+    // Block compression applied to textures after mip generation
+    block_compress::Format block_format = block_compress::Format::None;
+    block_compress::Quality block_quality = block_compress::Quality::High;
+    MeshOptimization mesh_optimization = MeshOptimization::VertexCache;
+    OutputVertexFormat vertex_format = OutputVertexFormat::PNTV32;
+    // Simplified levels of detail, as fractions of the triangle count of the full mesh. Empty disables LODs.
+    std::vector<float> lod_ratios;
+    // Largest simplification error allowed for a level of detail, relative to the size of the mesh.
+    float lod_error = 0.01f;
+    // Also split the mesh and every level of detail into meshlets.
+    bool meshlets = false;
+    // Codec for the binary payload of every asset
+    codec::Settings compression;
+    // Compress every mip level, and fixed-size chunks of mesh data, independently
+    bool chunked = false;
+    // Textures whose conversion would take more memory than this many MiB are converted a strip of rows at a time.
+    // 0 means no limit. Applies to every conversion separately, so concurrent conversions can use this many times over.
+    int memory_budget_mb = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <assetlib/texture.hpp>
+
+#include <cstdint>
+#include <memory>
+
+class ThreadPool;
+
+// PNG decoding straight from memory. Image data is inflated with libdeflate in one call, rows are unfiltered with
+// SSE2 where available, and the conversion to the requested channel count runs on the thread pool.
+namespace png {
+
+enum class ColorType : uint32_t {
+	Grey = 0,
+	RGB = 2,
+	Palette = 3,
+	GreyAlpha = 4,
+	RGBA = 6
+};
+
+struct Info {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Bits per sample, or per palette index
+	uint32_t bit_depth = 0;
+	ColorType color_type = ColorType::Grey;
+	bool interlaced = false;
+	// Color space declared by an sRGB chunk, or by a gAMA chunk close to 1/2.2 (sRGB) or 1.0 (RGB).
+	// Unknown if the file declares neither, or describes its colors with an ICC profile.
+	assetlib::ColorSpace colorspace = assetlib::ColorSpace::Unknown;
+};
+
+bool check_signature(unsigned char const* data, uint64_t size);
+
+// Reads the header and the chunks in front of the image data. Returns false if the data is not a valid PNG file.
+bool read_info(unsigned char const* data, uint64_t size, Info& info);
+
+// Decodes a whole file into 8-bit texels with the given amount of channels. Texels are converted the way stb_image
+// converts them (16-bit samples keep their high byte, tRNS becomes alpha), and the bottom row comes first when
+// flipped, so the result matches stbi_load_from_memory with stbi_set_flip_vertically_on_load(true).
+// Returns false for corrupt files, for images over 16 GiB decoded, and for the ones the decoder does not support
+// (Apple's CgBI variant), without throwing when memory runs out.
+// CRCs are not checked, like in stb_image.
+bool decode(ThreadPool& pool, unsigned char const* data, uint64_t size, uint32_t channels, bool flip_vertically, Info& info,
+			std::unique_ptr<unsigned char[]>& pixels);
+
+} // namespace png
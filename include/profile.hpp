@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Per-stage timers and counters. Recording is off until enable() is called, and a disabled Scope costs one branch.
+// Scopes nest per thread, which trace viewers show as a flame graph.
+namespace profile {
+
+void enable();
+bool enabled();
+
+// Drops everything recorded so far.
+void reset();
+
+// Times a stage from construction to destruction. The name must outlive the profile (use string literals).
+class Scope {
+public:
+	explicit Scope(const char* name);
+	// The detail shows up in the trace, like the file a conversion works on.
+	Scope(const char* name, std::string detail);
+	~Scope();
+
+	Scope(Scope const&) = delete;
+	Scope& operator=(Scope const&) = delete;
+
+	void bytes_in(uint64_t bytes) { in += bytes; }
+	void bytes_out(uint64_t bytes) { out += bytes; }
+
+	// Records the stage now instead of at destruction. Does nothing when called again.
+	void end();
+
+private:
+	const char* name;
+	std::string detail;
+	std::chrono::steady_clock::time_point start;
+	uint64_t in = 0;
+	uint64_t out = 0;
+	bool active = false;
+};
+
+// Adds to a named counter.
+void count(const char* name, uint64_t value = 1);
+
+// Totals of all scopes with the same name.
+struct StageSummary {
+	std::string name;
+	uint64_t calls = 0;
+	double total_ms = 0.0;
+	double max_ms = 0.0;
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+	// Largest resident memory of the process seen when a call of the stage ended.
+	uint64_t max_rss = 0;
+};
+
+// Stages in order of first appearance.
+std::vector<StageSummary> summarize();
+
+// Resident memory of the process in bytes, now and at its peak so far. 0 where the platform does not tell.
+uint64_t current_rss();
+uint64_t peak_rss();
+
+// Writes a Chrome trace-event file ("traceEvents", readable by chrome://tracing and Perfetto). The stage summary,
+// counters and peak memory are stored next to the events under "assettool", which trace viewers ignore.
+bool write(fs::path const& path, std::string& error);
+
+} // namespace profile
@@ -1,8 +1,54 @@
 #pragma once
 
+#include <assetlib/texture.hpp>
+#include <asset_ext.hpp>
 #include <mipgen/mipgen.hpp>
-#include <plib/stream.hpp>
+#include <mapped_file.hpp>
+#include <options.hpp>
+#include <thread_pool.hpp>
 
 #include <iostream>
+#include <memory>
+#include <vector>
 
-bool convert_texture(mipgen::Context& ctx, plib::binary_input_stream& in, plib::binary_output_stream& out, std::ostream& log);
\ No newline at end of file
+// mipgen_ctx is only used when options.mip_method is MipMethod::GPU, and may be null otherwise.
+bool convert_texture(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, InputData const& in, asset_ext::Output& output,
+					 std::ostream& log);
+
+// Source texture decoded to options.channels channels, bottom row first.
+struct DecodedTexture {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	unsigned char* pixels = nullptr;
+	// Owns the pixels decoded by the png decoder, stb_image allocates the others.
+	std::unique_ptr<unsigned char[]> png_pixels;
+
+	DecodedTexture() = default;
+	DecodedTexture(DecodedTexture const&) = delete;
+	DecodedTexture& operator=(DecodedTexture const&) = delete;
+	~DecodedTexture();
+};
+
+// Decodes a whole texture. PNG files go through the png decoder, everything else through stb_image.
+bool decode_texture(ThreadPool& pool, Options const& options, InputData const& in, DecodedTexture& texture);
+
+// Color space of a texture. With --colorspace auto, PNG files declare it with their sRGB and gAMA chunks, and
+// everything else is treated as linear.
+assetlib::ColorSpace texture_colorspace(Options const& options, InputData const& in);
+
+// One or more decoded images of the same size, stored as a single texture asset.
+struct TextureLayers {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	assetlib::ColorSpace colorspace = assetlib::ColorSpace::RGB;
+	// Texels of every layer, options.channels channels each
+	std::vector<unsigned char const*> layers;
+	// Amount of mip levels to keep, counting the base level. 0 keeps the full chain.
+	uint32_t max_mip_levels = 0;
+};
+
+// Generates mips for every layer, then block compresses, compresses and saves the texture like convert_texture does.
+// Every layer is stored with its own mip chain, one after the other. Textures with more than one layer are marked
+// with a "layers" count in the assettool metadata, and have format Unknown in the header.
+bool encode_texture(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, TextureLayers const& texture, asset_ext::Output& output,
+					std::ostream& log);
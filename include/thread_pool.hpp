@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool.
+// Every worker owns a queue of tasks. A worker pops new work from the back of its own queue, and when that
+// runs dry it steals from the front of the other queues. Tasks receive the index of the worker running them,
+// so callers can keep long-lived per-worker state (importers, mipgen contexts, ...) in a plain array.
+class ThreadPool {
+public:
+	using Task = std::function<void(size_t worker)>;
+
+	// Spawns the given amount of workers. A value of 0 uses one worker per hardware thread.
+	explicit ThreadPool(size_t workers = 0);
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+
+	size_t size() const;
+
+	// Queues a task. When called from inside a task, the new task goes to the calling worker's own queue.
+	void push(Task task);
+
+	// Blocks until every queued task has finished. Must not be called from inside a task.
+	void wait();
+
+	// Calls fn(begin, end) over [0, count) split into ranges of at most grain elements, and returns once all of them are done.
+	// The calling thread works on the ranges too, so this is safe to call from inside a task, even if every other worker is busy.
+	void parallel_for(size_t count, size_t grain, std::function<void(size_t begin, size_t end)> const& fn);
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+
+	// Amount of tasks sitting in a queue, and amount of tasks that were pushed but have not finished yet.
+	std::atomic<size_t> queued = 0;
+	std::atomic<size_t> pending = 0;
+	std::atomic<size_t> next_queue = 0;
+	bool stop = false;
+
+	bool try_pop(size_t worker, Task& task);
+	void run(size_t worker);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <assetlib/mesh.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact vertex formats, written instead of PNTV32 when requested.
+namespace vertex_quantize {
+
+// Position, normal, tangent and uv in 20 bytes instead of 44.
+//  - position: UNORM16 relative to the bounding box of the mesh, dequantized as min + value / 65535 * (max - min)
+//  - normal, tangent: octahedral encoding, SNORM16
+//  - uv: half float, so tiling coordinates outside of [0, 1] keep working
+struct PNTVQVertex {
+	uint16_t position[3];
+	int16_t normal[2];
+	int16_t tangent[2];
+	uint16_t uv[2];
+	uint16_t padding; // keeps every vertex 4-byte aligned
+};
+static_assert(sizeof(PNTVQVertex) == 20, "PNTVQVertex must be tightly packed");
+
+constexpr const char* pntvq_name = "PNTVQ";
+
+struct Bounds {
+	float min[3] = {};
+	float max[3] = {};
+};
+
+Bounds compute_bounds(assetlib::PNTV32Vertex const* vertices, size_t count);
+
+// Quantizes vertices relative to the given bounds.
+std::vector<PNTVQVertex> quantize(assetlib::PNTV32Vertex const* vertices, size_t count, Bounds const& bounds);
+
+uint16_t float_to_half(float value);
+void encode_octahedral(float const* direction, int16_t* encoded);
+
+} // namespace vertex_quantize
@@ -0,0 +1,343 @@
+#include <archive.hpp>
+#include <hash.hpp>
+#include <profile.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace archive {
+
+static uint64_t align_up(uint64_t value) {
+	return (value + page_size - 1) / page_size * page_size;
+}
+
+static uint64_t name_hash(std::string_view name) {
+	return hash64(name.data(), name.size());
+}
+
+bool Reader::open(fs::path const& path, std::string& error) {
+	file = MappedFile::open(path, error);
+	if (!file.is_open()) return false;
+
+	auto invalid = [&](std::string const& reason) {
+		error = path.generic_string() + " is not a valid archive: " + reason;
+		file = MappedFile();
+		return false;
+	};
+	if (file.size() < sizeof(Header)) return invalid("file too small");
+	memcpy(&header, file.data(), sizeof(Header));
+	if (memcmp(header.magic, magic, sizeof(magic)) != 0) return invalid("wrong magic");
+	if (header.version != version) return invalid("unsupported version " + std::to_string(header.version));
+	if (header.toc_offset > file.size() || header.toc_size > file.size() - header.toc_offset) return invalid("table of contents out of bounds");
+	if (header.slot_count == 0 || (header.slot_count & (header.slot_count - 1)) != 0) return invalid("slot count is not a power of two");
+	uint64_t const slots_size = static_cast<uint64_t>(header.slot_count) * sizeof(Slot);
+	if (slots_size > header.toc_size) return invalid("table of contents out of bounds");
+
+	names = file.data() + header.toc_offset + slots_size;
+	names_size = header.toc_size - slots_size;
+	return true;
+}
+
+bool Reader::slot(uint32_t index, std::string_view& name, Entry& entry) const {
+	Slot slot;
+	memcpy(&slot, file.data() + header.toc_offset + static_cast<uint64_t>(index) * sizeof(Slot), sizeof(Slot));
+	if (slot.name_size == 0) return false;
+	// Slots pointing outside the file read as empty.
+	if (slot.name_offset > names_size || slot.name_size > names_size - slot.name_offset) return false;
+	if (slot.offset > file.size() || slot.size > file.size() - slot.offset) return false;
+	name = std::string_view(reinterpret_cast<const char*>(names) + slot.name_offset, slot.name_size);
+	entry = { slot.offset, slot.size, slot.content_hash };
+	return true;
+}
+
+bool Reader::find(std::string_view name, Entry& entry) const {
+	if (!file.is_open() || name.empty()) return false;
+	uint64_t const hash = name_hash(name);
+	uint32_t const mask = header.slot_count - 1;
+	uint32_t index = static_cast<uint32_t>(hash) & mask;
+	for (uint32_t probe = 0; probe < header.slot_count; ++probe, index = (index + 1) & mask) {
+		uint64_t stored_hash;
+		uint32_t name_size;
+		unsigned char const* slot_data = file.data() + header.toc_offset + static_cast<uint64_t>(index) * sizeof(Slot);
+		memcpy(&stored_hash, slot_data + offsetof(Slot, name_hash), sizeof(stored_hash));
+		memcpy(&name_size, slot_data + offsetof(Slot, name_size), sizeof(name_size));
+		// Names are inserted at the first empty slot of their probe sequence, so an empty slot ends the search.
+		if (name_size == 0) return false;
+		if (stored_hash != hash || name_size != name.size()) continue;
+		std::string_view stored_name;
+		if (slot(index, stored_name, entry) && stored_name == name) return true;
+	}
+	return false;
+}
+
+uint64_t Reader::data_end() const {
+	return align_up(header.toc_offset + header.toc_size);
+}
+
+// Compares a stored payload with the contents of a file, reading the payload back from the archive.
+static bool same_contents(std::fstream& archive, Entry const& entry, unsigned char const* data, uint64_t size) {
+	if (entry.size != size) return false;
+	constexpr size_t chunk_size = 1024 * 1024;
+	std::unique_ptr<char[]> buffer = std::make_unique<char[]>(chunk_size);
+	archive.seekg(static_cast<std::streamoff>(entry.offset));
+	for (uint64_t done = 0; done < size;) {
+		size_t const count = static_cast<size_t>(std::min<uint64_t>(chunk_size, size - done));
+		if (!archive.read(buffer.get(), static_cast<std::streamsize>(count))) {
+			archive.clear();
+			return false;
+		}
+		if (memcmp(buffer.get(), data + done, count) != 0) return false;
+		done += count;
+	}
+	return true;
+}
+
+// Writes the table of contents at offset, then the header that points to it. The header goes last, so readers never
+// see a header whose table is not written yet.
+static bool write_toc(std::fstream& file, uint64_t offset, std::map<std::string, Entry> const& entries) {
+	uint32_t slot_count = 16;
+	while (slot_count < entries.size() * 2) slot_count *= 2;
+	uint32_t const mask = slot_count - 1;
+
+	std::vector<Slot> slots(slot_count, Slot{});
+	std::string names;
+	for (auto const& [name, entry] : entries) {
+		uint64_t const hash = name_hash(name);
+		uint32_t index = static_cast<uint32_t>(hash) & mask;
+		while (slots[index].name_size != 0) index = (index + 1) & mask;
+		slots[index] = { hash, entry.offset, entry.size, entry.content_hash, static_cast<uint32_t>(names.size()), static_cast<uint32_t>(name.size()) };
+		names += name;
+	}
+
+	Header header = {};
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.toc_offset = offset;
+	header.toc_size = slots.size() * sizeof(Slot) + names.size();
+	header.entry_count = static_cast<uint32_t>(entries.size());
+	header.slot_count = slot_count;
+
+	file.seekp(static_cast<std::streamoff>(offset));
+	file.write(reinterpret_cast<const char*>(slots.data()), static_cast<std::streamsize>(slots.size() * sizeof(Slot)));
+	file.write(names.data(), static_cast<std::streamsize>(names.size()));
+	file.flush();
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	file.flush();
+	return static_cast<bool>(file);
+}
+
+// Writes a new archive with only the payloads that are still referenced, packed in the order of their names.
+static bool rewrite(fs::path const& path, std::fstream& file, std::map<std::string, Entry>& entries, uint64_t& written, std::string& error) {
+	fs::path temp_path = path;
+	temp_path += ".tmp";
+	std::fstream out(temp_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out) {
+		error = "Failed to create " + temp_path.generic_string();
+		return false;
+	}
+
+	constexpr size_t chunk_size = 1024 * 1024;
+	std::unique_ptr<char[]> buffer = std::make_unique<char[]>(chunk_size);
+	// Old offset to new offset, deduplicated entries share a payload.
+	std::unordered_map<uint64_t, uint64_t> moved;
+	uint64_t data_end = page_size;
+	for (auto& [name, entry] : entries) {
+		auto [it, inserted] = moved.emplace(entry.offset, data_end);
+		if (inserted) {
+			file.seekg(static_cast<std::streamoff>(entry.offset));
+			out.seekp(static_cast<std::streamoff>(data_end));
+			for (uint64_t done = 0; done < entry.size;) {
+				size_t const count = static_cast<size_t>(std::min<uint64_t>(chunk_size, entry.size - done));
+				if (!file.read(buffer.get(), static_cast<std::streamsize>(count)) || !out.write(buffer.get(), static_cast<std::streamsize>(count))) {
+					error = "Failed to copy " + name + " into " + temp_path.generic_string();
+					out.close();
+					std::error_code ec;
+					fs::remove(temp_path, ec);
+					return false;
+				}
+				done += count;
+			}
+			written += entry.size;
+			data_end = align_up(data_end + entry.size);
+		}
+		entry.offset = it->second;
+	}
+
+	if (!write_toc(out, data_end, entries)) {
+		error = "Failed to write " + temp_path.generic_string();
+		out.close();
+		std::error_code ec;
+		fs::remove(temp_path, ec);
+		return false;
+	}
+	out.close();
+	file.close();
+	std::error_code ec;
+	fs::rename(temp_path, path, ec);
+	if (ec) {
+		error = "Failed to replace " + path.generic_string() + ": " + ec.message();
+		return false;
+	}
+	return true;
+}
+
+bool update(fs::path const& path, ThreadPool& pool, std::vector<Asset> const& assets, UpdateSettings const& settings, std::ostream& log) {
+	profile::Scope scope("archive update", path.generic_string());
+
+	// Sorted, so the table and rewritten archives come out the same for the same assets.
+	std::map<std::string, Entry> entries;
+	uint64_t data_end = page_size;
+	bool const exists = fs::exists(path);
+	if (exists) {
+		Reader reader;
+		std::string error;
+		if (!reader.open(path, error)) {
+			log << "Error: " << error << std::endl;
+			return false;
+		}
+		for (uint32_t i = 0; i < reader.slot_count(); ++i) {
+			std::string_view name;
+			Entry entry;
+			if (reader.slot(i, name, entry)) entries.emplace(name, entry);
+		}
+		data_end = reader.data_end();
+	}
+
+	size_t removed = 0;
+	if (settings.remove_missing) {
+		std::unordered_set<std::string_view> names;
+		for (Asset const& asset : assets) names.insert(asset.name);
+		for (auto it = entries.begin(); it != entries.end();) {
+			if (names.count(it->first) == 0) {
+				it = entries.erase(it);
+				++removed;
+			} else {
+				++it;
+			}
+		}
+	}
+
+	// Hash every asset that may differ from its stored copy on the pool. Files are mapped again when they are
+	// written, so large batches never keep thousands of mappings open.
+	std::vector<size_t> pending;
+	for (size_t i = 0; i < assets.size(); ++i) {
+		if (assets[i].changed || entries.count(assets[i].name) == 0) pending.push_back(i);
+	}
+	std::vector<uint64_t> hashes(pending.size());
+	std::vector<std::string> errors(pending.size());
+	pool.parallel_for(pending.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			MappedFile in = MappedFile::open(assets[pending[i]].file, errors[i]);
+			if (in.is_open()) hashes[i] = hash64(in.data(), in.size());
+		}
+	});
+	for (std::string const& error : errors) {
+		if (error.empty()) continue;
+		log << "Error: " << error << std::endl;
+		return false;
+	}
+
+	if (!exists) {
+		std::ofstream create(path, std::ios::binary | std::ios::trunc);
+		if (!create) {
+			log << "Error: Failed to create " << path.generic_string() << std::endl;
+			return false;
+		}
+	}
+	std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+	if (!file) {
+		log << "Error: Failed to open " << path.generic_string() << std::endl;
+		return false;
+	}
+
+	// Stored payloads by contents, to find duplicates.
+	std::unordered_multimap<uint64_t, Entry> by_contents;
+	if (settings.dedup) {
+		for (auto const& [name, entry] : entries) by_contents.emplace(entry.content_hash, entry);
+	}
+
+	size_t added = 0;
+	size_t replaced = 0;
+	size_t deduplicated = 0;
+	uint64_t written = 0;
+	for (size_t i = 0; i < pending.size(); ++i) {
+		Asset const& asset = assets[pending[i]];
+		std::string error;
+		MappedFile in = MappedFile::open(asset.file, error);
+		if (!in.is_open()) {
+			log << "Error: " << error << std::endl;
+			return false;
+		}
+
+		auto stored = entries.find(asset.name);
+		if (stored != entries.end() && stored->second.content_hash == hashes[i] && same_contents(file, stored->second, in.data(), in.size())) continue;
+		if (stored == entries.end()) ++added;
+		else ++replaced;
+
+		Entry entry = { 0, in.size(), hashes[i] };
+		bool duplicate = false;
+		if (settings.dedup) {
+			auto [first, last] = by_contents.equal_range(hashes[i]);
+			for (; first != last && !duplicate; ++first) {
+				if (same_contents(file, first->second, in.data(), in.size())) {
+					entry.offset = first->second.offset;
+					duplicate = true;
+				}
+			}
+		}
+		if (duplicate) {
+			++deduplicated;
+		} else {
+			entry.offset = data_end;
+			file.seekp(static_cast<std::streamoff>(data_end));
+			if (!file.write(reinterpret_cast<const char*>(in.data()), static_cast<std::streamsize>(in.size()))) {
+				log << "Error: Failed to write " << asset.name << " into " << path.generic_string() << std::endl;
+				return false;
+			}
+			data_end = align_up(data_end + in.size());
+			written += in.size();
+			if (settings.dedup) by_contents.emplace(entry.content_hash, entry);
+		}
+		entries[asset.name] = entry;
+	}
+
+	if (exists && added == 0 && replaced == 0 && removed == 0 && !settings.rewrite) {
+		log << "Archive " << path.generic_string() << " is up to date (" << entries.size() << " assets).\n";
+		return true;
+	}
+
+	// Replaced payloads and old tables are never overwritten, rewrite the archive once they take more space than
+	// the payloads still in use.
+	std::unordered_map<uint64_t, uint64_t> live_payloads;
+	for (auto const& [name, entry] : entries) live_payloads.emplace(entry.offset, entry.size);
+	uint64_t live_bytes = 0;
+	for (auto const& [offset, size] : live_payloads) live_bytes += align_up(size);
+	uint64_t const unused_bytes = data_end - page_size - live_bytes;
+
+	bool const compact = settings.rewrite || unused_bytes > live_bytes;
+	if (compact) {
+		std::string error;
+		if (!rewrite(path, file, entries, written, error)) {
+			log << "Error: " << error << std::endl;
+			return false;
+		}
+	} else if (!write_toc(file, data_end, entries)) {
+		log << "Error: Failed to write " << path.generic_string() << std::endl;
+		return false;
+	}
+	scope.bytes_out(written);
+
+	log << "Archive " << path.generic_string() << ": " << entries.size() << " assets, " << added << " added, " << replaced << " replaced, "
+		<< removed << " removed, " << deduplicated << " deduplicated. Wrote " << static_cast<double>(written) / (1024.0 * 1024.0) << " MB"
+		<< (compact ? " into a compacted archive.\n" : ".\n");
+	return true;
+}
+
+} // namespace archive
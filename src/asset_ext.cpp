@@ -0,0 +1,348 @@
+#include <asset_ext.hpp>
+#include <assetlib/versions.hpp>
+#include <mapped_file.hpp>
+#include <profile.hpp>
+
+#include <lz4.h>
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace asset_ext {
+
+// Fixed part of the asset file layout: type, version, json length and blob length.
+static constexpr size_t file_header_size = 4 + 3 * sizeof(uint32_t);
+
+void attach_metadata(std::string& header, JsonWriter const& object) {
+	std::string const& json = object.str();
+	if (json.empty() || json == "{}") return;
+
+	// The header is a single JSON object, so the new member goes right before its closing brace.
+	size_t const close = header.find_last_of('}');
+	if (close == std::string::npos) {
+		header = std::string("{\"") + metadata_key + "\":" + json + "}";
+		return;
+	}
+
+	size_t const last = header.find_last_not_of(" \t\r\n", close == 0 ? 0 : close - 1);
+	bool const empty_header = last == std::string::npos || header[last] == '{';
+	std::string member = std::string(empty_header ? "" : ",") + "\"" + metadata_key + "\":" + json;
+	header.insert(close, member);
+}
+
+void attach_metadata(assetlib::AssetFile& file, JsonWriter const& object) {
+	attach_metadata(file.json, object);
+}
+
+// Writes everything up to the blob. Returns a pointer to where the blob starts.
+static unsigned char* write_file_header(unsigned char* out, char const* type, uint32_t version, std::string const& json, uint32_t blob_size) {
+	uint32_t const json_size = static_cast<uint32_t>(json.size());
+	memcpy(out, type, 4);
+	memcpy(out + 4, &version, sizeof(uint32_t));
+	memcpy(out + 8, &json_size, sizeof(uint32_t));
+	memcpy(out + 12, &blob_size, sizeof(uint32_t));
+	memcpy(out + file_header_size, json.data(), json.size());
+	return out + file_header_size + json.size();
+}
+
+Output Output::file(fs::path path) {
+	Output output;
+	output.file_path = std::move(path);
+	return output;
+}
+
+Output Output::memory(std::vector<unsigned char>& buffer) {
+	Output output;
+	output.buffer = &buffer;
+	return output;
+}
+
+std::string Output::name() const {
+	return buffer ? std::string("asset in memory") : file_path.generic_string();
+}
+
+unsigned char* Output::reserve(uint64_t capacity, std::string& error) {
+	if (buffer) {
+		buffer->resize(capacity);
+		return buffer->data();
+	}
+	mapped = MappedOutputFile::create(file_path, capacity, error);
+	return mapped.is_open() ? mapped.data() : nullptr;
+}
+
+bool Output::finish(uint64_t size, std::string& error) {
+	if (buffer) {
+		buffer->resize(size);
+		return true;
+	}
+	return mapped.finish(size, error);
+}
+
+// The file format stores lengths as 32-bit values.
+static bool check_sizes(Output const& output, size_t json_size, size_t blob_size, std::ostream& log) {
+	if (json_size > std::numeric_limits<uint32_t>::max() || blob_size > std::numeric_limits<uint32_t>::max()) {
+		log << "Error: " << output.name() << " is too large for the asset file format" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool write_file(Output& output, char const* type, uint32_t version, std::string const& json, void const* blob, size_t blob_size, std::ostream& log) {
+	if (!check_sizes(output, json.size(), blob_size, log)) return false;
+
+	profile::Scope scope("save");
+	size_t const size = file_header_size + json.size() + blob_size;
+	scope.bytes_out(size);
+	std::string error;
+	unsigned char* out = output.reserve(size, error);
+	if (!out) {
+		log << "Error: " << error << std::endl;
+		return false;
+	}
+
+	unsigned char* blob_start = write_file_header(out, type, version, json, static_cast<uint32_t>(blob_size));
+	if (blob_size > 0) memcpy(blob_start, blob, blob_size);
+
+	if (!output.finish(size, error)) {
+		log << "Error: " << error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool save_binary_file(Output& output, assetlib::AssetFile const& file, std::ostream& log) {
+	return write_file(output, file.type, file.version, file.json, file.binary_blob.data(), file.binary_blob.size(), log);
+}
+
+// Same fields as the header assetlib::pack_mesh writes.
+static std::string mesh_header(assetlib::MeshInfo const& info, size_t payload_size, JsonWriter const& ext) {
+	JsonWriter writer;
+	writer.begin_object();
+	writer.key("format").value(vertex_format_name(info.format));
+	writer.key("vertex_count").value(info.vertex_count);
+	writer.key("index_count").value(info.index_count);
+	writer.key("index_bits").value(info.index_bits);
+	writer.key("compression").value(info.compression == assetlib::CompressionMode::LZ4 ? "LZ4" : "None");
+	writer.key("byte_size").value(static_cast<uint64_t>(payload_size));
+	writer.end_object();
+	std::string json = writer.str();
+	attach_metadata(json, ext);
+	return json;
+}
+
+static constexpr char mesh_type[4] = { 'M', 'E', 'S', 'H' };
+
+bool save_mesh(Output& output, assetlib::MeshInfo const& info, size_t vertex_stride, void const* vertices, void const* indices,
+			   size_t detail_bytes, JsonWriter const& ext, std::ostream& log) {
+	size_t const vertex_bytes = static_cast<size_t>(info.vertex_count) * vertex_stride;
+	// The detail data directly follows the indices, it is stored with them.
+	size_t const index_bytes = static_cast<size_t>(info.index_count) * (info.index_bits / 8) + detail_bytes;
+	size_t const payload_size = vertex_bytes + index_bytes;
+	bool const compress = info.compression == assetlib::CompressionMode::LZ4;
+	if (compress && payload_size > LZ4_MAX_INPUT_SIZE) {
+		log << "Error: Mesh data of " << output.name() << " is too large for LZ4 compression" << std::endl;
+		return false;
+	}
+
+	// Also covers LZ4 compression, which writes straight into the mapped output.
+	profile::Scope scope("save");
+	scope.bytes_in(payload_size);
+	std::string const json = mesh_header(info, payload_size, ext);
+
+	// The compressed size is only known afterwards, reserve the worst case and truncate the output when done.
+	size_t const max_blob_size = compress ? static_cast<size_t>(LZ4_compressBound(static_cast<int>(payload_size))) : payload_size;
+	std::string error;
+	unsigned char* out = output.reserve(file_header_size + json.size() + max_blob_size, error);
+	if (!out) {
+		log << "Error: " << error << std::endl;
+		return false;
+	}
+
+	size_t blob_size = payload_size;
+	unsigned char* blob = out + file_header_size + json.size();
+	if (compress) {
+		// LZ4 blocks need contiguous input. The vertices and indices live in separate buffers.
+		std::vector<char> payload(payload_size);
+		memcpy(payload.data(), vertices, vertex_bytes);
+		memcpy(payload.data() + vertex_bytes, indices, index_bytes);
+		int const compressed_size = LZ4_compress_default(payload.data(), reinterpret_cast<char*>(blob), static_cast<int>(payload_size), static_cast<int>(max_blob_size));
+		if (compressed_size <= 0 && payload_size > 0) {
+			log << "Error: Failed to compress mesh data of " << output.name() << std::endl;
+			return false;
+		}
+		blob_size = static_cast<size_t>(compressed_size);
+	} else {
+		memcpy(blob, vertices, vertex_bytes);
+		memcpy(blob + vertex_bytes, indices, index_bytes);
+	}
+	if (!check_sizes(output, json.size(), blob_size, log)) return false;
+
+	write_file_header(out, mesh_type, assetlib::mesh_version, json, static_cast<uint32_t>(blob_size));
+	scope.bytes_out(file_header_size + json.size() + blob_size);
+	if (!output.finish(file_header_size + json.size() + blob_size, error)) {
+		log << "Error: " << error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool save_mesh_blob(Output& output, assetlib::MeshInfo const& info, size_t vertex_stride, size_t detail_bytes, std::vector<char> const& blob,
+					JsonWriter const& ext, std::ostream& log) {
+	size_t const payload_size = static_cast<size_t>(info.vertex_count) * vertex_stride + static_cast<size_t>(info.index_count) * (info.index_bits / 8)
+		+ detail_bytes;
+
+	return write_file(output, mesh_type, assetlib::mesh_version, mesh_header(info, payload_size, ext), blob.data(), blob.size(), log);
+}
+
+bool needs_extended_compression(codec::Settings const& settings, bool chunked) {
+	return chunked || (settings.codec != codec::Codec::None && settings.codec != codec::Codec::LZ4 && settings.codec != codec::Codec::LZ4HC);
+}
+
+bool compresses_payload(codec::Settings const& settings, bool chunked) {
+	return needs_extended_compression(settings, chunked) || settings.codec == codec::Codec::LZ4HC;
+}
+
+assetlib::CompressionMode compression_mode(codec::Settings const& settings) {
+	return settings.codec == codec::Codec::None ? assetlib::CompressionMode::None : assetlib::CompressionMode::LZ4;
+}
+
+void write_compression(JsonWriter& ext, codec::Settings const& settings, std::vector<codec::Chunk> const& chunks) {
+	std::vector<uint32_t> sections;
+	std::vector<uint64_t> sizes, compressed_offsets, compressed_sizes;
+	for (codec::Chunk const& chunk : chunks) {
+		sections.push_back(chunk.section);
+		sizes.push_back(chunk.size);
+		compressed_offsets.push_back(chunk.compressed_offset);
+		compressed_sizes.push_back(chunk.compressed_size);
+	}
+
+	ext.key("compression").begin_object();
+	ext.key("codec").value(codec::codec_name(settings.codec));
+	ext.key("level").value(static_cast<int32_t>(codec::effective_level(settings)));
+	ext.key("chunks").begin_object();
+	ext.key("section").array(sections.data(), sections.size());
+	ext.key("size").array(sizes.data(), sizes.size());
+	ext.key("compressed_offset").array(compressed_offsets.data(), compressed_offsets.size());
+	ext.key("compressed_size").array(compressed_sizes.data(), compressed_sizes.size());
+	ext.end_object();
+	ext.end_object();
+}
+
+const char* texture_format_name(assetlib::TextureFormat format) {
+	switch (format) {
+		case assetlib::TextureFormat::R8: return "R8";
+		case assetlib::TextureFormat::RG8: return "RG8";
+		case assetlib::TextureFormat::RGB8: return "RGB8";
+		case assetlib::TextureFormat::RGBA8: return "RGBA8";
+		default: return "Unknown";
+	}
+}
+
+const char* vertex_format_name(assetlib::VertexFormat format) {
+	switch (format) {
+		case assetlib::VertexFormat::PNTV32: return "PNTV32";
+		default: return "Unknown";
+	}
+}
+
+std::string texture_header(assetlib::TextureInfo const& info, JsonWriter const& ext) {
+	JsonWriter writer;
+	writer.begin_object();
+	writer.key("format").value(texture_format_name(info.format));
+	writer.key("extents").array(info.extents, 2);
+	writer.key("byte_size").value(info.byte_size);
+	writer.key("mip_levels").value(info.mip_levels);
+	writer.key("colorspace").value(info.colorspace == assetlib::ColorSpace::sRGB ? "sRGB" : "RGB");
+	writer.key("compression").value(info.compression == assetlib::CompressionMode::LZ4 ? "LZ4" : "None");
+	writer.end_object();
+	std::string json = writer.str();
+	attach_metadata(json, ext);
+	return json;
+}
+
+static constexpr char texture_type[4] = { 'I', 'T', 'E', 'X' };
+
+bool save_texture_blob(Output& output, assetlib::TextureInfo const& info, std::vector<char> const& blob, JsonWriter const& ext, std::ostream& log) {
+	return write_file(output, texture_type, assetlib::itex_version, texture_header(info, ext), blob.data(), blob.size(), log);
+}
+
+StreamedAssetWriter::~StreamedAssetWriter() {
+	if (buffer && !finished) buffer->clear();
+	if (temp_path.empty() || finished) return;
+	if (file.is_open()) file.close();
+	std::error_code ec;
+	fs::remove(temp_path, ec);
+}
+
+bool StreamedAssetWriter::open(Output& output, size_t max_json_size, std::string& error) {
+	json_capacity = max_json_size;
+	if (!output.is_file()) {
+		buffer = output.memory_buffer();
+		buffer->assign(file_header_size + json_capacity, 0);
+		return true;
+	}
+	path = output.path();
+	// Written next to the output and renamed over it once finished, so a failure keeps the previous output intact.
+	temp_path = path;
+	temp_path += ".tmp";
+	file.open(temp_path, std::ios::binary | std::ios::trunc);
+	// The header is written last, seek past it.
+	if (!file || !file.seekp(static_cast<std::streamoff>(file_header_size + json_capacity))) {
+		error = "Failed to create " + path.generic_string();
+		return false;
+	}
+	return true;
+}
+
+bool StreamedAssetWriter::append(void const* data, size_t size, uint64_t& offset, std::string& error) {
+	offset = blob_size;
+	if (buffer) {
+		buffer->insert(buffer->end(), static_cast<unsigned char const*>(data), static_cast<unsigned char const*>(data) + size);
+		blob_size += size;
+		return true;
+	}
+	if (!file.write(static_cast<char const*>(data), static_cast<std::streamsize>(size))) {
+		error = "Failed to write " + path.generic_string();
+		return false;
+	}
+	blob_size += size;
+	return true;
+}
+
+bool StreamedAssetWriter::finish(char const* type, uint32_t version, std::string const& json, std::string& error) {
+	if (json.size() > json_capacity || json_capacity > std::numeric_limits<uint32_t>::max() || blob_size > std::numeric_limits<uint32_t>::max()) {
+		error = (buffer ? std::string("Asset") : path.generic_string()) + " is too large for the asset file format";
+		return false;
+	}
+
+	// JSON allows trailing whitespace, so the padding does not change the header.
+	std::string padded = json;
+	padded.resize(json_capacity, ' ');
+	if (buffer) {
+		write_file_header(buffer->data(), type, version, padded, static_cast<uint32_t>(blob_size));
+		finished = true;
+		return true;
+	}
+	std::vector<unsigned char> header(file_header_size + padded.size());
+	write_file_header(header.data(), type, version, padded, static_cast<uint32_t>(blob_size));
+	if (!file.seekp(0) || !file.write(reinterpret_cast<char const*>(header.data()), static_cast<std::streamsize>(header.size()))) {
+		error = "Failed to write " + path.generic_string();
+		return false;
+	}
+	file.close();
+	if (file.fail()) {
+		error = "Failed to write " + path.generic_string();
+		return false;
+	}
+	std::error_code ec;
+	fs::rename(temp_path, path, ec);
+	if (ec) {
+		error = "Failed to replace " + path.generic_string() + ": " + ec.message();
+		return false;
+	}
+	finished = true;
+	return true;
+}
+
+} // namespace asset_ext
@@ -0,0 +1,94 @@
+#include <assettool.hpp>
+#include <asset_ext.hpp>
+#include <mapped_file.hpp>
+#include <mesh_convert.hpp>
+#include <profile.hpp>
+#include <texture_convert.hpp>
+
+#include <string>
+
+namespace assettool {
+
+AssetType asset_type(fs::path const& path) {
+	fs::path const extension = path.extension();
+	if (extension == ".png"
+		|| extension == ".bmp"
+		|| extension == ".jpg"
+		|| extension == ".tga") {
+		return AssetType::Texture;
+	}
+	if (extension == ".obj") {
+		return AssetType::Mesh;
+		// TODO: add more formats, etc
+	}
+	return AssetType::Unknown;
+}
+
+fs::path output_path(fs::path const& source) {
+	fs::path path = source;
+	switch (asset_type(source)) {
+	case AssetType::Texture: path.replace_extension(".tx"); break;
+	case AssetType::Mesh: path.replace_extension(".mesh"); break;
+	default: break;
+	}
+	return path;
+}
+
+mipgen::Context* Context::mipgen(Options const& options) {
+	if (options.mip_method != MipMethod::GPU) return nullptr;
+	if (!mipgen_ctx) {
+		mipgen_ctx = std::make_unique<mipgen::Context>(mipgen::GenerationMethod::ImageBlit);
+	}
+	return mipgen_ctx.get();
+}
+
+static bool convert_input(Context& ctx, ThreadPool& pool, Options const& options, AssetType type, InputData const& in,
+						  asset_ext::Output& output, std::ostream& log) {
+	switch (type) {
+	case AssetType::Texture: return convert_texture(ctx.mipgen(options), pool, options, in, output, log);
+	case AssetType::Mesh: return convert_mesh(ctx.importer(), pool, options, in, output, log);
+	default:
+		log << "Error: Unknown asset type.\n";
+		return false;
+	}
+}
+
+bool convert(Context& ctx, ThreadPool& pool, Options const& options, AssetType type, unsigned char const* data, size_t size,
+			 std::vector<unsigned char>& output, std::ostream& log) {
+	asset_ext::Output out = asset_ext::Output::memory(output);
+	if (!convert_input(ctx, pool, options, type, InputData(data, size), out, log)) {
+		output.clear();
+		return false;
+	}
+	return true;
+}
+
+bool convert_file(Context& ctx, ThreadPool& pool, Options const& options, fs::path const& source, fs::path const& output,
+				  std::ostream& log) {
+	AssetType const type = asset_type(source);
+	if (type == AssetType::Unknown) {
+		log << "Error: " << source.generic_string() << " is not a supported asset type.\n";
+		return false;
+	}
+
+	std::string error;
+	MappedFile in;
+	{
+		profile::Scope scope("map input");
+		in = MappedFile::open(source, error);
+	}
+	if (!in.is_open()) {
+		log << "Error: " << error << "\n";
+		return false;
+	}
+
+	return convert_mapped(ctx, pool, options, type, in, output, log);
+}
+
+bool convert_mapped(Context& ctx, ThreadPool& pool, Options const& options, AssetType type, MappedFile const& source,
+					fs::path const& output, std::ostream& log) {
+	asset_ext::Output out = asset_ext::Output::file(output);
+	return convert_input(ctx, pool, options, type, source, out, log);
+}
+
+} // namespace assettool
@@ -0,0 +1,394 @@
+#include <atlas.hpp>
+#include <json_writer.hpp>
+#include <mapped_file.hpp>
+#include <profile.hpp>
+#include <texture_convert.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+
+namespace atlas {
+
+MaxRects::MaxRects(uint32_t width, uint32_t height) {
+	free_rects.push_back({ 0, 0, width, height });
+}
+
+bool MaxRects::insert(uint32_t width, uint32_t height, Heuristic heuristic, Rect& placed) {
+	uint64_t best_primary = std::numeric_limits<uint64_t>::max();
+	uint64_t best_secondary = std::numeric_limits<uint64_t>::max();
+	bool found = false;
+	for (Rect const& free : free_rects) {
+		if (free.width < width || free.height < height) continue;
+		uint64_t const leftover_x = free.width - width;
+		uint64_t const leftover_y = free.height - height;
+		uint64_t const short_side = std::min(leftover_x, leftover_y);
+		uint64_t const long_side = std::max(leftover_x, leftover_y);
+		uint64_t primary = 0;
+		uint64_t secondary = 0;
+		switch (heuristic) {
+			case Heuristic::BestShortSideFit:
+				primary = short_side;
+				secondary = long_side;
+				break;
+			case Heuristic::BestLongSideFit:
+				primary = long_side;
+				secondary = short_side;
+				break;
+			case Heuristic::BestAreaFit:
+				primary = static_cast<uint64_t>(free.width) * free.height - static_cast<uint64_t>(width) * height;
+				secondary = short_side;
+				break;
+			case Heuristic::BottomLeft:
+				primary = static_cast<uint64_t>(free.y) + height;
+				secondary = free.x;
+				break;
+		}
+		if (primary < best_primary || (primary == best_primary && secondary < best_secondary)) {
+			best_primary = primary;
+			best_secondary = secondary;
+			placed = { free.x, free.y, width, height };
+			found = true;
+		}
+	}
+	if (!found) return false;
+
+	split_free_rects(placed);
+	remove_contained_free_rects();
+	used_right = std::max(used_right, placed.x + placed.width);
+	used_bottom = std::max(used_bottom, placed.y + placed.height);
+	return true;
+}
+
+void MaxRects::split_free_rects(Rect const& used) {
+	std::vector<Rect> result;
+	result.reserve(free_rects.size() + 4);
+	for (Rect const& free : free_rects) {
+		bool const overlaps = used.x < free.x + free.width && used.x + used.width > free.x
+			&& used.y < free.y + free.height && used.y + used.height > free.y;
+		if (!overlaps) {
+			result.push_back(free);
+			continue;
+		}
+		// What is left of the free rectangle on each side of the used one, every part as large as possible.
+		// The parts overlap, which is what lets later rectangles use any of them.
+		if (used.x > free.x) result.push_back({ free.x, free.y, used.x - free.x, free.height });
+		if (used.x + used.width < free.x + free.width) {
+			result.push_back({ used.x + used.width, free.y, free.x + free.width - used.x - used.width, free.height });
+		}
+		if (used.y > free.y) result.push_back({ free.x, free.y, free.width, used.y - free.y });
+		if (used.y + used.height < free.y + free.height) {
+			result.push_back({ free.x, used.y + used.height, free.width, free.y + free.height - used.y - used.height });
+		}
+	}
+	free_rects = std::move(result);
+}
+
+static bool contains(Rect const& outer, Rect const& inner) {
+	return inner.x >= outer.x && inner.y >= outer.y
+		&& inner.x + inner.width <= outer.x + outer.width && inner.y + inner.height <= outer.y + outer.height;
+}
+
+void MaxRects::remove_contained_free_rects() {
+	for (size_t i = 0; i < free_rects.size(); ++i) {
+		bool removed = false;
+		for (size_t j = i + 1; j < free_rects.size();) {
+			if (contains(free_rects[j], free_rects[i])) {
+				removed = true;
+				break;
+			}
+			if (contains(free_rects[i], free_rects[j])) {
+				free_rects.erase(free_rects.begin() + j);
+			} else {
+				++j;
+			}
+		}
+		if (removed) {
+			free_rects.erase(free_rects.begin() + i);
+			--i;
+		}
+	}
+}
+
+static uint32_t round_up(uint32_t value, uint32_t multiple) {
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+static uint32_t next_power_of_two(uint32_t value) {
+	uint32_t result = 1;
+	while (result < value) result *= 2;
+	return result;
+}
+
+struct Page {
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// Where every sprite ended up, for one packing heuristic.
+struct Packing {
+	std::vector<Page> pages;
+	// Page and cell of every sprite. Cells are sprites with their padding.
+	std::vector<uint32_t> sprite_pages;
+	std::vector<Rect> cells;
+	uint64_t area = 0;
+};
+
+// Places cells in order, on the first page they fit on, opening new pages as needed. Every cell fits on an empty page.
+static Packing pack_cells(std::vector<Rect> const& cells, std::vector<size_t> const& order, uint32_t page_size, Heuristic heuristic) {
+	Packing packing;
+	packing.sprite_pages.resize(cells.size());
+	packing.cells = cells;
+	std::vector<MaxRects> bins;
+	for (size_t index : order) {
+		Rect& cell = packing.cells[index];
+		bool placed = false;
+		for (size_t page = 0; page < bins.size() && !placed; ++page) {
+			placed = bins[page].insert(cell.width, cell.height, heuristic, cell);
+			if (placed) packing.sprite_pages[index] = static_cast<uint32_t>(page);
+		}
+		if (!placed) {
+			bins.emplace_back(page_size, page_size);
+			bins.back().insert(cell.width, cell.height, heuristic, cell);
+			packing.sprite_pages[index] = static_cast<uint32_t>(bins.size() - 1);
+		}
+	}
+
+	// Pages shrink to the smallest power of two that holds their sprites.
+	for (MaxRects const& bin : bins) {
+		Page const page = { std::min(next_power_of_two(bin.used_width()), page_size), std::min(next_power_of_two(bin.used_height()), page_size) };
+		packing.pages.push_back(page);
+		packing.area += static_cast<uint64_t>(page.width) * page.height;
+	}
+	return packing;
+}
+
+// Copies a sprite into its cell, and fills the rest of the cell by repeating the edge texels of the sprite.
+static void blit_sprite(DecodedTexture const& sprite, Rect const& cell, uint32_t padding, uint32_t channels, unsigned char* page, uint32_t page_width) {
+	size_t const row_size = static_cast<size_t>(sprite.width) * channels;
+	for (uint32_t y = 0; y < cell.height; ++y) {
+		uint32_t const sprite_y = static_cast<uint32_t>(std::clamp<int64_t>(static_cast<int64_t>(y) - padding, 0, sprite.height - 1));
+		unsigned char const* src = sprite.pixels + sprite_y * row_size;
+		unsigned char* dst = page + (static_cast<size_t>(cell.y + y) * page_width + cell.x) * channels;
+		for (uint32_t x = 0; x < padding; ++x) memcpy(dst + x * channels, src, channels);
+		memcpy(dst + padding * channels, src, row_size);
+		for (uint32_t x = padding + sprite.width; x < cell.width; ++x) memcpy(dst + x * channels, src + row_size - channels, channels);
+	}
+}
+
+static bool write_table(fs::path const& path, JsonWriter const& table, std::ostream& log) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file || !file.write(table.str().data(), static_cast<std::streamsize>(table.str().size()))) {
+		log << "Error: Failed to write " << path.generic_string() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static void write_sprite(JsonWriter& table, std::string const& name, const char* index_key, uint32_t index, Rect const& rect, uint32_t width, uint32_t height) {
+	float const uv[4] = {
+		static_cast<float>(rect.x) / width, static_cast<float>(rect.y) / height,
+		static_cast<float>(rect.x + rect.width) / width, static_cast<float>(rect.y + rect.height) / height
+	};
+	uint32_t const texels[4] = { rect.x, rect.y, rect.width, rect.height };
+	table.begin_object();
+	table.key("name").value(name);
+	table.key(index_key).value(index);
+	table.key("rect").array(texels, 4);
+	table.key("uv").array(uv, 4);
+	table.end_object();
+}
+
+static bool pack_array(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, PackSettings const& settings, std::vector<Input> const& inputs,
+					   std::vector<DecodedTexture> const& sprites, assetlib::ColorSpace colorspace, std::ostream& log) {
+	TextureLayers texture;
+	texture.width = sprites[0].width;
+	texture.height = sprites[0].height;
+	texture.colorspace = colorspace;
+	for (size_t i = 0; i < sprites.size(); ++i) {
+		if (sprites[i].width != texture.width || sprites[i].height != texture.height) {
+			log << "Error: Texture array layers must have the same size, " << inputs[i].name << " is " << sprites[i].width << "x" << sprites[i].height
+				<< " but " << inputs[0].name << " is " << texture.width << "x" << texture.height << std::endl;
+			return false;
+		}
+		texture.layers.push_back(sprites[i].pixels);
+	}
+
+	fs::path const output = fs::path(settings.output).replace_extension(".tx");
+	asset_ext::Output file = asset_ext::Output::file(output);
+	if (!encode_texture(mipgen_ctx, pool, options, texture, file, log)) return false;
+
+	JsonWriter table;
+	table.begin_object();
+	table.key("type").value("array");
+	table.key("texture").value(output.filename().generic_string());
+	table.key("width").value(texture.width);
+	table.key("height").value(texture.height);
+	table.key("layers").value(static_cast<uint32_t>(sprites.size()));
+	table.key("sprites").begin_array();
+	for (size_t i = 0; i < sprites.size(); ++i) {
+		write_sprite(table, inputs[i].name, "layer", static_cast<uint32_t>(i), { 0, 0, texture.width, texture.height }, texture.width, texture.height);
+	}
+	table.end_array();
+	table.end_object();
+	return write_table(fs::path(settings.output).replace_extension(".json"), table, log);
+}
+
+static bool pack_atlas(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, PackSettings const& settings, std::vector<Input> const& inputs,
+					   std::vector<DecodedTexture> const& sprites, assetlib::ColorSpace colorspace, std::ostream& log) {
+	uint32_t const channels = static_cast<uint32_t>(options.channels);
+	uint32_t const padding = settings.padding;
+	// Level n shrinks the gutter to padding / 2^n texels, keep the levels where it is still a whole texel.
+	uint32_t mip_levels = 1;
+	for (uint32_t gutter = padding; gutter >= 2; gutter /= 2) ++mip_levels;
+	// Cells start and end on texel boundaries in every kept level, and on block boundaries in every kept level when
+	// block compressed.
+	uint32_t const alignment = (options.block_format != block_compress::Format::None ? 4u : 1u) << (mip_levels - 1);
+	uint32_t const page_size = settings.atlas_size / alignment * alignment;
+	// The gutter only covers the 2x2 footprint of the box filter. Kaiser and Lanczos reach several texels further on
+	// every level and would pull neighbouring sprites in, so pages always use the box filter.
+	Options page_options = options;
+	page_options.mip_filter = cpu_mipgen::Filter::Box;
+
+	std::vector<Rect> cells(sprites.size());
+	for (size_t i = 0; i < sprites.size(); ++i) {
+		cells[i].width = round_up(sprites[i].width + 2 * padding, alignment);
+		cells[i].height = round_up(sprites[i].height + 2 * padding, alignment);
+		if (cells[i].width > page_size || cells[i].height > page_size) {
+			log << "Error: " << inputs[i].name << " (" << sprites[i].width << "x" << sprites[i].height << ") does not fit an atlas page of "
+				<< settings.atlas_size << " texels with " << padding << " texels of padding" << std::endl;
+			return false;
+		}
+	}
+
+	Packing best;
+	{
+		profile::Scope scope("atlas pack");
+		// Large sprites first, they are the hardest to place.
+		std::vector<size_t> order(sprites.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			uint32_t const side_a = std::max(cells[a].width, cells[a].height), side_b = std::max(cells[b].width, cells[b].height);
+			if (side_a != side_b) return side_a > side_b;
+			return static_cast<uint64_t>(cells[a].width) * cells[a].height > static_cast<uint64_t>(cells[b].width) * cells[b].height;
+		});
+
+		// Every heuristic packs some sets better than the others, so try all of them and keep the one with the
+		// fewest pages, then the smallest area.
+		Heuristic const heuristics[] = { Heuristic::BestShortSideFit, Heuristic::BestLongSideFit, Heuristic::BestAreaFit, Heuristic::BottomLeft };
+		std::vector<Packing> packings(std::size(heuristics));
+		pool.parallel_for(packings.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) packings[i] = pack_cells(cells, order, page_size, heuristics[i]);
+		});
+		best = std::move(*std::min_element(packings.begin(), packings.end(), [](Packing const& a, Packing const& b) {
+			if (a.pages.size() != b.pages.size()) return a.pages.size() < b.pages.size();
+			return a.area < b.area;
+		}));
+	}
+
+	// Every page is filled and converted on its own, each with a log of its own so messages stay in page order.
+	std::vector<std::ostringstream> page_logs(best.pages.size());
+	std::vector<char> page_results(best.pages.size(), 0);
+	auto convert_page = [&](size_t page) {
+		std::vector<unsigned char> pixels(static_cast<size_t>(best.pages[page].width) * best.pages[page].height * channels, 0);
+		{
+			profile::Scope scope("atlas blit");
+			scope.bytes_out(pixels.size());
+			for (size_t i = 0; i < sprites.size(); ++i) {
+				if (best.sprite_pages[i] == page) blit_sprite(sprites[i], best.cells[i], padding, channels, pixels.data(), best.pages[page].width);
+			}
+		}
+
+		TextureLayers texture;
+		texture.width = best.pages[page].width;
+		texture.height = best.pages[page].height;
+		texture.colorspace = colorspace;
+		texture.layers = { pixels.data() };
+		texture.max_mip_levels = mip_levels;
+		asset_ext::Output output = asset_ext::Output::file(fs::path(settings.output).replace_extension().concat("_" + std::to_string(page) + ".tx"));
+		page_results[page] = encode_texture(mipgen_ctx, pool, page_options, texture, output, page_logs[page]);
+	};
+	// The GPU path has a single mipgen context, which converts one page at a time.
+	if (options.mip_method == MipMethod::CPU) {
+		pool.parallel_for(best.pages.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t page = begin; page < end; ++page) convert_page(page);
+		});
+	} else {
+		for (size_t page = 0; page < best.pages.size(); ++page) convert_page(page);
+	}
+
+	bool success = true;
+	for (size_t page = 0; page < best.pages.size(); ++page) {
+		log << page_logs[page].str();
+		success = success && page_results[page];
+	}
+	if (!success) return false;
+
+	JsonWriter table;
+	table.begin_object();
+	table.key("type").value("atlas");
+	table.key("padding").value(padding);
+	table.key("mip_levels").value(mip_levels);
+	table.key("pages").begin_array();
+	for (size_t page = 0; page < best.pages.size(); ++page) {
+		table.begin_object();
+		table.key("texture").value(fs::path(settings.output).stem().generic_string() + "_" + std::to_string(page) + ".tx");
+		table.key("width").value(best.pages[page].width);
+		table.key("height").value(best.pages[page].height);
+		table.end_object();
+	}
+	table.end_array();
+	table.key("sprites").begin_array();
+	for (size_t i = 0; i < sprites.size(); ++i) {
+		Rect const rect = { best.cells[i].x + padding, best.cells[i].y + padding, sprites[i].width, sprites[i].height };
+		Page const& page = best.pages[best.sprite_pages[i]];
+		write_sprite(table, inputs[i].name, "page", best.sprite_pages[i], rect, page.width, page.height);
+	}
+	table.end_array();
+	table.end_object();
+	return write_table(fs::path(settings.output).replace_extension(".json"), table, log);
+}
+
+bool pack_textures(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, PackSettings const& settings, std::vector<Input> const& inputs,
+				   std::ostream& log) {
+	if (inputs.empty()) {
+		log << "Error: No textures to pack" << std::endl;
+		return false;
+	}
+
+	std::vector<DecodedTexture> sprites(inputs.size());
+	std::vector<assetlib::ColorSpace> colorspaces(inputs.size());
+	std::vector<std::string> errors(inputs.size());
+	pool.parallel_for(inputs.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			MappedFile in = MappedFile::open(inputs[i].path, errors[i]);
+			if (!in.is_open()) continue;
+			if (!decode_texture(pool, options, in, sprites[i])) errors[i] = "Failed to read texture " + inputs[i].path.generic_string();
+			colorspaces[i] = texture_colorspace(options, in);
+		}
+	});
+
+	bool success = true;
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		if (errors[i].empty()) continue;
+		log << "Error: " << errors[i] << std::endl;
+		success = false;
+	}
+	if (!success) return false;
+
+	// Sprites share their texture, so they have to share a color space too.
+	for (size_t i = 1; i < inputs.size(); ++i) {
+		if (colorspaces[i] != colorspaces[0]) {
+			log << "Error: " << inputs[i].name << " and " << inputs[0].name << " have different color spaces, pass --colorspace to pack them together" << std::endl;
+			return false;
+		}
+	}
+
+	if (settings.mode == PackMode::Array) return pack_array(mipgen_ctx, pool, options, settings, inputs, sprites, colorspaces[0], log);
+	return pack_atlas(mipgen_ctx, pool, options, settings, inputs, sprites, colorspaces[0], log);
+}
+
+} // namespace atlas
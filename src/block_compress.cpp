@@ -0,0 +1,615 @@
+#include <block_compress.hpp>
+#include <thread_pool.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BLOCK_COMPRESS_SSE2 1
+#endif
+
+namespace block_compress {
+
+const char* format_name(Format format) {
+	switch (format) {
+		case Format::None: return "none";
+		case Format::BC1: return "bc1";
+		case Format::BC3: return "bc3";
+		case Format::BC4: return "bc4";
+		case Format::BC5: return "bc5";
+		case Format::BC7: return "bc7";
+	}
+	return "unknown";
+}
+
+size_t block_size(Format format) {
+	switch (format) {
+		case Format::BC1:
+		case Format::BC4:
+			return 8;
+		case Format::BC3:
+		case Format::BC5:
+		case Format::BC7:
+			return 16;
+		default:
+			return 0;
+	}
+}
+
+static uint32_t level_extent(uint32_t base, uint32_t level) {
+	return std::max(1u, base >> level);
+}
+
+static uint32_t block_count(uint32_t extent) {
+	return (extent + 3) / 4;
+}
+
+size_t compressed_size(Format format, uint32_t width, uint32_t height, uint32_t mip_levels) {
+	size_t size = 0;
+	for (uint32_t level = 0; level < mip_levels; ++level) {
+		size += static_cast<size_t>(block_count(level_extent(width, level))) * block_count(level_extent(height, level)) * block_size(format);
+	}
+	return size;
+}
+
+// 16 texels stored per channel, so four texels fit in one SSE register. Values are in [0, 255].
+struct Block {
+	alignas(16) float texels[4][16];
+};
+
+// Palette entries are interleaved (RGBA per entry), as they are only ever broadcast.
+using Palette = float[16][4];
+
+// Finds the closest palette entry for every texel, using the first `channels` channels.
+// Returns the total squared error of the block. This is the inner loop of every encoder.
+static float select_indices(Block const& block, uint32_t channels, Palette const& palette, uint32_t palette_size, uint8_t* indices) {
+#if defined(BLOCK_COMPRESS_SSE2)
+	__m128 total = _mm_setzero_ps();
+	for (uint32_t group = 0; group < 16; group += 4) {
+		__m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+		__m128i best_index = _mm_setzero_si128();
+
+		__m128 texel[4];
+		for (uint32_t c = 0; c < channels; ++c) {
+			texel[c] = _mm_load_ps(&block.texels[c][group]);
+		}
+
+		for (uint32_t entry = 0; entry < palette_size; ++entry) {
+			__m128 dist = _mm_setzero_ps();
+			for (uint32_t c = 0; c < channels; ++c) {
+				__m128 const diff = _mm_sub_ps(texel[c], _mm_set1_ps(palette[entry][c]));
+				dist = _mm_add_ps(dist, _mm_mul_ps(diff, diff));
+			}
+			__m128i const closer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+			best = _mm_min_ps(best, dist);
+			best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(static_cast<int>(entry))), _mm_andnot_si128(closer, best_index));
+		}
+
+		alignas(16) int32_t lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), best_index);
+		for (uint32_t i = 0; i < 4; ++i) {
+			indices[group + i] = static_cast<uint8_t>(lanes[i]);
+		}
+		total = _mm_add_ps(total, best);
+	}
+
+	alignas(16) float sums[4];
+	_mm_store_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (uint32_t i = 0; i < 16; ++i) {
+		float best = std::numeric_limits<float>::max();
+		for (uint32_t entry = 0; entry < palette_size; ++entry) {
+			float dist = 0.0f;
+			for (uint32_t c = 0; c < channels; ++c) {
+				float const diff = block.texels[c][i] - palette[entry][c];
+				dist += diff * diff;
+			}
+			if (dist < best) {
+				best = dist;
+				indices[i] = static_cast<uint8_t>(entry);
+			}
+		}
+		total += best;
+	}
+	return total;
+#endif
+}
+
+// Endpoints along the principal axis of the texel colors, through their mean.
+static void principal_axis_endpoints(Block const& block, uint32_t channels, float* e0, float* e1) {
+	float mean[4] = {};
+	float lo[4];
+	float hi[4];
+	for (uint32_t c = 0; c < channels; ++c) {
+		lo[c] = hi[c] = block.texels[c][0];
+		for (uint32_t i = 0; i < 16; ++i) {
+			mean[c] += block.texels[c][i];
+			lo[c] = std::min(lo[c], block.texels[c][i]);
+			hi[c] = std::max(hi[c], block.texels[c][i]);
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float cov[4][4] = {};
+	for (uint32_t i = 0; i < 16; ++i) {
+		for (uint32_t a = 0; a < channels; ++a) {
+			for (uint32_t b = a; b < channels; ++b) {
+				cov[a][b] += (block.texels[a][i] - mean[a]) * (block.texels[b][i] - mean[b]);
+			}
+		}
+	}
+	for (uint32_t a = 0; a < channels; ++a) {
+		for (uint32_t b = 0; b < a; ++b) {
+			cov[a][b] = cov[b][a];
+		}
+	}
+
+	// Power iteration, starting from the diagonal of the bounding box.
+	float axis[4];
+	for (uint32_t c = 0; c < channels; ++c) {
+		axis[c] = hi[c] - lo[c];
+	}
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		float next[4] = {};
+		float length = 0.0f;
+		for (uint32_t a = 0; a < channels; ++a) {
+			for (uint32_t b = 0; b < channels; ++b) {
+				next[a] += cov[a][b] * axis[b];
+			}
+			length = std::max(length, std::abs(next[a]));
+		}
+		if (length == 0.0f) break;
+		for (uint32_t c = 0; c < channels; ++c) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float length_sq = 0.0f;
+	for (uint32_t c = 0; c < channels; ++c) {
+		length_sq += axis[c] * axis[c];
+	}
+	if (length_sq == 0.0f) {
+		// Solid block
+		for (uint32_t c = 0; c < channels; ++c) {
+			e0[c] = e1[c] = mean[c];
+		}
+		return;
+	}
+
+	float t_min = std::numeric_limits<float>::max();
+	float t_max = std::numeric_limits<float>::lowest();
+	for (uint32_t i = 0; i < 16; ++i) {
+		float t = 0.0f;
+		for (uint32_t c = 0; c < channels; ++c) {
+			t += (block.texels[c][i] - mean[c]) * axis[c];
+		}
+		t_min = std::min(t_min, t);
+		t_max = std::max(t_max, t);
+	}
+	for (uint32_t c = 0; c < channels; ++c) {
+		e0[c] = std::clamp(mean[c] + axis[c] * t_min / length_sq, 0.0f, 255.0f);
+		e1[c] = std::clamp(mean[c] + axis[c] * t_max / length_sq, 0.0f, 255.0f);
+	}
+}
+
+// Least squares fit of both endpoints for fixed indices. weights[i] is the interpolation factor of palette entry i.
+// Leaves the endpoints untouched if the indices do not constrain them (all texels use the same entry).
+static void refine_endpoints(Block const& block, uint32_t channels, uint8_t const* indices, float const* weights, float* e0, float* e1) {
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float x0[4] = {};
+	float x1[4] = {};
+	for (uint32_t i = 0; i < 16; ++i) {
+		float const t = weights[indices[i]];
+		float const s = 1.0f - t;
+		aa += s * s;
+		ab += s * t;
+		bb += t * t;
+		for (uint32_t c = 0; c < channels; ++c) {
+			x0[c] += s * block.texels[c][i];
+			x1[c] += t * block.texels[c][i];
+		}
+	}
+
+	float const det = aa * bb - ab * ab;
+	if (std::abs(det) < 1e-6f) return;
+	for (uint32_t c = 0; c < channels; ++c) {
+		e0[c] = std::clamp((bb * x0[c] - ab * x1[c]) / det, 0.0f, 255.0f);
+		e1[c] = std::clamp((aa * x1[c] - ab * x0[c]) / det, 0.0f, 255.0f);
+	}
+}
+
+static Block single_channel(Block const& block, uint32_t channel) {
+	Block result;
+	memcpy(result.texels[0], block.texels[channel], sizeof(result.texels[0]));
+	return result;
+}
+
+// BC1 color block (also the color half of BC3). Always uses four color mode.
+
+static uint16_t pack_565(float const* rgb) {
+	uint32_t const r = static_cast<uint32_t>(std::lround(rgb[0] * 31.0f / 255.0f));
+	uint32_t const g = static_cast<uint32_t>(std::lround(rgb[1] * 63.0f / 255.0f));
+	uint32_t const b = static_cast<uint32_t>(std::lround(rgb[2] * 31.0f / 255.0f));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpack_565(uint16_t color, float* rgb) {
+	uint32_t const r = (color >> 11) & 31;
+	uint32_t const g = (color >> 5) & 63;
+	uint32_t const b = color & 31;
+	rgb[0] = static_cast<float>((r << 3) | (r >> 2));
+	rgb[1] = static_cast<float>((g << 2) | (g >> 4));
+	rgb[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+static constexpr float bc1_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+struct BC1Block {
+	uint16_t color0 = 0;
+	uint16_t color1 = 0;
+	uint8_t indices[16] = {};
+	float error = std::numeric_limits<float>::max();
+};
+
+static BC1Block try_bc1(Block const& block, float const* e0, float const* e1) {
+	BC1Block result;
+	result.color0 = pack_565(e0);
+	result.color1 = pack_565(e1);
+	// Four color mode requires color0 > color1.
+	if (result.color0 < result.color1) std::swap(result.color0, result.color1);
+
+	Palette palette;
+	unpack_565(result.color0, palette[0]);
+	unpack_565(result.color1, palette[1]);
+	for (uint32_t c = 0; c < 3; ++c) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	// With equal endpoints the decoder switches to three color mode, where only entry 0 is still the same color.
+	uint32_t const palette_size = result.color0 == result.color1 ? 1 : 4;
+	result.error = select_indices(block, 3, palette, palette_size, result.indices);
+	return result;
+}
+
+static void encode_bc1(Block const& block, Quality quality, unsigned char* out) {
+	float e0[4], e1[4];
+	principal_axis_endpoints(block, 3, e0, e1);
+	BC1Block best = try_bc1(block, e0, e1);
+
+	if (quality == Quality::High) {
+		for (int iteration = 0; iteration < 3; ++iteration) {
+			// The indices refer to the packed endpoints, which may have been swapped. Fit against the packed order.
+			unpack_565(best.color0, e0);
+			unpack_565(best.color1, e1);
+			refine_endpoints(block, 3, best.indices, bc1_weights, e0, e1);
+			BC1Block candidate = try_bc1(block, e0, e1);
+			if (candidate.error >= best.error) break;
+			best = candidate;
+		}
+	}
+
+	uint32_t bits = 0;
+	for (uint32_t i = 0; i < 16; ++i) {
+		bits |= static_cast<uint32_t>(best.indices[i]) << (2 * i);
+	}
+	out[0] = static_cast<unsigned char>(best.color0 & 0xFF);
+	out[1] = static_cast<unsigned char>(best.color0 >> 8);
+	out[2] = static_cast<unsigned char>(best.color1 & 0xFF);
+	out[3] = static_cast<unsigned char>(best.color1 >> 8);
+	for (uint32_t i = 0; i < 4; ++i) {
+		out[4 + i] = static_cast<unsigned char>((bits >> (8 * i)) & 0xFF);
+	}
+}
+
+// BC4 single channel block (also the alpha half of BC3, and both halves of BC5).
+
+struct BC4Block {
+	uint8_t a0 = 0;
+	uint8_t a1 = 0;
+	uint8_t indices[16] = {};
+	float error = std::numeric_limits<float>::max();
+};
+
+static BC4Block try_bc4(Block const& block, int32_t a0, int32_t a1) {
+	BC4Block result;
+	result.a0 = static_cast<uint8_t>(std::clamp(a0, 0, 255));
+	result.a1 = static_cast<uint8_t>(std::clamp(a1, 0, 255));
+
+	Palette palette;
+	float const f0 = result.a0;
+	float const f1 = result.a1;
+	palette[0][0] = f0;
+	palette[1][0] = f1;
+	if (result.a0 > result.a1) {
+		// Eight interpolated values
+		for (uint32_t i = 2; i < 8; ++i) {
+			palette[i][0] = (static_cast<float>(8 - i) * f0 + static_cast<float>(i - 1) * f1) / 7.0f;
+		}
+	} else {
+		// Six interpolated values, plus exact 0 and 255
+		for (uint32_t i = 2; i < 6; ++i) {
+			palette[i][0] = (static_cast<float>(6 - i) * f0 + static_cast<float>(i - 1) * f1) / 5.0f;
+		}
+		palette[6][0] = 0.0f;
+		palette[7][0] = 255.0f;
+	}
+
+	result.error = select_indices(block, 1, palette, 8, result.indices);
+	return result;
+}
+
+// block holds the channel to encode in channel 0.
+static void encode_bc4(Block const& block, Quality quality, unsigned char* out) {
+	float lo = 255.0f, hi = 0.0f;
+	// Range without the values that six value mode can represent exactly.
+	float inner_lo = 255.0f, inner_hi = 0.0f;
+	for (uint32_t i = 0; i < 16; ++i) {
+		float const v = block.texels[0][i];
+		lo = std::min(lo, v);
+		hi = std::max(hi, v);
+		if (v > 0.0f && v < 255.0f) {
+			inner_lo = std::min(inner_lo, v);
+			inner_hi = std::max(inner_hi, v);
+		}
+	}
+
+	int32_t const max = static_cast<int32_t>(std::lround(hi));
+	int32_t const min = static_cast<int32_t>(std::lround(lo));
+	BC4Block best = try_bc4(block, max, min);
+
+	if (quality == Quality::High && best.error > 0.0f) {
+		if (inner_lo <= inner_hi) {
+			BC4Block candidate = try_bc4(block, static_cast<int32_t>(std::lround(inner_lo)), static_cast<int32_t>(std::lround(inner_hi)));
+			if (candidate.error < best.error) best = candidate;
+		}
+
+		// Search a small neighbourhood around the eight value endpoints.
+		constexpr int32_t radius = 2;
+		for (int32_t d0 = -radius; d0 <= radius; ++d0) {
+			for (int32_t d1 = -radius; d1 <= radius; ++d1) {
+				int32_t const a0 = max + d0;
+				int32_t const a1 = min + d1;
+				if (a0 <= a1 || a0 > 255 || a1 < 0) continue;
+				BC4Block candidate = try_bc4(block, a0, a1);
+				if (candidate.error < best.error) best = candidate;
+			}
+		}
+	}
+
+	uint64_t bits = 0;
+	for (uint32_t i = 0; i < 16; ++i) {
+		bits |= static_cast<uint64_t>(best.indices[i]) << (3 * i);
+	}
+	out[0] = best.a0;
+	out[1] = best.a1;
+	for (uint32_t i = 0; i < 6; ++i) {
+		out[2 + i] = static_cast<unsigned char>((bits >> (8 * i)) & 0xFF);
+	}
+}
+
+// BC7, using mode 6 only: a single RGBA line with 7.7.7.7 endpoints, one p-bit per endpoint and 4-bit indices.
+// Mode 6 handles smooth and alpha-blended content well, which covers most of our textures.
+
+static constexpr uint32_t bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BC7Endpoint {
+	uint8_t value[4] = {}; // 7 bits each
+	uint8_t p = 0;
+
+	uint32_t expanded(uint32_t c) const {
+		return (static_cast<uint32_t>(value[c]) << 1) | p;
+	}
+};
+
+static BC7Endpoint quantize_bc7_endpoint(float const* color) {
+	BC7Endpoint best;
+	float best_error = std::numeric_limits<float>::max();
+	for (uint8_t p = 0; p < 2; ++p) {
+		BC7Endpoint candidate;
+		candidate.p = p;
+		float error = 0.0f;
+		for (uint32_t c = 0; c < 4; ++c) {
+			int32_t const q = static_cast<int32_t>(std::lround((color[c] - static_cast<float>(p)) / 2.0f));
+			candidate.value[c] = static_cast<uint8_t>(std::clamp(q, 0, 127));
+			float const diff = static_cast<float>(candidate.expanded(c)) - color[c];
+			error += diff * diff;
+		}
+		if (error < best_error) {
+			best_error = error;
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+struct BC7Block {
+	BC7Endpoint e0;
+	BC7Endpoint e1;
+	uint8_t indices[16] = {};
+	float error = std::numeric_limits<float>::max();
+};
+
+static BC7Block try_bc7(Block const& block, float const* e0, float const* e1) {
+	BC7Block result;
+	result.e0 = quantize_bc7_endpoint(e0);
+	result.e1 = quantize_bc7_endpoint(e1);
+
+	Palette palette;
+	for (uint32_t i = 0; i < 16; ++i) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			uint32_t const w = bc7_weights4[i];
+			palette[i][c] = static_cast<float>(((64 - w) * result.e0.expanded(c) + w * result.e1.expanded(c) + 32) >> 6);
+		}
+	}
+	result.error = select_indices(block, 4, palette, 16, result.indices);
+	return result;
+}
+
+// Writes `count` bits of value at the current position, least significant bit first.
+struct BitWriter {
+	unsigned char* out;
+	uint32_t position = 0;
+
+	void write(uint32_t value, uint32_t count) {
+		for (uint32_t i = 0; i < count; ++i, ++position) {
+			if ((value >> i) & 1) {
+				out[position / 8] |= static_cast<unsigned char>(1 << (position % 8));
+			}
+		}
+	}
+};
+
+static void encode_bc7(Block const& block, Quality quality, unsigned char* out) {
+	float e0[4], e1[4];
+	principal_axis_endpoints(block, 4, e0, e1);
+	BC7Block best = try_bc7(block, e0, e1);
+
+	if (quality == Quality::High) {
+		float weights[16];
+		for (uint32_t i = 0; i < 16; ++i) {
+			weights[i] = static_cast<float>(bc7_weights4[i]) / 64.0f;
+		}
+		for (int iteration = 0; iteration < 3; ++iteration) {
+			refine_endpoints(block, 4, best.indices, weights, e0, e1);
+			BC7Block candidate = try_bc7(block, e0, e1);
+			if (candidate.error >= best.error) break;
+			best = candidate;
+		}
+	}
+
+	// The most significant index bit of texel 0 is implicitly zero. Swap the endpoints if it is set.
+	if (best.indices[0] & 0x8) {
+		std::swap(best.e0, best.e1);
+		for (uint8_t& index : best.indices) {
+			index = static_cast<uint8_t>(15 - index);
+		}
+	}
+
+	memset(out, 0, 16);
+	BitWriter writer{ out };
+	writer.write(1 << 6, 7); // Mode 6
+	for (uint32_t c = 0; c < 4; ++c) {
+		writer.write(best.e0.value[c], 7);
+		writer.write(best.e1.value[c], 7);
+	}
+	writer.write(best.e0.p, 1);
+	writer.write(best.e1.p, 1);
+	writer.write(best.indices[0], 3);
+	for (uint32_t i = 1; i < 16; ++i) {
+		writer.write(best.indices[i], 4);
+	}
+	assert(writer.position == 128);
+}
+
+static void load_block(unsigned char const* level, uint32_t channels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, Block& block) {
+	for (uint32_t y = 0; y < 4; ++y) {
+		uint32_t const sy = std::min(by * 4 + y, height - 1);
+		for (uint32_t x = 0; x < 4; ++x) {
+			uint32_t const sx = std::min(bx * 4 + x, width - 1);
+			unsigned char const* texel = level + (static_cast<size_t>(sy) * width + sx) * channels;
+			uint32_t const i = y * 4 + x;
+			for (uint32_t c = 0; c < 4; ++c) {
+				if (c < channels) block.texels[c][i] = texel[c];
+				else block.texels[c][i] = c == 3 ? 255.0f : 0.0f;
+			}
+		}
+	}
+}
+
+static void encode_block(Block const& block, Format format, Quality quality, unsigned char* out) {
+	switch (format) {
+		case Format::BC1:
+			encode_bc1(block, quality, out);
+			break;
+		case Format::BC3:
+			encode_bc4(single_channel(block, 3), quality, out);
+			encode_bc1(block, quality, out + 8);
+			break;
+		case Format::BC4:
+			encode_bc4(block, quality, out);
+			break;
+		case Format::BC5:
+			encode_bc4(block, quality, out);
+			encode_bc4(single_channel(block, 1), quality, out + 8);
+			break;
+		case Format::BC7:
+			encode_bc7(block, quality, out);
+			break;
+		default:
+			assert(false && "Invalid block format");
+	}
+}
+
+void compress_mip_chain(ThreadPool& pool, unsigned char const* pixels, uint32_t channels, uint32_t width, uint32_t height,
+						uint32_t mip_levels, Format format, Quality quality, unsigned char* output) {
+	// Work is split by rows of blocks across all levels at once, so the tiny levels at the end of the chain
+	// do not each need their own round of synchronization.
+	struct Level {
+		unsigned char const* src;
+		unsigned char* dst;
+		uint32_t width;
+		uint32_t height;
+		uint32_t blocks_x;
+		size_t first_row; // Index of the first block row of this level, across the whole chain
+	};
+
+	std::vector<Level> levels;
+	size_t rows = 0;
+	for (uint32_t level = 0; level < mip_levels; ++level) {
+		Level info;
+		info.width = level_extent(width, level);
+		info.height = level_extent(height, level);
+		info.blocks_x = block_count(info.width);
+		info.src = pixels;
+		info.dst = output;
+		info.first_row = rows;
+		levels.push_back(info);
+
+		uint32_t const blocks_y = block_count(info.height);
+		pixels += static_cast<size_t>(info.width) * info.height * channels;
+		output += static_cast<size_t>(info.blocks_x) * blocks_y * block_size(format);
+		rows += blocks_y;
+	}
+
+	size_t const bytes_per_block = block_size(format);
+	pool.parallel_for(rows, 4, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; ++row) {
+			auto it = std::upper_bound(levels.begin(), levels.end(), row, [](size_t r, Level const& l) { return r < l.first_row; });
+			Level const& level = *(it - 1);
+			uint32_t const by = static_cast<uint32_t>(row - level.first_row);
+
+			Block block;
+			for (uint32_t bx = 0; bx < level.blocks_x; ++bx) {
+				load_block(level.src, channels, level.width, level.height, bx, by, block);
+				unsigned char* dst = level.dst + (static_cast<size_t>(by) * level.blocks_x + bx) * bytes_per_block;
+				encode_block(block, format, quality, dst);
+			}
+		}
+	});
+}
+
+void compress_rows(ThreadPool& pool, unsigned char const* rows, uint32_t channels, uint32_t width, uint32_t row_count,
+				   Format format, Quality quality, unsigned char* output) {
+	uint32_t const blocks_x = block_count(width);
+	size_t const bytes_per_block = block_size(format);
+	// Edge blocks repeat the last row of the band, which is the last row of the level for the bottom band.
+	pool.parallel_for(block_count(row_count), 1, [&](size_t begin, size_t end) {
+		Block block;
+		for (size_t by = begin; by < end; ++by) {
+			for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+				load_block(rows, channels, width, row_count, bx, static_cast<uint32_t>(by), block);
+				encode_block(block, format, quality, output + (by * blocks_x + bx) * bytes_per_block);
+			}
+		}
+	});
+}
+
+} // namespace block_compress
@@ -0,0 +1,168 @@
+#include <cache.hpp>
+#include <hash.hpp>
+#include <assetlib/versions.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+// First line of every manifest. Manifests with another header are discarded.
+static constexpr const char* manifest_header = "assettool-cache 1";
+
+uint64_t hash_options(Options const& options) {
+	uint64_t h = hash_combine(0, converter_version);
+	h = hash_combine(h, assetlib::itex_version);
+	h = hash_combine(h, assetlib::mesh_version);
+	h = hash_combine(h, options.colorspace);
+	h = hash_combine(h, options.channels);
+	h = hash_combine(h, options.mip_method);
+	h = hash_combine(h, options.mip_filter);
+	h = hash_combine(h, options.block_format);
+	h = hash_combine(h, options.block_quality);
+	h = hash_combine(h, options.mesh_optimization);
+	h = hash_combine(h, options.vertex_format);
+	h = hash_combine(h, options.lod_ratios.size());
+	for (float ratio : options.lod_ratios) h = hash_combine(h, ratio);
+	h = hash_combine(h, options.lod_error);
+	h = hash_combine(h, options.meshlets);
+	h = hash_combine(h, options.compression.codec);
+	h = hash_combine(h, codec::effective_level(options.compression));
+	h = hash_combine(h, options.chunked);
+	// Streamed textures are stored with chunked compression, so the budget can change the output.
+	h = hash_combine(h, options.memory_budget_mb);
+	return h;
+}
+
+static int64_t file_time(fs::path const& path, std::error_code& ec) {
+	return static_cast<int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+}
+
+ConversionCache::ConversionCache(fs::path directory) : directory(directory.lexically_normal()) {
+	// Without the trailing separator, lexically_relative would see an extra empty component.
+	if (!this->directory.has_filename()) this->directory = this->directory.parent_path();
+	std::ifstream file(this->directory / manifest_name);
+	if (!file) return;
+
+	std::string line;
+	if (!std::getline(file, line) || line != manifest_header) return;
+
+	while (std::getline(file, line)) {
+		std::istringstream parse(line);
+		Entry entry;
+		parse >> std::hex >> entry.content_hash >> entry.options_hash >> std::dec
+			  >> entry.source_time >> entry.source_size >> entry.output_time >> entry.output_size;
+		std::string path;
+		// The path is the remainder of the line, so it may contain spaces.
+		parse.ignore(1);
+		if (!parse || !std::getline(parse, path) || path.empty()) continue;
+		entries[path] = entry;
+	}
+}
+
+std::string ConversionCache::key(fs::path const& source) const {
+	// Purely lexical, this runs for every file of a rebuild and must not touch the filesystem. Sources are named the
+	// same way as the directory, both come from the command line.
+	fs::path relative = source.lexically_normal().lexically_relative(directory);
+	if (relative.empty()) relative = source;
+	return relative.generic_string();
+}
+
+ConversionCache::Lookup ConversionCache::lookup(fs::path const& source, fs::path const& output, uint64_t options_hash) {
+	Lookup result;
+
+	std::error_code ec;
+	uintmax_t const source_size = fs::file_size(source, ec);
+	int64_t const source_time = file_time(source, ec);
+	if (ec) return result;
+
+	uintmax_t const output_size = fs::file_size(output, ec);
+	int64_t const output_time = file_time(output, ec);
+	bool const have_output = !ec;
+
+	std::string const name = key(source);
+	Entry entry;
+	bool known = false;
+	{
+		std::lock_guard lock(mutex);
+		auto it = entries.find(name);
+		if (it != entries.end()) {
+			entry = it->second;
+			known = true;
+		}
+	}
+
+	bool const output_valid = known && have_output
+		&& entry.options_hash == options_hash
+		&& entry.output_size == output_size
+		&& entry.output_time == output_time;
+
+	// Fast path: nothing about the source changed on disk.
+	if (output_valid && entry.source_size == source_size && entry.source_time == source_time) {
+		result.up_to_date = true;
+		return result;
+	}
+
+	// The source may only have been touched. Hashing it is left to the caller, which reads it anyway to convert it.
+	result.check_contents = output_valid && entry.source_size == source_size;
+	return result;
+}
+
+bool ConversionCache::matches_contents(fs::path const& source, uint64_t content_hash) {
+	std::error_code ec;
+	int64_t const source_time = file_time(source, ec);
+	if (ec) return false;
+
+	std::lock_guard lock(mutex);
+	auto it = entries.find(key(source));
+	if (it == entries.end() || it->second.content_hash != content_hash) return false;
+	// Remember the new timestamp so the next run takes the fast path.
+	it->second.source_time = source_time;
+	dirty = true;
+	return true;
+}
+
+void ConversionCache::record(fs::path const& source, fs::path const& output, uint64_t options_hash, uint64_t content_hash) {
+	std::error_code ec;
+	Entry entry;
+	entry.content_hash = content_hash;
+	entry.options_hash = options_hash;
+	entry.source_size = fs::file_size(source, ec);
+	entry.source_time = file_time(source, ec);
+	entry.output_size = fs::file_size(output, ec);
+	entry.output_time = file_time(output, ec);
+	if (ec) return;
+
+	std::string const name = key(source);
+	std::lock_guard lock(mutex);
+	entries[name] = entry;
+	dirty = true;
+}
+
+bool ConversionCache::save() {
+	std::lock_guard lock(mutex);
+	if (!dirty) return true;
+
+	// Write to a temporary file first, so an interrupted run never leaves a truncated manifest behind.
+	fs::path const path = directory / manifest_name;
+	fs::path tmp_path = path;
+	tmp_path += ".tmp";
+	{
+		std::ofstream file(tmp_path, std::ios::trunc);
+		if (!file) return false;
+
+		file << manifest_header << "\n";
+		for (auto const& [name, entry] : entries) {
+			file << std::hex << entry.content_hash << " " << entry.options_hash << " " << std::dec
+				 << entry.source_time << " " << entry.source_size << " "
+				 << entry.output_time << " " << entry.output_size << " " << name << "\n";
+		}
+		if (!file) return false;
+	}
+
+	std::error_code ec;
+	fs::rename(tmp_path, path, ec);
+	if (ec) return false;
+
+	dirty = false;
+	return true;
+}
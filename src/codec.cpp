@@ -0,0 +1,155 @@
+#include <codec.hpp>
+#include <thread_pool.hpp>
+
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+
+namespace codec {
+
+// Zstd's own default is 3, which is tuned for speed. Assets are compressed once and loaded many times.
+static constexpr int zstd_default_level = 19;
+
+const char* codec_name(Codec codec) {
+	switch (codec) {
+		case Codec::None: return "None";
+		case Codec::LZ4: return "LZ4";
+		case Codec::LZ4HC: return "LZ4HC";
+		case Codec::Zstd: return "Zstd";
+	}
+	return "None";
+}
+
+bool parse_settings(std::string const& str, Settings& settings) {
+	size_t const colon = str.find(':');
+	std::string const name = str.substr(0, colon);
+	if (name == "none") settings.codec = Codec::None;
+	else if (name == "lz4") settings.codec = Codec::LZ4;
+	else if (name == "lz4hc") settings.codec = Codec::LZ4HC;
+	else if (name == "zstd") settings.codec = Codec::Zstd;
+	else return false;
+
+	settings.level = 0;
+	if (colon == std::string::npos) return true;
+
+	std::string const level = str.substr(colon + 1);
+	if (level.empty() || level.find_first_not_of("-0123456789") != std::string::npos) return false;
+	try {
+		settings.level = std::stoi(level);
+	} catch (std::exception const&) {
+		return false;
+	}
+
+	switch (settings.codec) {
+		case Codec::LZ4HC: return settings.level >= LZ4HC_CLEVEL_MIN && settings.level <= LZ4HC_CLEVEL_MAX;
+		case Codec::Zstd: return settings.level >= ZSTD_minCLevel() && settings.level <= ZSTD_maxCLevel() && settings.level != 0;
+		default: return false; // no levels
+	}
+}
+
+int effective_level(Settings const& settings) {
+	if (settings.level != 0) return settings.level;
+	if (settings.codec == Codec::LZ4HC) return LZ4HC_CLEVEL_DEFAULT;
+	if (settings.codec == Codec::Zstd) return zstd_default_level;
+	return 0;
+}
+
+size_t compress_bound(Codec codec, size_t size) {
+	switch (codec) {
+		case Codec::None: return size;
+		case Codec::LZ4:
+		case Codec::LZ4HC: return size > LZ4_MAX_INPUT_SIZE ? 0 : static_cast<size_t>(LZ4_compressBound(static_cast<int>(size)));
+		case Codec::Zstd: return ZSTD_compressBound(size);
+	}
+	return 0;
+}
+
+size_t compress(Settings const& settings, void const* src, size_t size, void* dst, size_t capacity) {
+	if (size == 0) return 0;
+	switch (settings.codec) {
+		case Codec::None:
+			if (capacity < size) return 0;
+			memcpy(dst, src, size);
+			return size;
+		case Codec::LZ4:
+		case Codec::LZ4HC: {
+			if (size > LZ4_MAX_INPUT_SIZE) return 0;
+			int const dst_capacity = static_cast<int>(std::min<size_t>(capacity, LZ4_compressBound(static_cast<int>(size))));
+			int const result = settings.codec == Codec::LZ4
+				? LZ4_compress_default(static_cast<char const*>(src), static_cast<char*>(dst), static_cast<int>(size), dst_capacity)
+				: LZ4_compress_HC(static_cast<char const*>(src), static_cast<char*>(dst), static_cast<int>(size), dst_capacity, effective_level(settings));
+			return result > 0 ? static_cast<size_t>(result) : 0;
+		}
+		case Codec::Zstd: {
+			size_t const result = ZSTD_compress(dst, capacity, src, size, effective_level(settings));
+			return ZSTD_isError(result) ? 0 : result;
+		}
+	}
+	return 0;
+}
+
+bool decompress(Codec codec, void const* src, size_t compressed_size, void* dst, size_t size) {
+	switch (codec) {
+		case Codec::None:
+			if (compressed_size != size) return false;
+			memcpy(dst, src, size);
+			return true;
+		case Codec::LZ4:
+		case Codec::LZ4HC:
+			if (compressed_size > LZ4_MAX_INPUT_SIZE || size > LZ4_MAX_INPUT_SIZE) return false;
+			return LZ4_decompress_safe(static_cast<char const*>(src), static_cast<char*>(dst), static_cast<int>(compressed_size), static_cast<int>(size)) == static_cast<int>(size);
+		case Codec::Zstd:
+			return ZSTD_decompress(dst, size, src, compressed_size) == size;
+	}
+	return false;
+}
+
+bool compress_chunks(ThreadPool& pool, Settings const& settings, std::vector<Section> const& sections, size_t max_chunk_size,
+					 std::vector<char>& blob, std::vector<Chunk>& chunks) {
+	chunks.clear();
+	std::vector<unsigned char const*> sources;
+	for (size_t s = 0; s < sections.size(); ++s) {
+		unsigned char const* data = static_cast<unsigned char const*>(sections[s].data);
+		for (size_t done = 0; done < sections[s].size; done += max_chunk_size) {
+			Chunk chunk;
+			chunk.section = static_cast<uint32_t>(s);
+			chunk.size = std::min(max_chunk_size, sections[s].size - done);
+			chunks.push_back(chunk);
+			sources.push_back(data + done);
+		}
+	}
+
+	// Every chunk gets its worst case space, the gaps are closed once all of them are done.
+	std::vector<size_t> bound_offsets(chunks.size() + 1, 0);
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		size_t const bound = compress_bound(settings.codec, chunks[i].size);
+		if (bound == 0) return false;
+		bound_offsets[i + 1] = bound_offsets[i] + bound;
+	}
+	blob.resize(bound_offsets.back());
+
+	std::vector<uint8_t> failed(chunks.size(), 0);
+	pool.parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			size_t const capacity = bound_offsets[i + 1] - bound_offsets[i];
+			chunks[i].compressed_size = compress(settings, sources[i], chunks[i].size, blob.data() + bound_offsets[i], capacity);
+			failed[i] = chunks[i].compressed_size == 0;
+		}
+	});
+
+	uint64_t write = 0;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		if (failed[i]) return false;
+		chunks[i].compressed_offset = write;
+		if (write != bound_offsets[i]) memmove(blob.data() + write, blob.data() + bound_offsets[i], chunks[i].compressed_size);
+		write += chunks[i].compressed_size;
+	}
+	blob.resize(write);
+	return true;
+}
+
+} // namespace codec
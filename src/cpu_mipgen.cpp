@@ -0,0 +1,518 @@
+#include <cpu_mipgen.hpp>
+#include <thread_pool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// The AVX2 kernel is compiled for AVX2 and FMA on its own, and only called on CPUs that support them. Everything
+// else is compiled for the baseline instruction set, so the library runs on any x86-64 CPU.
+#if !defined(ASSETTOOL_DISABLE_AVX2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define CPU_MIPGEN_AVX2 1
+	#define CPU_MIPGEN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif !defined(ASSETTOOL_DISABLE_AVX2) && defined(_MSC_VER) && defined(_M_X64)
+	// MSVC compiles AVX2 intrinsics without /arch:AVX2.
+	#include <immintrin.h>
+	#include <intrin.h>
+	#define CPU_MIPGEN_AVX2 1
+	#define CPU_MIPGEN_TARGET_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define CPU_MIPGEN_SSE2 1
+#endif
+
+namespace cpu_mipgen {
+
+struct FormatInfo {
+	uint32_t channels = 0;
+	// The first srgb_channels channels are sRGB encoded, the rest (if any) are linear.
+	uint32_t srgb_channels = 0;
+};
+
+static FormatInfo format_info(mipgen::ImageFormat format) {
+	switch (format) {
+		case mipgen::ImageFormat::R8: return { 1, 0 };
+		case mipgen::ImageFormat::RG8: return { 2, 0 };
+		case mipgen::ImageFormat::RGB8: return { 3, 0 };
+		case mipgen::ImageFormat::RGBA8: return { 4, 0 };
+		case mipgen::ImageFormat::sR8: return { 1, 1 };
+		case mipgen::ImageFormat::sRG8: return { 2, 2 };
+		case mipgen::ImageFormat::sRGB8: return { 3, 3 };
+		case mipgen::ImageFormat::sRGBA8: return { 4, 3 };
+		default:
+			assert(false && "Unsupported image format");
+			return {};
+	}
+}
+
+static uint32_t level_extent(uint32_t base, uint32_t level) {
+	return std::max(1u, base >> level);
+}
+
+uint32_t get_mip_count(mipgen::ImageInfo const& info) {
+	uint32_t largest = std::max(info.extents[0], info.extents[1]);
+	uint32_t count = 1;
+	while (largest > 1) {
+		largest >>= 1;
+		++count;
+	}
+	return count;
+}
+
+size_t output_buffer_size(mipgen::ImageInfo const& info) {
+	size_t const channels = format_info(info.format).channels;
+	size_t size = 0;
+	for (uint32_t level = 0; level < cpu_mipgen::get_mip_count(info); ++level) {
+		size += static_cast<size_t>(level_extent(info.extents[0], level)) * level_extent(info.extents[1], level) * channels;
+	}
+	return size;
+}
+
+// Conversion tables between 8-bit values and linear floats.
+
+static float srgb_to_linear(float s) {
+	return s <= 0.04045f ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float l) {
+	return l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+}
+
+// Resolution of the linear -> sRGB table. Fine enough that every 8-bit sRGB value round-trips.
+static constexpr uint32_t encode_table_size = 1 << 16;
+
+struct Tables {
+	std::array<float, 256> decode_linear;
+	std::array<float, 256> decode_srgb;
+	std::vector<unsigned char> encode_srgb;
+
+	Tables() : encode_srgb(encode_table_size) {
+		for (uint32_t i = 0; i < 256; ++i) {
+			decode_linear[i] = static_cast<float>(i) / 255.0f;
+			decode_srgb[i] = srgb_to_linear(static_cast<float>(i) / 255.0f);
+		}
+		for (uint32_t i = 0; i < encode_table_size; ++i) {
+			float const l = static_cast<float>(i) / static_cast<float>(encode_table_size - 1);
+			encode_srgb[i] = static_cast<unsigned char>(std::lround(linear_to_srgb(l) * 255.0f));
+		}
+	}
+};
+
+static Tables const& tables() {
+	static Tables const instance;
+	return instance;
+}
+
+// Filter kernels, as a function of the distance to the sample center in destination pixels.
+
+static float sinc(float x) {
+	if (std::abs(x) < 1e-6f) return 1.0f;
+	float const px = 3.14159265358979f * x;
+	return std::sin(px) / px;
+}
+
+// Zeroth order modified Bessel function of the first kind, used by the Kaiser window.
+static float bessel_i0(float x) {
+	float sum = 1.0f;
+	float term = 1.0f;
+	float const half_sq = x * x / 4.0f;
+	for (int k = 1; k < 32; ++k) {
+		term *= half_sq / static_cast<float>(k * k);
+		sum += term;
+		if (term < sum * 1e-8f) break;
+	}
+	return sum;
+}
+
+static float filter_radius(Filter filter) {
+	switch (filter) {
+		case Filter::Box: return 0.5f;
+		case Filter::Kaiser: return 3.0f;
+		case Filter::Lanczos: return 3.0f;
+	}
+	return 0.5f;
+}
+
+static float filter_weight(Filter filter, float x) {
+	float const radius = filter_radius(filter);
+	float const ax = std::abs(x);
+	switch (filter) {
+		case Filter::Box:
+			return ax < radius ? 1.0f : 0.0f;
+		case Filter::Kaiser: {
+			constexpr float alpha = 4.0f;
+			if (ax >= radius) return 0.0f;
+			float const t = x / radius;
+			return sinc(x) * bessel_i0(alpha * std::sqrt(1.0f - t * t)) / bessel_i0(alpha);
+		}
+		case Filter::Lanczos:
+			return ax < radius ? sinc(x) * sinc(x / radius) : 0.0f;
+	}
+	return 0.0f;
+}
+
+// Precomputed source positions and weights for resampling one dimension. Every destination sample uses the same
+// amount of taps. Unused taps have a weight of zero, so the inner loops never branch.
+struct Taps {
+	uint32_t count = 0;
+	std::vector<uint32_t> index;
+	std::vector<float> weight;
+};
+
+static Taps compute_taps(Filter filter, uint32_t src_size, uint32_t dst_size) {
+	float const scale = static_cast<float>(src_size) / static_cast<float>(dst_size);
+	float const support = filter_radius(filter) * scale;
+
+	Taps taps;
+	taps.count = static_cast<uint32_t>(std::ceil(support * 2.0f)) + 1;
+	taps.index.assign(static_cast<size_t>(taps.count) * dst_size, 0);
+	taps.weight.assign(static_cast<size_t>(taps.count) * dst_size, 0.0f);
+
+	for (uint32_t x = 0; x < dst_size; ++x) {
+		float const center = (static_cast<float>(x) + 0.5f) * scale;
+		int32_t const first = static_cast<int32_t>(std::floor(center - support));
+
+		float total = 0.0f;
+		for (uint32_t t = 0; t < taps.count; ++t) {
+			int32_t const src = first + static_cast<int32_t>(t);
+			float const w = filter_weight(filter, (static_cast<float>(src) + 0.5f - center) / scale);
+			size_t const slot = static_cast<size_t>(x) * taps.count + t;
+			// Clamp to the edge of the image.
+			taps.index[slot] = static_cast<uint32_t>(std::clamp(src, 0, static_cast<int32_t>(src_size) - 1));
+			taps.weight[slot] = w;
+			total += w;
+		}
+
+		if (total == 0.0f) {
+			// Only possible for box filtering a single source pixel exactly on a tap boundary.
+			taps.index[static_cast<size_t>(x) * taps.count] = std::min(static_cast<uint32_t>(center), src_size - 1);
+			taps.weight[static_cast<size_t>(x) * taps.count] = 1.0f;
+			total = 1.0f;
+		}
+		for (uint32_t t = 0; t < taps.count; ++t) {
+			taps.weight[static_cast<size_t>(x) * taps.count + t] /= total;
+		}
+	}
+
+	return taps;
+}
+
+#if defined(CPU_MIPGEN_AVX2)
+static bool detect_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool const fma = (info[2] & (1 << 12)) != 0;
+	// The OS must save the AVX registers on context switches.
+	bool const os_avx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	if (!fma || !os_avx) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+static bool has_avx2() {
+	static bool const supported = detect_avx2();
+	return supported;
+}
+
+// Processes the first multiple of 8 elements of accumulate_row and returns how many that is.
+CPU_MIPGEN_TARGET_AVX2 static size_t accumulate_row_avx2(float* dst, float const* src, float weight, size_t count) {
+	size_t i = 0;
+	__m256 const w8 = _mm256_set1_ps(weight);
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(dst + i, _mm256_fmadd_ps(w8, _mm256_loadu_ps(src + i), _mm256_loadu_ps(dst + i)));
+	}
+	return i;
+}
+#endif
+
+// dst[i] += weight * src[i]
+static void accumulate_row(float* dst, float const* src, float weight, size_t count) {
+	size_t i = 0;
+#if defined(CPU_MIPGEN_AVX2)
+	if (has_avx2()) i = accumulate_row_avx2(dst, src, weight, count);
+#endif
+#if defined(CPU_MIPGEN_SSE2)
+	__m128 const w4 = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(w4, _mm_loadu_ps(src + i))));
+	}
+#endif
+	for (; i < count; ++i) {
+		dst[i] += weight * src[i];
+	}
+}
+
+// Resamples one row horizontally. src holds src_width pixels, dst receives one pixel per destination sample.
+static void filter_row(float* dst, float const* src, Taps const& taps, uint32_t dst_width, uint32_t channels) {
+#if defined(CPU_MIPGEN_SSE2)
+	if (channels == 4) {
+		// One pixel fits exactly in a register.
+		for (uint32_t x = 0; x < dst_width; ++x) {
+			uint32_t const* index = &taps.index[static_cast<size_t>(x) * taps.count];
+			float const* weight = &taps.weight[static_cast<size_t>(x) * taps.count];
+			__m128 acc = _mm_setzero_ps();
+			for (uint32_t t = 0; t < taps.count; ++t) {
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[t]), _mm_loadu_ps(src + static_cast<size_t>(index[t]) * 4)));
+			}
+			_mm_storeu_ps(dst + static_cast<size_t>(x) * 4, acc);
+		}
+		return;
+	}
+#endif
+	for (uint32_t x = 0; x < dst_width; ++x) {
+		uint32_t const* index = &taps.index[static_cast<size_t>(x) * taps.count];
+		float const* weight = &taps.weight[static_cast<size_t>(x) * taps.count];
+		for (uint32_t c = 0; c < channels; ++c) {
+			float acc = 0.0f;
+			for (uint32_t t = 0; t < taps.count; ++t) {
+				acc += weight[t] * src[static_cast<size_t>(index[t]) * channels + c];
+			}
+			dst[static_cast<size_t>(x) * channels + c] = acc;
+		}
+	}
+}
+
+static void decode_row(float* dst, unsigned char const* src, uint32_t width, FormatInfo const& format) {
+	Tables const& lut = tables();
+	for (uint32_t x = 0; x < width; ++x) {
+		for (uint32_t c = 0; c < format.channels; ++c) {
+			unsigned char const value = src[static_cast<size_t>(x) * format.channels + c];
+			dst[static_cast<size_t>(x) * format.channels + c] = c < format.srgb_channels ? lut.decode_srgb[value] : lut.decode_linear[value];
+		}
+	}
+}
+
+static void encode_row(unsigned char* dst, float const* src, uint32_t width, FormatInfo const& format) {
+	Tables const& lut = tables();
+	for (uint32_t x = 0; x < width; ++x) {
+		for (uint32_t c = 0; c < format.channels; ++c) {
+			// Sharpening filters can overshoot, so clamp before quantizing.
+			float const value = std::clamp(src[static_cast<size_t>(x) * format.channels + c], 0.0f, 1.0f);
+			unsigned char& out = dst[static_cast<size_t>(x) * format.channels + c];
+			if (c < format.srgb_channels) {
+				out = lut.encode_srgb[static_cast<uint32_t>(value * static_cast<float>(encode_table_size - 1) + 0.5f)];
+			} else {
+				out = static_cast<unsigned char>(value * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+// Per-thread scratch memory, reused across rows and levels.
+struct Scratch {
+	std::vector<float> column; // Vertically filtered row at source width
+	std::vector<float> row; // Fully filtered row at destination width
+	std::vector<float> decoded; // Decoded source row, only used for level 0
+};
+
+void generate_mipmap(ThreadPool& pool, mipgen::ImageInfo const& info, Filter filter, unsigned char* output) {
+	FormatInfo const format = format_info(info.format);
+	uint32_t const mip_count = cpu_mipgen::get_mip_count(info);
+
+	size_t const base_size = static_cast<size_t>(info.extents[0]) * info.extents[1] * format.channels;
+	memcpy(output, info.pixels, base_size);
+	unsigned char* level_output = output + base_size;
+
+	// Levels are filtered from the previous level, which is kept at full float precision so that quantization
+	// errors do not accumulate down the chain. Level 0 is decoded on the fly instead of being converted as a whole.
+	std::vector<float> previous;
+	std::vector<float> current;
+
+	for (uint32_t level = 1; level < mip_count; ++level) {
+		uint32_t const src_width = level_extent(info.extents[0], level - 1);
+		uint32_t const src_height = level_extent(info.extents[1], level - 1);
+		uint32_t const dst_width = level_extent(info.extents[0], level);
+		uint32_t const dst_height = level_extent(info.extents[1], level);
+		size_t const src_row_size = static_cast<size_t>(src_width) * format.channels;
+		size_t const dst_row_size = static_cast<size_t>(dst_width) * format.channels;
+
+		Taps const horizontal = compute_taps(filter, src_width, dst_width);
+		Taps const vertical = compute_taps(filter, src_height, dst_height);
+
+		bool const keep_float = level + 1 < mip_count;
+		if (keep_float) {
+			current.resize(dst_row_size * dst_height);
+		}
+
+		// Aim for tasks of roughly 64k output values, so small levels are not split into tiny tasks.
+		size_t const grain = std::max<size_t>(1, (64 * 1024) / std::max<size_t>(dst_row_size, 1));
+		pool.parallel_for(dst_height, grain, [&](size_t begin, size_t end) {
+			thread_local Scratch scratch;
+			scratch.column.resize(src_row_size);
+			scratch.row.resize(dst_row_size);
+			if (level == 1) scratch.decoded.resize(src_row_size);
+
+			for (size_t y = begin; y < end; ++y) {
+				std::fill(scratch.column.begin(), scratch.column.end(), 0.0f);
+				for (uint32_t t = 0; t < vertical.count; ++t) {
+					float const weight = vertical.weight[y * vertical.count + t];
+					if (weight == 0.0f) continue;
+					uint32_t const src_y = vertical.index[y * vertical.count + t];
+					float const* src_row;
+					if (level == 1) {
+						decode_row(scratch.decoded.data(), info.pixels + src_y * src_row_size, src_width, format);
+						src_row = scratch.decoded.data();
+					} else {
+						src_row = previous.data() + src_y * src_row_size;
+					}
+					accumulate_row(scratch.column.data(), src_row, weight, src_row_size);
+				}
+
+				float* dst_row = keep_float ? current.data() + y * dst_row_size : scratch.row.data();
+				filter_row(dst_row, scratch.column.data(), horizontal, dst_width, format.channels);
+				encode_row(level_output + y * dst_row_size, dst_row, dst_width, format);
+			}
+		});
+
+		level_output += dst_row_size * dst_height;
+		std::swap(previous, current);
+	}
+}
+
+// One level of a MipStream, filtered from a window of rows of the level above it.
+struct MipStream::Level {
+	uint32_t src_width = 0;
+	uint32_t dst_width = 0;
+	uint32_t dst_height = 0;
+	Taps horizontal;
+	Taps vertical;
+	// Per destination row: the lowest source row that it or any later row reads, and the highest source row it reads.
+	std::vector<uint32_t> first_needed;
+	std::vector<uint32_t> last_needed;
+
+	// Source rows [window_first, window_first + window_rows) at full float precision.
+	std::vector<float> window;
+	uint32_t window_first = 0;
+	uint32_t window_rows = 0;
+	// Amount of source rows received, and the next destination row to produce.
+	uint32_t received = 0;
+	uint32_t next_row = 0;
+
+	// Rows produced by the last feed, as floats for the next level and encoded for the sink.
+	std::vector<float> produced;
+	std::vector<unsigned char> encoded;
+};
+
+MipStream::MipStream(mipgen::ImageInfo const& info, Filter filter) {
+	FormatInfo const format = format_info(info.format);
+	width = info.extents[0];
+	channels = format.channels;
+	srgb_channels = format.srgb_channels;
+
+	uint32_t const mip_count = cpu_mipgen::get_mip_count(info);
+	for (uint32_t index = 1; index < mip_count; ++index) {
+		auto level = std::make_unique<Level>();
+		uint32_t const src_height = level_extent(info.extents[1], index - 1);
+		level->src_width = level_extent(info.extents[0], index - 1);
+		level->dst_width = level_extent(info.extents[0], index);
+		level->dst_height = level_extent(info.extents[1], index);
+		level->horizontal = compute_taps(filter, level->src_width, level->dst_width);
+		level->vertical = compute_taps(filter, src_height, level->dst_height);
+
+		Taps const& vertical = level->vertical;
+		level->first_needed.resize(level->dst_height);
+		level->last_needed.resize(level->dst_height);
+		for (uint32_t y = 0; y < level->dst_height; ++y) {
+			auto const first = vertical.index.begin() + static_cast<size_t>(y) * vertical.count;
+			auto const [low, high] = std::minmax_element(first, first + vertical.count);
+			level->first_needed[y] = *low;
+			level->last_needed[y] = *high;
+		}
+		for (uint32_t y = level->dst_height - 1; y > 0; --y) {
+			level->first_needed[y - 1] = std::min(level->first_needed[y - 1], level->first_needed[y]);
+		}
+		levels.push_back(std::move(level));
+	}
+}
+
+MipStream::~MipStream() = default;
+
+void MipStream::push(ThreadPool& pool, unsigned char const* rows, uint32_t row_count, RowSink const& sink) {
+	sink(0, rows, row_count);
+	if (!levels.empty()) feed(pool, 0, rows, row_count, sink);
+}
+
+// Adds source rows to a level and produces every destination row they complete. The first level receives 8-bit rows,
+// the others the float rows of the level before them.
+void MipStream::feed(ThreadPool& pool, size_t index, void const* rows, uint32_t row_count, RowSink const& sink) {
+	Level& level = *levels[index];
+	FormatInfo const format{ channels, srgb_channels };
+	size_t const src_row_size = static_cast<size_t>(level.src_width) * channels;
+	size_t const dst_row_size = static_cast<size_t>(level.dst_width) * channels;
+
+	// Drop the rows no remaining destination row reads, then append the new ones.
+	uint32_t const keep_from = level.next_row < level.dst_height ? level.first_needed[level.next_row] : level.received;
+	uint32_t const dropped = std::min(keep_from - level.window_first, level.window_rows);
+	if (dropped > 0) {
+		std::copy(level.window.begin() + dropped * src_row_size, level.window.begin() + level.window_rows * src_row_size, level.window.begin());
+		level.window_first += dropped;
+		level.window_rows -= dropped;
+	}
+	size_t const append_at = level.window_rows * src_row_size;
+	level.window.resize(append_at + row_count * src_row_size);
+	if (index == 0) {
+		unsigned char const* bytes = static_cast<unsigned char const*>(rows);
+		pool.parallel_for(row_count, 16, [&](size_t begin, size_t end) {
+			for (size_t y = begin; y < end; ++y) {
+				decode_row(level.window.data() + append_at + y * src_row_size, bytes + y * src_row_size, level.src_width, format);
+			}
+		});
+	} else {
+		float const* floats = static_cast<float const*>(rows);
+		std::copy(floats, floats + row_count * src_row_size, level.window.begin() + append_at);
+	}
+	level.window_rows += row_count;
+	level.received += row_count;
+
+	uint32_t first = level.next_row;
+	uint32_t last = first;
+	while (last < level.dst_height && level.last_needed[last] < level.received) ++last;
+	uint32_t const produced_rows = last - first;
+	if (produced_rows == 0) return;
+
+	bool const keep_float = index + 1 < levels.size();
+	if (keep_float) level.produced.resize(produced_rows * dst_row_size);
+	level.encoded.resize(produced_rows * dst_row_size);
+
+	// Same accumulation order as generate_mipmap(), so both produce identical chains.
+	Taps const& vertical = level.vertical;
+	size_t const grain = std::max<size_t>(1, (64 * 1024) / std::max<size_t>(dst_row_size, 1));
+	pool.parallel_for(produced_rows, grain, [&](size_t begin, size_t end) {
+		thread_local Scratch scratch;
+		scratch.column.resize(src_row_size);
+		scratch.row.resize(dst_row_size);
+
+		for (size_t i = begin; i < end; ++i) {
+			size_t const y = first + i;
+			std::fill(scratch.column.begin(), scratch.column.end(), 0.0f);
+			for (uint32_t t = 0; t < vertical.count; ++t) {
+				float const weight = vertical.weight[y * vertical.count + t];
+				if (weight == 0.0f) continue;
+				uint32_t const src_y = vertical.index[y * vertical.count + t];
+				float const* src_row = level.window.data() + (src_y - level.window_first) * src_row_size;
+				accumulate_row(scratch.column.data(), src_row, weight, src_row_size);
+			}
+
+			float* dst_row = keep_float ? level.produced.data() + i * dst_row_size : scratch.row.data();
+			filter_row(dst_row, scratch.column.data(), level.horizontal, level.dst_width, channels);
+			encode_row(level.encoded.data() + i * dst_row_size, dst_row, level.dst_width, format);
+		}
+	});
+	level.next_row = last;
+
+	sink(static_cast<uint32_t>(index + 1), level.encoded.data(), produced_rows);
+	if (keep_float) feed(pool, index + 1, level.produced.data(), produced_rows, sink);
+}
+
+} // namespace cpu_mipgen
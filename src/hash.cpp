@@ -0,0 +1,94 @@
+#include <hash.hpp>
+
+#include <cstring>
+
+// Reference: https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+static constexpr uint64_t prime1 = 11400714785074694791ULL;
+static constexpr uint64_t prime2 = 14029467366897019727ULL;
+static constexpr uint64_t prime3 = 1609587929392839161ULL;
+static constexpr uint64_t prime4 = 9650029242287828579ULL;
+static constexpr uint64_t prime5 = 2870177450012600261ULL;
+
+static uint64_t rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(unsigned char const* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t read32(unsigned char const* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+	acc += input * prime2;
+	acc = rotl(acc, 31);
+	return acc * prime1;
+}
+
+static uint64_t merge_round(uint64_t acc, uint64_t value) {
+	acc ^= xxh_round(0, value);
+	return acc * prime1 + prime4;
+}
+
+uint64_t hash64(void const* data, size_t size, uint64_t seed) {
+	unsigned char const* p = static_cast<unsigned char const*>(data);
+	unsigned char const* const end = p + size;
+	uint64_t h;
+
+	if (size >= 32) {
+		uint64_t v1 = seed + prime1 + prime2;
+		uint64_t v2 = seed + prime2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - prime1;
+		unsigned char const* const limit = end - 32;
+		do {
+			v1 = xxh_round(v1, read64(p));
+			v2 = xxh_round(v2, read64(p + 8));
+			v3 = xxh_round(v3, read64(p + 16));
+			v4 = xxh_round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge_round(h, v1);
+		h = merge_round(h, v2);
+		h = merge_round(h, v3);
+		h = merge_round(h, v4);
+	} else {
+		h = seed + prime5;
+	}
+
+	h += static_cast<uint64_t>(size);
+
+	while (p + 8 <= end) {
+		h ^= xxh_round(0, read64(p));
+		h = rotl(h, 27) * prime1 + prime4;
+		p += 8;
+	}
+
+	if (p + 4 <= end) {
+		h ^= static_cast<uint64_t>(read32(p)) * prime1;
+		h = rotl(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+
+	while (p < end) {
+		h ^= (*p) * prime5;
+		h = rotl(h, 11) * prime1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,153 @@
+#include <image_rows.hpp>
+#include <mapped_file.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace image_rows {
+
+static uint32_t read_u16(unsigned char const* p) {
+	return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8);
+}
+
+static uint32_t read_u32(unsigned char const* p) {
+	return read_u16(p) | (read_u16(p + 2) << 16);
+}
+
+// Luminance of an RGB texel, with the same weights and rounding as stb_image.
+static unsigned char luminance(unsigned char r, unsigned char g, unsigned char b) {
+	return static_cast<unsigned char>((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+void convert_channels(unsigned char const* src, uint32_t src_channels, unsigned char* dst, uint32_t dst_channels, uint32_t count) {
+	if (src_channels == dst_channels) {
+		memcpy(dst, src, static_cast<size_t>(count) * src_channels);
+		return;
+	}
+	for (uint32_t i = 0; i < count; ++i, src += src_channels, dst += dst_channels) {
+		bool const grey = src_channels <= 2;
+		unsigned char const alpha = src_channels == 2 ? src[1] : src_channels == 4 ? src[3] : 255;
+		unsigned char const value = grey ? src[0] : luminance(src[0], src[1], src[2]);
+		switch (dst_channels) {
+			case 1: dst[0] = value; break;
+			case 2: dst[0] = value; dst[1] = alpha; break;
+			case 3:
+				dst[0] = grey ? value : src[0];
+				dst[1] = grey ? value : src[1];
+				dst[2] = grey ? value : src[2];
+				break;
+			case 4:
+				dst[0] = grey ? value : src[0];
+				dst[1] = grey ? value : src[1];
+				dst[2] = grey ? value : src[2];
+				dst[3] = alpha;
+				break;
+		}
+	}
+}
+
+// Rows stored raw at a fixed stride, like uncompressed TGA and BMP files.
+class RawReader : public Reader {
+public:
+	RawReader(unsigned char const* pixels, size_t stride, uint32_t width, uint32_t height, uint32_t file_channels, uint32_t channels,
+			  bool bottom_up, bool bgr, bool flip_vertically)
+		: pixels(pixels), stride(stride), bottom_up(bottom_up), bgr(bgr) {
+		image_width = width;
+		image_height = height;
+		this->file_channels = file_channels;
+		this->channels = channels;
+		flip = flip_vertically;
+		swizzled.resize(static_cast<size_t>(width) * file_channels);
+	}
+
+	bool read(unsigned char* dst, uint32_t row_count) override {
+		if (row_count > image_height - next_row) return false;
+		size_t const row_size = static_cast<size_t>(image_width) * channels;
+		uint32_t const first_file_row = flip == bottom_up ? next_row : image_height - next_row - row_count;
+		for (uint32_t i = 0; i < row_count; ++i, ++next_row) {
+			// Rows come out bottom first when flipped. Files that store rows bottom first can then be read in order.
+			uint32_t const file_row = flip == bottom_up ? next_row : image_height - 1 - next_row;
+			unsigned char const* src = pixels + file_row * stride;
+			if (bgr) {
+				for (size_t x = 0; x < image_width; ++x) {
+					unsigned char const* texel = src + x * file_channels;
+					unsigned char* out = swizzled.data() + x * file_channels;
+					out[0] = texel[2];
+					out[1] = texel[1];
+					out[2] = texel[0];
+					if (file_channels == 4) out[3] = texel[3];
+				}
+				src = swizzled.data();
+			}
+			convert_channels(src, file_channels, dst + i * row_size, channels, image_width);
+		}
+		// Every row is read once, so the file never has to be resident as a whole.
+		if (release_rows) release_pages(pixels + first_file_row * stride, row_count * stride);
+		return true;
+	}
+
+private:
+	unsigned char const* pixels;
+	size_t stride;
+	bool bottom_up;
+	bool bgr;
+	uint32_t next_row = 0;
+	std::vector<unsigned char> swizzled;
+};
+
+static bool fits(uint64_t size, uint64_t offset, size_t stride, uint32_t height) {
+	return offset <= size && static_cast<uint64_t>(stride) * height <= size - offset;
+}
+
+static std::unique_ptr<Reader> open_tga(unsigned char const* data, uint64_t size, uint32_t channels, bool flip_vertically) {
+	if (size < 18) return nullptr;
+	uint32_t const id_length = data[0];
+	uint32_t const colormap_type = data[1];
+	uint32_t const image_type = data[2];
+	uint32_t const width = read_u16(data + 12);
+	uint32_t const height = read_u16(data + 14);
+	uint32_t const bits = data[16];
+	// Bit 5 of the descriptor is set when rows are stored top to bottom.
+	bool const bottom_up = (data[17] & 0x20) == 0;
+
+	uint32_t file_channels = 0;
+	if (image_type == 2 && (bits == 24 || bits == 32)) file_channels = bits / 8;
+	else if (image_type == 3 && bits == 8) file_channels = 1;
+	if (colormap_type != 0 || file_channels == 0 || width == 0 || height == 0) return nullptr;
+
+	size_t const stride = static_cast<size_t>(width) * file_channels;
+	uint64_t const offset = 18 + id_length;
+	if (!fits(size, offset, stride, height)) return nullptr;
+	return std::make_unique<RawReader>(data + offset, stride, width, height, file_channels, channels, bottom_up, file_channels >= 3, flip_vertically);
+}
+
+static std::unique_ptr<Reader> open_bmp(unsigned char const* data, uint64_t size, uint32_t channels, bool flip_vertically) {
+	if (size < 34 || data[0] != 'B' || data[1] != 'M') return nullptr;
+	uint32_t const offset = read_u32(data + 10);
+	uint32_t const header_size = read_u32(data + 14);
+	if (header_size != 40 && header_size != 56 && header_size != 108 && header_size != 124) return nullptr;
+	int32_t const width = static_cast<int32_t>(read_u32(data + 18));
+	int32_t const height = static_cast<int32_t>(read_u32(data + 22));
+	uint32_t const planes = read_u16(data + 26);
+	uint32_t const bits = read_u16(data + 28);
+	uint32_t const compression = read_u32(data + 30);
+	// 32-bit files are left to stb_image, which makes the whole image opaque when every alpha value is 0.
+	if (planes != 1 || bits != 24 || compression != 0 || width <= 0 || height == 0 || height == INT32_MIN) return nullptr;
+
+	uint32_t const rows = static_cast<uint32_t>(height < 0 ? -height : height);
+	// Rows are padded to 4 bytes.
+	size_t const stride = (static_cast<size_t>(width) * 3 + 3) & ~size_t{ 3 };
+	if (!fits(size, offset, stride, rows)) return nullptr;
+	return std::make_unique<RawReader>(data + offset, stride, static_cast<uint32_t>(width), rows, 3, channels, height > 0, true, flip_vertically);
+}
+
+std::unique_ptr<Reader> open(unsigned char const* data, uint64_t size, uint32_t channels, bool flip_vertically, bool release_rows) {
+	if (channels < 1 || channels > 4) return nullptr;
+	std::unique_ptr<Reader> reader = open_bmp(data, size, channels, flip_vertically);
+	if (!reader) reader = open_tga(data, size, channels, flip_vertically);
+	if (reader) reader->release_rows = release_rows;
+	return reader;
+}
+
+} // namespace image_rows
@@ -0,0 +1,129 @@
+#include <json_writer.hpp>
+
+#include <charconv>
+#include <cmath>
+
+void JsonWriter::separator() {
+	if (after_key) {
+		after_key = false;
+		return;
+	}
+	if (!empty_scope.empty()) {
+		if (!empty_scope.back()) out += ',';
+		empty_scope.back() = false;
+	}
+}
+
+void JsonWriter::write_string(std::string_view str) {
+	out += '"';
+	for (char c : str) {
+		switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20) {
+					constexpr const char* hex = "0123456789abcdef";
+					out += "\\u00";
+					out += hex[(c >> 4) & 0xF];
+					out += hex[c & 0xF];
+				} else {
+					out += c;
+				}
+		}
+	}
+	out += '"';
+}
+
+JsonWriter& JsonWriter::begin_object() {
+	separator();
+	out += '{';
+	empty_scope.push_back(true);
+	return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+	out += '}';
+	empty_scope.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+	separator();
+	out += '[';
+	empty_scope.push_back(true);
+	return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+	out += ']';
+	empty_scope.pop_back();
+	return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+	separator();
+	write_string(name);
+	out += ':';
+	after_key = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view str) {
+	separator();
+	write_string(str);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* str) {
+	return value(std::string_view(str));
+}
+
+JsonWriter& JsonWriter::value(bool b) {
+	separator();
+	out += b ? "true" : "false";
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(double number) {
+	separator();
+	// JSON has no representation for these.
+	if (!std::isfinite(number)) {
+		out += "null";
+		return *this;
+	}
+	char buffer[32];
+	auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+	out.append(buffer, result.ptr);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(float number) {
+	return value(static_cast<double>(number));
+}
+
+JsonWriter& JsonWriter::value(int64_t number) {
+	separator();
+	out += std::to_string(number);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t number) {
+	separator();
+	out += std::to_string(number);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(int32_t number) {
+	return value(static_cast<int64_t>(number));
+}
+
+JsonWriter& JsonWriter::value(uint32_t number) {
+	return value(static_cast<uint64_t>(number));
+}
+
+std::string const& JsonWriter::str() const {
+	return out;
+}
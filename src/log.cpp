@@ -0,0 +1,26 @@
+#include <log.hpp>
+
+LogSink::LogSink(std::ostream& out) : out(out) {
+
+}
+
+void LogSink::write(std::string const& text) {
+	if (text.empty()) return;
+
+	std::lock_guard lock(mutex);
+	out << text;
+	out.flush();
+}
+
+LogBuffer::LogBuffer(LogSink& sink) : sink(sink) {
+
+}
+
+LogBuffer::~LogBuffer() {
+	flush_to_sink();
+}
+
+void LogBuffer::flush_to_sink() {
+	sink.write(str());
+	str("");
+}
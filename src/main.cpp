@@ -1,19 +1,26 @@
 #include <assetlib/versions.hpp>
 #include <assetlib/texture.hpp>
 #include <assetlib/mesh.hpp>
-#include <texture_convert.hpp>
-#include <mesh_convert.hpp>
+#include <assettool.hpp>
+#include <atlas.hpp>
+#include <archive.hpp>
 #include <options.hpp>
-#include <mipgen/mipgen.hpp>
-#include <stb_image.h>
+#include <thread_pool.hpp>
+#include <cache.hpp>
+#include <hash.hpp>
+#include <log.hpp>
+#include <mapped_file.hpp>
+#include <profile.hpp>
 #include <argumentum/argparse.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <string>
 #include <iostream>
 #include <filesystem>
-
-// define the options global
-Options g_options = {};
+#include <stdexcept>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -40,65 +47,220 @@ static void log_asset_versions(std::ostream& out) {
 	out << LINE_HORIZONTAL;
 }
 
-static bool is_texture(fs::path const& path) {
-	if (path.extension() == ".png"
-		|| path.extension() == ".bmp"
-		|| path.extension() == ".jpg"
-		|| path.extension() == ".tga") {
-		return true;
-	}
-	return false;
-}
+// Arguments of the command line tool. Everything that influences the converted assets is in options, the rest
+// selects what to convert and where to put it.
+struct CommandLine {
+    fs::path file;
+    fs::path directory;
+    // 0 uses every hardware thread
+    int jobs = 0;
+    // Ignore the conversion cache
+    bool force = false;
+    // "atlas" or "array" packs textures instead of converting them one by one
+    std::string pack = "none";
+    fs::path pack_output;
+    std::vector<fs::path> pack_inputs;
+    int atlas_size = 2048;
+    int atlas_padding = 4;
+    fs::path archive;
+    // Asset names in the archive are relative to this, the directory of the archive if empty
+    fs::path archive_root;
+    bool archive_dedup = false;
+    bool archive_rewrite = false;
+    fs::path profile;
+    Options options;
+};
 
-static bool is_mesh(fs::path const& path) {
-	if (path.extension() == ".obj") {
-		return true;
-		// TODO: add more formats, etc
-	}
-	return false;
+static bool is_asset(fs::path const& path) {
+    return assettool::asset_type(path) != assettool::AssetType::Unknown;
 }
 
-static void process_file(fs::path const& path, std::ostream& log) {
-    auto start = std::chrono::high_resolution_clock::now();
-    mipgen::Context mipgen_ctx(mipgen::GenerationMethod::ImageBlit);
+struct ProcessResult {
+	bool converted = false;
+	bool skipped = false;
+	bool success = true;
+	uintmax_t bytes_in = 0;
+};
 
-    if (is_texture(path)) {
-        fs::path new_path = path;
-        new_path.replace_extension(".tx");
+// Converts a single file. If a cache is given, files whose output is still up to date are skipped, unless force is
+// set. Successful conversions are recorded in the cache either way.
+static ProcessResult process_file(fs::path const& path, assettool::Context& ctx, ThreadPool& pool, Options const& options, ConversionCache* cache,
+                                  bool force, uint64_t options_hash, std::ostream& log) {
+    auto start = std::chrono::high_resolution_clock::now();
+    ProcessResult result;
 
-        auto in = plib::binary_input_stream::from_file(path.generic_string().c_str());
-        auto out = plib::binary_output_stream::from_file(new_path.generic_string().c_str());
+    assettool::AssetType const type = assettool::asset_type(path);
+    if (type == assettool::AssetType::Unknown) return result;
 
-        bool success = convert_texture(mipgen_ctx, in, out, log);
-        if (!success) {
-            log << "Conversion of texture " << path.generic_string() << " failed.\n";
+    fs::path const new_path = assettool::output_path(path);
+    ConversionCache::Lookup cached;
+    if (cache && !force) {
+        cached = cache->lookup(path, new_path, options_hash);
+        if (cached.up_to_date) {
+            result.skipped = true;
+            profile::count("files up to date");
+            return result;
         }
     }
 
-    else if (is_mesh(path)) {
-        fs::path new_path = path;
-        new_path.replace_extension(".mesh");
+    // The source is mapped once, the cache hashes the mapping and the decoders read straight from it. It is never
+    // copied into memory as a whole.
+    std::string error;
+    MappedFile in;
+    {
+        profile::Scope map_scope("map input");
+        in = MappedFile::open(path, error);
+    }
+    if (!in.is_open()) {
+        log << "Error: " << error << "\n";
+        result.converted = true;
+        result.success = false;
+        return result;
+    }
 
-        auto in = plib::binary_input_stream::from_file(path.generic_string().c_str());
-        auto out = plib::binary_output_stream::from_file(new_path.generic_string().c_str());
+    uint64_t content_hash = 0;
+    if (cache) {
+        profile::Scope hash_scope("hash source");
+        hash_scope.bytes_in(in.size());
+        content_hash = hash64(in.data(), in.size());
+        if (cached.check_contents && cache->matches_contents(path, content_hash)) {
+            result.skipped = true;
+            profile::count("files up to date");
+            return result;
+        }
+    }
 
-        bool success = convert_mesh(in, out, log);
-        if (!success) {
-            log << "Conversion of mesh " << path.generic_string() << " failed.\n";
+    {
+        profile::Scope scope("convert", path.generic_string());
+        result.converted = true;
+        result.bytes_in = in.size();
+        scope.bytes_in(in.size());
+        result.success = assettool::convert_mapped(ctx, pool, options, type, in, new_path, log);
+        if (!result.success) {
+            log << "Conversion of " << (type == assettool::AssetType::Texture ? "texture " : "mesh ") << path.generic_string() << " failed.\n";
         }
+        profile::count(result.success ? "files converted" : "files failed");
+    }
+
+    // The output is closed at this point, so the recorded output size and timestamp are final.
+    if (cache && result.success) {
+        cache->record(path, new_path, options_hash, content_hash);
     }
 
     auto end = std::chrono::high_resolution_clock::now();
 
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-    std::cout << "Converted and preprocessed " << path.generic_string() << " in " << ms << "ms.\n";
+    log << "Converted and preprocessed " << path.generic_string() << " in " << ms << "ms.\n";
+    return result;
+}
+
+// Textures to pack: the ones given with --pack-inputs, or every texture below the directory, named by their path
+// relative to it.
+static std::vector<atlas::Input> pack_inputs(CommandLine const& args) {
+	std::vector<atlas::Input> inputs;
+	if (!args.pack_inputs.empty()) {
+		for (fs::path const& path : args.pack_inputs) inputs.push_back({ path, path.generic_string() });
+		return inputs;
+	}
+	for (fs::directory_entry const& entry : fs::recursive_directory_iterator(args.directory)) {
+		if (!entry.is_regular_file() || assettool::asset_type(entry.path()) != assettool::AssetType::Texture) continue;
+		inputs.push_back({ entry.path(), entry.path().lexically_relative(args.directory).generic_string() });
+	}
+	// Directory iteration order is unspecified, sort so pages and layers come out the same on every run.
+	std::sort(inputs.begin(), inputs.end(), [](atlas::Input const& a, atlas::Input const& b) { return a.name < b.name; });
+	return inputs;
+}
+
+// Name of an asset in the archive: its path relative to the archive root. --file and --dir name assets the same way,
+// so either can update what the other stored. Empty for outputs outside of the root.
+static std::string archive_name(CommandLine const& args, fs::path const& output) {
+	fs::path root = (args.archive_root.empty() ? fs::absolute(args.archive).parent_path() : fs::absolute(args.archive_root)).lexically_normal();
+	if (!root.has_filename()) root = root.parent_path();
+	fs::path const name = fs::absolute(output).lexically_normal().lexically_relative(root);
+	if (name.empty() || *name.begin() == "..") return {};
+	return name.generic_string();
 }
 
-static void process_directory(fs::path const& directory, std::ostream& log) {
-	mipgen::Context mipgen_ctx(mipgen::GenerationMethod::ImageBlit);
+// Converts every asset below the given directory, spread over a pool of worker threads. Returns false if any
+// conversion or the archive update failed.
+static bool process_directory(CommandLine const& args, ConversionCache* cache, LogSink& sink) {
+	fs::path const& directory = args.directory;
+	std::vector<std::pair<fs::path, uintmax_t>> files;
 	for (fs::directory_entry const& entry : fs::recursive_directory_iterator(directory)) {
-		process_file(entry.path(), log);
+		if (!entry.is_regular_file()) continue;
+		if (!is_asset(entry.path())) continue;
+		files.emplace_back(entry.path(), entry.file_size());
+	}
+
+	// Queue the largest files first, so a huge file picked up last cannot leave every other worker idle.
+	// Workers pop the newest task from their own queue, so push in ascending order of size.
+	std::sort(files.begin(), files.end(), [](auto const& a, auto const& b) { return a.second < b.second; });
+
+	ThreadPool pool(static_cast<size_t>(std::max(args.jobs, 0)));
+	std::vector<assettool::Context> contexts(pool.size());
+
+	uint64_t const options_hash = hash_options(args.options);
+
+	std::atomic<size_t> converted = 0;
+	std::atomic<size_t> skipped = 0;
+	std::atomic<size_t> failed = 0;
+	std::atomic<uintmax_t> bytes_in = 0;
+	// Outputs written in this run, which the archive has to read again.
+	std::vector<char> changed(files.size(), 0);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < files.size(); ++i) {
+		pool.push([&, i](size_t worker) {
+			LogBuffer log(sink);
+			ProcessResult result = process_file(files[i].first, contexts[worker], pool, args.options, cache, args.force, options_hash, log);
+			if (result.skipped) skipped.fetch_add(1);
+			if (!result.converted) return;
+			changed[i] = result.success;
+			converted.fetch_add(1);
+			bytes_in.fetch_add(result.bytes_in);
+			if (!result.success) failed.fetch_add(1);
+		});
 	}
+	pool.wait();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	double const seconds = std::chrono::duration<double>(end - start).count();
+	double const megabytes = static_cast<double>(bytes_in.load()) / (1024.0 * 1024.0);
+
+	LogBuffer log(sink);
+	log << LINE_HORIZONTAL;
+	log << "Converted " << converted.load() << " files (" << failed.load() << " failed, " << skipped.load() << " up to date) using "
+		<< pool.size() << " workers in " << seconds << "s.\n";
+	if (seconds > 0.0) {
+		log << "Throughput: " << (converted.load() / seconds) << " files/s, " << (megabytes / seconds) << " MB/s.\n";
+	}
+	log << LINE_HORIZONTAL;
+
+	if (!args.archive.empty()) {
+		// The archive mirrors the directory: outputs of failed conversions keep their previous version, assets whose
+		// source is gone are dropped.
+		std::vector<archive::Asset> assets;
+		bool named = true;
+		for (size_t i = 0; i < files.size(); ++i) {
+			fs::path const output = assettool::output_path(files[i].first);
+			if (!fs::exists(output)) continue;
+			std::string name = archive_name(args, output);
+			if (name.empty()) {
+				log << "Error: " << output.generic_string() << " is outside of the archive root, set --archive-root.\n";
+				named = false;
+				continue;
+			}
+			assets.push_back({ std::move(name), output, changed[i] != 0 });
+		}
+		// Without every name, removing missing assets would drop the ones that were left out.
+		if (!named) return false;
+		archive::UpdateSettings settings;
+		settings.remove_missing = true;
+		settings.dedup = args.archive_dedup;
+		settings.rewrite = args.archive_rewrite;
+		if (!archive::update(args.archive, pool, assets, settings, log)) return false;
+	}
+	return failed.load() == 0;
 }
 
 // Functions used to parse arguments
@@ -107,34 +269,303 @@ struct argumentum::from_string<assetlib::ColorSpace> {
     [[nodiscard]] static assetlib::ColorSpace convert(std::string const& s) {
         if (s == "RGB") return assetlib::ColorSpace::RGB;
         else if (s == "sRGB") return assetlib::ColorSpace::sRGB;
+        // "auto"
         else return assetlib::ColorSpace::Unknown;
     }
 };
 
-// Usage: assettool filename
+template<>
+struct argumentum::from_string<MipMethod> {
+    [[nodiscard]] static MipMethod convert(std::string const& s) {
+        if (s == "cpu") return MipMethod::CPU;
+        return MipMethod::GPU;
+    }
+};
+
+template<>
+struct argumentum::from_string<cpu_mipgen::Filter> {
+    [[nodiscard]] static cpu_mipgen::Filter convert(std::string const& s) {
+        if (s == "kaiser") return cpu_mipgen::Filter::Kaiser;
+        else if (s == "lanczos") return cpu_mipgen::Filter::Lanczos;
+        else return cpu_mipgen::Filter::Box;
+    }
+};
+
+template<>
+struct argumentum::from_string<block_compress::Format> {
+    [[nodiscard]] static block_compress::Format convert(std::string const& s) {
+        if (s == "bc1") return block_compress::Format::BC1;
+        else if (s == "bc3") return block_compress::Format::BC3;
+        else if (s == "bc4") return block_compress::Format::BC4;
+        else if (s == "bc5") return block_compress::Format::BC5;
+        else if (s == "bc7") return block_compress::Format::BC7;
+        else return block_compress::Format::None;
+    }
+};
+
+template<>
+struct argumentum::from_string<block_compress::Quality> {
+    [[nodiscard]] static block_compress::Quality convert(std::string const& s) {
+        if (s == "fast") return block_compress::Quality::Fast;
+        return block_compress::Quality::High;
+    }
+};
+
+template<>
+struct argumentum::from_string<MeshOptimization> {
+    [[nodiscard]] static MeshOptimization convert(std::string const& s) {
+        if (s == "none") return MeshOptimization::None;
+        else if (s == "overdraw") return MeshOptimization::Overdraw;
+        else return MeshOptimization::VertexCache;
+    }
+};
+
+template<>
+struct argumentum::from_string<OutputVertexFormat> {
+    [[nodiscard]] static OutputVertexFormat convert(std::string const& s) {
+        if (s == "compact") return OutputVertexFormat::Compact;
+        return OutputVertexFormat::PNTV32;
+    }
+};
+
+template<>
+struct argumentum::from_string<codec::Settings> {
+    [[nodiscard]] static codec::Settings convert(std::string const& s) {
+        codec::Settings settings;
+        if (!codec::parse_settings(s, settings)) {
+            throw std::invalid_argument("Invalid compression '" + s + "', expected none, lz4, lz4hc[:3-12] or zstd[:level]");
+        }
+        return settings;
+    }
+};
+
+// Exits with a non-zero status if any conversion, the packing or the archive update failed.
+// Usage: assettool --file filename
+//        assettool (--file filename | --dir directory) [--jobs N] [--archive archive [--archive-root directory]]
+//        assettool --pack atlas|array --pack-output output (--dir directory | --pack-inputs files...)
 int main(int argc, char** argv) {
 	std::ostream& log = std::cout;
+    CommandLine args;
 
     auto parser = argumentum::argument_parser{};
     auto params = parser.params();
     parser.config().program(argv[0]).description("Asset converter tool for Andromeda.");
-    params.add_parameter(g_options.file, "--file", "-f")
+    params.add_parameter(args.file, "--file", "-f")
         .nargs(1)
-        .required()
         .help("Path to the unprocessed asset file.");
-    params.add_parameter(g_options.colorspace, "--colorspace", "-s")
+    params.add_parameter(args.directory, "--dir", "-d")
+        .nargs(1)
+        .help("Path to a directory. Every asset below it is converted in parallel.");
+    params.add_parameter(args.jobs, "--jobs", "-j")
+        .nargs(1)
+        .absent(0)
+        .help("Amount of worker threads. Defaults to the amount of hardware threads.");
+    params.add_parameter(args.force, "--force")
+        .nargs(0)
+        .help("Convert every asset, even if the conversion cache says its output is up to date. The cache is still updated.");
+    params.add_parameter(args.options.colorspace, "--colorspace", "-s")
         .nargs(1)
-        .choices({"RGB", "sRGB"})
-        .absent(assetlib::ColorSpace::RGB)
-        .help("If the asset is an image file, this is the color space of the image.");
-    params.add_parameter(g_options.channels, "--channels", "-c")
+        .choices({"auto", "RGB", "sRGB"})
+        .absent(assetlib::ColorSpace::Unknown)
+        .help("If the asset is an image file, this is the color space of the image. 'auto' reads it from the sRGB and gAMA chunks of PNG files, and uses RGB for files without them.");
+    params.add_parameter(args.options.channels, "--channels", "-c")
         .nargs(1)
         .absent(4)
         .help("If the asset is an image file, this is the amount of channels the final processed image must have.");
+    params.add_parameter(args.options.mip_method, "--mip-method")
+        .nargs(1)
+        .choices({"gpu", "cpu"})
+        .absent(MipMethod::GPU)
+        .help("Generate mipmaps with GPU image blits, or on the CPU for machines without a GPU.");
+    params.add_parameter(args.options.mip_filter, "--mip-filter")
+        .nargs(1)
+        .choices({"box", "kaiser", "lanczos"})
+        .absent(cpu_mipgen::Filter::Box)
+        .help("Downsampling filter used with --mip-method cpu. Atlas pages always use box, the others reach past the padding.");
+    params.add_parameter(args.options.block_format, "--format")
+        .nargs(1)
+        .choices({"none", "bc1", "bc3", "bc4", "bc5", "bc7"})
+        .absent(block_compress::Format::None)
+        .help("Block compression format for textures. 'none' keeps texels uncompressed.");
+    params.add_parameter(args.options.block_quality, "--format-quality")
+        .nargs(1)
+        .choices({"fast", "high"})
+        .absent(block_compress::Quality::High)
+        .help("Block compression preset. 'fast' for iteration builds, 'high' for release builds.");
+    params.add_parameter(args.options.mesh_optimization, "--mesh-optimize")
+        .nargs(1)
+        .choices({"none", "cache", "overdraw"})
+        .absent(MeshOptimization::VertexCache)
+        .help("Mesh optimizations. 'cache' welds vertices and reorders for the vertex cache, 'overdraw' also reduces overdraw.");
+    params.add_parameter(args.options.vertex_format, "--vertex-format")
+        .nargs(1)
+        .choices({"pntv32", "compact"})
+        .absent(OutputVertexFormat::PNTV32)
+        .help("Vertex format of meshes. 'compact' quantizes to 20 bytes per vertex (UNORM16 positions in mesh bounds, octahedral normals and tangents, half float uvs).");
+    params.add_parameter(args.options.lod_ratios, "--lods")
+        .minargs(1)
+        .help("Generate simplified levels of detail with these fractions of the original triangle count, e.g. --lods 0.5 0.25 0.125.");
+    params.add_parameter(args.options.lod_error, "--lod-error")
+        .nargs(1)
+        .absent(0.01f)
+        .help("Largest error allowed while simplifying levels of detail, relative to the mesh size.");
+    params.add_parameter(args.options.meshlets, "--meshlets")
+        .nargs(0)
+        .help("Split meshes and their levels of detail into meshlets of at most 64 vertices and 124 triangles.");
+    params.add_parameter(args.options.compression, "--compression")
+        .nargs(1)
+        .absent(codec::Settings{})
+        .help("Codec for asset data: none, lz4, lz4hc[:level] or zstd[:level]. Only none, lz4 and lz4hc without --chunked are readable without the assettool extensions.");
+    params.add_parameter(args.options.chunked, "--chunked")
+        .nargs(0)
+        .help("Compress every mip level and every 256 KiB of mesh data independently, for parallel and partial decompression.");
+    params.add_parameter(args.options.memory_budget_mb, "--memory-budget")
+        .nargs(1)
+        .absent(0)
+        .help("Memory budget per conversion in MiB. Larger textures are decoded, mipmapped, compressed and written in strips, always with chunked compression. 0 disables the limit.");
+    params.add_parameter(args.pack, "--pack")
+        .nargs(1)
+        .choices({"none", "atlas", "array"})
+        .absent("none")
+        .help("Pack textures into atlas pages, or into the layers of one texture array, and write a JSON table with the texel and UV rectangle of every texture.");
+    params.add_parameter(args.pack_output, "--pack-output")
+        .nargs(1)
+        .help("Output of --pack, without extension. Atlas pages are written as <output>_<page>.tx, arrays as <output>.tx, the table as <output>.json.");
+    params.add_parameter(args.pack_inputs, "--pack-inputs")
+        .minargs(1)
+        .help("Textures to pack. Without it, every texture below --dir is packed.");
+    params.add_parameter(args.atlas_size, "--atlas-size")
+        .nargs(1)
+        .absent(2048)
+        .help("Largest width and height of an atlas page. Pages shrink to the smallest power of two that holds their textures.");
+    params.add_parameter(args.atlas_padding, "--atlas-padding")
+        .nargs(1)
+        .absent(4)
+        .help("Texels around every texture in an atlas, copied from its edges. Pages keep 1 + log2(padding) mip levels, so filtering never mixes textures.");
+    params.add_parameter(args.archive, "--archive")
+        .nargs(1)
+        .help("Also store every converted asset in this archive, a single file with a hashed table of contents. Only changed assets are written, the archive is updated in place.");
+    params.add_parameter(args.archive_root, "--archive-root")
+        .nargs(1)
+        .help("Directory that asset names in the archive are relative to, for both --file and --dir. Defaults to the directory of the archive.");
+    params.add_parameter(args.archive_dedup, "--archive-dedup")
+        .nargs(0)
+        .help("Store assets with identical contents only once in the archive.");
+    params.add_parameter(args.archive_rewrite, "--archive-rewrite")
+        .nargs(0)
+        .help("Write a compacted archive instead of appending to it. Happens anyway once replaced assets take more space than the current ones.");
+    params.add_parameter(args.profile, "--profile")
+        .nargs(1)
+        .help("Write per-stage timings, byte counts and memory use to this file, in Chrome trace-event format (chrome://tracing, Perfetto).");
 
     if (!parser.parse_args(argc, argv)) return -1;
 
+    Options const& options = args.options;
+    if (args.pack == "none") {
+        if (args.file.empty() == args.directory.empty()) {
+            log << "Error: Exactly one of --file or --dir must be given.\n";
+            return -1;
+        }
+    } else {
+        if (args.pack_output.empty()) {
+            log << "Error: --pack requires --pack-output.\n";
+            return -1;
+        }
+        if (args.pack_inputs.empty() == args.directory.empty()) {
+            log << "Error: Exactly one of --pack-inputs or --dir must be given with --pack.\n";
+            return -1;
+        }
+        if (!args.archive.empty()) {
+            log << "Error: --archive cannot be combined with --pack.\n";
+            return -1;
+        }
+        if (args.atlas_size < 1 || args.atlas_padding < 0) {
+            log << "Error: --atlas-size must be positive and --atlas-padding must not be negative.\n";
+            return -1;
+        }
+    }
+    if (options.memory_budget_mb < 0) {
+        log << "Error: --memory-budget must not be negative.\n";
+        return -1;
+    }
+    for (float ratio : options.lod_ratios) {
+        if (!(ratio > 0.0f && ratio < 1.0f)) {
+            log << "Error: --lods ratios must be between 0 and 1.\n";
+            return -1;
+        }
+    }
+
     log_asset_versions(log);
-	stbi_set_flip_vertically_on_load(true);
-	process_file(g_options.file, log);
+    if (!args.profile.empty()) profile::enable();
+
+    // The cache manifest lives next to the converted output.
+    fs::path const cache_directory = args.directory.empty() ? args.file.parent_path() : args.directory;
+    std::unique_ptr<ConversionCache> cache;
+    // Packed outputs depend on all of their inputs at once, which the per-file cache cannot track. Forced runs still
+    // record what they convert, so the next run without --force can skip it.
+    if (args.pack == "none") {
+        cache = std::make_unique<ConversionCache>(cache_directory);
+    }
+
+    bool success = true;
+    if (args.pack != "none") {
+        atlas::PackSettings settings;
+        settings.mode = args.pack == "array" ? atlas::PackMode::Array : atlas::PackMode::Atlas;
+        settings.output = args.pack_output;
+        settings.atlas_size = static_cast<uint32_t>(args.atlas_size);
+        settings.padding = static_cast<uint32_t>(args.atlas_padding);
+
+        ThreadPool pool(static_cast<size_t>(std::max(args.jobs, 0)));
+        assettool::Context ctx;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (atlas::pack_textures(ctx.mipgen(options), pool, options, settings, pack_inputs(args), log)) {
+            auto end = std::chrono::high_resolution_clock::now();
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+            log << "Packed textures into " << args.pack_output.generic_string() << " in " << ms << "ms.\n";
+        } else {
+            log << "Packing textures into " << args.pack_output.generic_string() << " failed.\n";
+            success = false;
+        }
+    } else if (!args.directory.empty()) {
+        LogSink sink(log);
+        success = process_directory(args, cache.get(), sink);
+    } else {
+        // A single file still uses a pool, for the parallel parts of its conversion.
+        ThreadPool pool(static_cast<size_t>(std::max(args.jobs, 0)));
+        assettool::Context ctx;
+        ProcessResult result = process_file(args.file, ctx, pool, options, cache.get(), args.force, hash_options(options), log);
+        if (result.skipped) {
+            log << args.file.generic_string() << " is up to date.\n";
+        }
+        success = result.success;
+        fs::path const output = assettool::output_path(args.file);
+        if (!args.archive.empty() && fs::exists(output)) {
+            // Only this asset is updated, everything else in the archive stays.
+            archive::Asset asset = { archive_name(args, output), output, result.converted && result.success };
+            archive::UpdateSettings settings;
+            settings.dedup = args.archive_dedup;
+            settings.rewrite = args.archive_rewrite;
+            if (asset.name.empty()) {
+                log << "Error: " << output.generic_string() << " is outside of the archive root, set --archive-root.\n";
+                success = false;
+            } else if (!archive::update(args.archive, pool, { asset }, settings, log)) {
+                success = false;
+            }
+        }
+    }
+
+    if (cache && !cache->save()) {
+        log << "Warning: Failed to write conversion cache in " << cache_directory.generic_string() << ".\n";
+    }
+
+    if (!args.profile.empty()) {
+        std::string error;
+        if (!profile::write(args.profile, error)) {
+            log << "Warning: " << error << ".\n";
+        } else {
+            log << "Wrote profile to " << args.profile.generic_string() << ".\n";
+        }
+    }
+
+    return success ? 0 : -1;
 }
\ No newline at end of file
@@ -0,0 +1,286 @@
+#include <mapped_file.hpp>
+
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#else
+#	include <cerrno>
+#	include <cstring>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+static std::string system_error_message() {
+#ifdef _WIN32
+	return std::system_category().message(static_cast<int>(GetLastError()));
+#else
+	return std::strerror(errno);
+#endif
+}
+
+#ifndef _WIN32
+// Reserves the disk space for the whole file, so running out of space is reported here instead of raising SIGBUS on
+// a store into the mapping. Returns 0 or an errno value.
+static int allocate_file(int file, uint64_t size) {
+#	ifdef __APPLE__
+	fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0 };
+	if (fcntl(file, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		if (fcntl(file, F_PREALLOCATE, &store) == -1) return errno;
+	}
+	return ftruncate(file, static_cast<off_t>(size)) == 0 ? 0 : errno;
+#	else
+	return posix_fallocate(file, 0, static_cast<off_t>(size));
+#	endif
+}
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept {
+	*this = std::move(rhs);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept {
+	if (this != &rhs) {
+		close();
+		memory = std::exchange(rhs.memory, nullptr);
+		bytes = std::exchange(rhs.bytes, 0);
+		opened = std::exchange(rhs.opened, false);
+	}
+	return *this;
+}
+
+MappedFile MappedFile::open(fs::path const& path, std::string& error) {
+	MappedFile result;
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		error = "Failed to open " + path.generic_string() + ": " + system_error_message();
+		return result;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		error = "Failed to query size of " + path.generic_string() + ": " + system_error_message();
+		CloseHandle(file);
+		return result;
+	}
+	result.bytes = static_cast<uint64_t>(size.QuadPart);
+	if (result.bytes > 0) {
+		// The view keeps the mapping and the file alive, both handles can be closed right away.
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr) {
+			result.memory = static_cast<unsigned char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+		if (result.memory == nullptr) {
+			error = "Failed to map " + path.generic_string() + ": " + system_error_message();
+			CloseHandle(file);
+			result.bytes = 0;
+			return result;
+		}
+	}
+	CloseHandle(file);
+#else
+	int const file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		error = "Failed to open " + path.generic_string() + ": " + system_error_message();
+		return result;
+	}
+	struct stat info;
+	if (fstat(file, &info) != 0) {
+		error = "Failed to query size of " + path.generic_string() + ": " + system_error_message();
+		::close(file);
+		return result;
+	}
+	result.bytes = static_cast<uint64_t>(info.st_size);
+	if (result.bytes > 0) {
+		void* memory = mmap(nullptr, result.bytes, PROT_READ, MAP_PRIVATE, file, 0);
+		if (memory == MAP_FAILED) {
+			error = "Failed to map " + path.generic_string() + ": " + system_error_message();
+			::close(file);
+			result.bytes = 0;
+			return result;
+		}
+		// Decoders read front to back, let the kernel read ahead aggressively.
+		madvise(memory, result.bytes, MADV_SEQUENTIAL);
+		result.memory = static_cast<unsigned char const*>(memory);
+	}
+	// The mapping stays valid after closing the descriptor.
+	::close(file);
+#endif
+	result.opened = true;
+	return result;
+}
+
+void MappedFile::close() {
+	if (memory) {
+#ifdef _WIN32
+		UnmapViewOfFile(memory);
+#else
+		munmap(const_cast<unsigned char*>(memory), bytes);
+#endif
+	}
+	memory = nullptr;
+	bytes = 0;
+	opened = false;
+}
+
+void release_pages(void const* data, size_t size) {
+	if (size == 0) return;
+#ifdef _WIN32
+	// Unlocking pages that are not locked removes them from the working set.
+	VirtualUnlock(const_cast<void*>(data), size);
+#else
+	// Whole pages only, rounded outwards. Pages of a read-only file mapping are simply read again when touched.
+	uintptr_t const page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	uintptr_t const begin = reinterpret_cast<uintptr_t>(data) & ~(page - 1);
+	uintptr_t const end = reinterpret_cast<uintptr_t>(data) + size;
+	madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+MappedOutputFile::~MappedOutputFile() {
+	discard();
+}
+
+MappedOutputFile::MappedOutputFile(MappedOutputFile&& rhs) noexcept {
+	*this = std::move(rhs);
+}
+
+MappedOutputFile& MappedOutputFile::operator=(MappedOutputFile&& rhs) noexcept {
+	if (this != &rhs) {
+		discard();
+		path = std::move(rhs.path);
+		temp_path = std::move(rhs.temp_path);
+		memory = std::exchange(rhs.memory, nullptr);
+		bytes = std::exchange(rhs.bytes, 0);
+		opened = std::exchange(rhs.opened, false);
+#ifdef _WIN32
+		file = std::exchange(rhs.file, nullptr);
+#else
+		file = std::exchange(rhs.file, -1);
+#endif
+	}
+	return *this;
+}
+
+MappedOutputFile MappedOutputFile::create(fs::path const& path, uint64_t capacity, std::string& error) {
+	MappedOutputFile result;
+	result.path = path;
+	result.temp_path = path;
+	result.temp_path += ".tmp";
+#ifdef _WIN32
+	HANDLE file = CreateFileW(result.temp_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		error = "Failed to create " + path.generic_string() + ": " + system_error_message();
+		return result;
+	}
+	result.file = file;
+	// From here on, the destructor removes the file again if anything goes wrong.
+	result.opened = true;
+	if (capacity > 0) {
+		// Creating the mapping grows the file to the requested capacity.
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(capacity >> 32), static_cast<DWORD>(capacity), nullptr);
+		if (mapping != nullptr) {
+			result.memory = static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+	}
+#else
+	int const file = ::open(result.temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0) {
+		error = "Failed to create " + path.generic_string() + ": " + system_error_message();
+		return result;
+	}
+	result.file = file;
+	// From here on, the destructor removes the file again if anything goes wrong.
+	result.opened = true;
+	if (capacity > 0) {
+		if (int const status = allocate_file(file, capacity); status != 0) {
+			error = "Failed to allocate " + std::to_string(capacity) + " bytes for " + path.generic_string() + ": " + std::strerror(status);
+			return MappedOutputFile{};
+		}
+		void* memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (memory != MAP_FAILED) result.memory = static_cast<unsigned char*>(memory);
+	}
+#endif
+	if (capacity > 0 && result.memory == nullptr) {
+		error = "Failed to map " + path.generic_string() + ": " + system_error_message();
+		return MappedOutputFile{};
+	}
+	result.bytes = capacity;
+	return result;
+}
+
+bool MappedOutputFile::finish(uint64_t size, std::string& error) {
+	if (!opened || size > bytes) {
+		error = "Invalid size for output file " + path.generic_string();
+		return false;
+	}
+
+#ifdef _WIN32
+	if (memory) {
+		UnmapViewOfFile(memory);
+		memory = nullptr;
+	}
+	LARGE_INTEGER end;
+	end.QuadPart = static_cast<LONGLONG>(size);
+	bool const truncated = SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+#else
+	if (memory) {
+		munmap(memory, bytes);
+		memory = nullptr;
+	}
+	bool const truncated = ftruncate(file, static_cast<off_t>(size)) == 0;
+#endif
+	if (!truncated) {
+		error = "Failed to resize " + path.generic_string() + ": " + system_error_message();
+		return false;
+	}
+
+	close();
+	opened = false;
+	std::error_code ec;
+	fs::rename(temp_path, path, ec);
+	if (ec) {
+		error = "Failed to replace " + path.generic_string() + ": " + ec.message();
+		fs::remove(temp_path, ec);
+		return false;
+	}
+	return true;
+}
+
+void MappedOutputFile::discard() {
+	if (!opened) return;
+	close();
+	opened = false;
+	std::error_code ec;
+	fs::remove(temp_path, ec);
+}
+
+void MappedOutputFile::close() {
+#ifdef _WIN32
+	if (memory) UnmapViewOfFile(memory);
+	if (file) CloseHandle(file);
+	file = nullptr;
+#else
+	if (memory) munmap(memory, bytes);
+	if (file >= 0) ::close(file);
+	file = -1;
+#endif
+	memory = nullptr;
+	bytes = 0;
+}
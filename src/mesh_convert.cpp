@@ -1,54 +1,599 @@
 #include <mesh_convert.hpp>
 #include <assetlib/mesh.hpp>
 
+#include <mesh_optimize.hpp>
+#include <mesh_simplify.hpp>
+#include <meshlet.hpp>
+#include <vertex_quantize.hpp>
+#include <asset_ext.hpp>
+#include <codec.hpp>
+#include <options.hpp>
+#include <profile.hpp>
+
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <limits>
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
-bool convert_mesh(plib::binary_input_stream& in, plib::binary_output_stream& out, std::ostream& log) {
+// Range of the merged vertex and index buffers that holds one aiMesh of the scene.
+// Indices are relative to first_vertex, so every submesh is drawn with first_vertex as its vertex offset.
+struct Submesh {
+	uint32_t first_vertex = 0;
+	uint32_t vertex_count = 0;
+	uint32_t first_index = 0;
+	uint32_t index_count = 0;
+	uint32_t material = 0;
+	float bounds_min[3] = {};
+	float bounds_max[3] = {};
+};
+
+// Index range of a submesh within one level of detail. Uses the vertices of the full detail submesh.
+struct LodRange {
+	uint32_t first_index = 0;
+	uint32_t index_count = 0;
+	float error = 0.0f;
+};
+
+struct Lod {
+	float ratio = 1.0f;
+	// One range per submesh
+	std::vector<LodRange> ranges;
+};
+
+// Meshlets of one submesh in one level of detail. Level 0 is the full detail mesh.
+struct MeshletGroup {
+	uint32_t lod = 0;
+	uint32_t submesh = 0;
+	uint32_t first_meshlet = 0;
+	uint32_t meshlet_count = 0;
+};
+
+struct MeshletTable {
+	std::vector<MeshletGroup> groups;
+	std::vector<meshlet::Meshlet> meshlets;
+	// Position of the meshlet vertex indices in the index buffer. Like all indices, they are relative to the first
+	// vertex of their submesh.
+	uint32_t vertex_data_offset = 0;
+	// Three bytes per triangle, appended to the index buffer after conversion to the final index size.
+	std::vector<uint8_t> triangles;
+};
+
+struct SubmeshStats {
+	mesh_optimize::Stats before;
+	mesh_optimize::Stats after;
+	size_t vertices_before = 0;
+};
+
+// Amount of vertices or indices copied per task.
+static constexpr size_t copy_grain = 64 * 1024;
+
+static size_t count_triangles(aiMesh const* mesh) {
+	size_t count = 0;
+	for (size_t i = 0; i < mesh->mNumFaces; ++i) {
+		// Triangulation leaves point and line primitives alone, those cannot be drawn as triangles.
+		if (mesh->mFaces[i].mNumIndices == 3) ++count;
+	}
+	return count;
+}
+
+// Finds the submesh that an element of the merged buffers belongs to, given the first element of every submesh.
+static size_t find_submesh(std::vector<size_t> const& firsts, size_t element) {
+	return static_cast<size_t>(std::upper_bound(firsts.begin(), firsts.end(), element) - firsts.begin()) - 1;
+}
+
+static SubmeshStats optimize_submesh(assetlib::PNTV32Vertex* vertices, uint32_t* indices, Submesh& submesh, MeshOptimization optimization) {
+	constexpr size_t stride = sizeof(assetlib::PNTV32Vertex);
+	SubmeshStats stats;
+	stats.vertices_before = submesh.vertex_count;
+	stats.before = mesh_optimize::analyze_vertex_cache(indices, submesh.index_count, submesh.vertex_count);
+
+	size_t vertex_count = mesh_optimize::deduplicate_vertices(vertices, submesh.vertex_count, stride, indices, submesh.index_count);
+	mesh_optimize::optimize_vertex_cache(indices, submesh.index_count, vertex_count);
+	if (optimization == MeshOptimization::Overdraw) {
+		mesh_optimize::optimize_overdraw(indices, submesh.index_count, vertices, vertex_count, stride);
+	}
+	vertex_count = mesh_optimize::optimize_vertex_fetch(vertices, vertex_count, stride, indices, submesh.index_count);
+	submesh.vertex_count = static_cast<uint32_t>(vertex_count);
+
+	stats.after = mesh_optimize::analyze_vertex_cache(indices, submesh.index_count, submesh.vertex_count);
+	return stats;
+}
+
+// Optimizes every submesh on its own, so they stay separately drawable, and compacts the vertex buffer afterwards.
+static void optimize_mesh(ThreadPool& pool, MeshOptimization optimization, std::vector<assetlib::PNTV32Vertex>& vertices, std::vector<uint32_t>& indices,
+						  std::vector<Submesh>& submeshes, std::ostream& log) {
+	std::vector<SubmeshStats> stats(submeshes.size());
+	pool.parallel_for(submeshes.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			Submesh& submesh = submeshes[i];
+			stats[i] = optimize_submesh(vertices.data() + submesh.first_vertex, indices.data() + submesh.first_index, submesh, optimization);
+		}
+	});
+
+	// Welding only ever removes vertices, so the index buffer keeps its layout. Close the gaps in the vertex buffer.
+	std::vector<assetlib::PNTV32Vertex> compacted;
+	std::vector<uint32_t> old_first(submeshes.size());
+	uint32_t vertex_count = 0;
+	for (size_t i = 0; i < submeshes.size(); ++i) {
+		old_first[i] = submeshes[i].first_vertex;
+		submeshes[i].first_vertex = vertex_count;
+		vertex_count += submeshes[i].vertex_count;
+	}
+	compacted.resize(vertex_count);
+	pool.parallel_for(submeshes.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			std::copy_n(vertices.data() + old_first[i], submeshes[i].vertex_count, compacted.data() + submeshes[i].first_vertex);
+		}
+	});
+
+	// Weigh the per submesh ratios by what they are relative to.
+	float acmr_before = 0.0f, acmr_after = 0.0f, atvr_before = 0.0f, atvr_after = 0.0f;
+	size_t const triangles = indices.size() / 3;
+	for (size_t i = 0; i < submeshes.size(); ++i) {
+		float const triangle_weight = static_cast<float>(submeshes[i].index_count / 3) / static_cast<float>(std::max<size_t>(triangles, 1));
+		float const vertex_weight = static_cast<float>(submeshes[i].vertex_count) / static_cast<float>(std::max<uint32_t>(vertex_count, 1));
+		acmr_before += stats[i].before.acmr * triangle_weight;
+		acmr_after += stats[i].after.acmr * triangle_weight;
+		atvr_before += stats[i].before.atvr * vertex_weight;
+		atvr_after += stats[i].after.atvr * vertex_weight;
+	}
+
+	log << "Optimized mesh: " << vertices.size() << " -> " << compacted.size() << " vertices, "
+		<< "ACMR " << acmr_before << " -> " << acmr_after << ", "
+		<< "ATVR " << atvr_before << " -> " << atvr_after << "\n";
+	vertices = std::move(compacted);
+}
+
+static void compute_bounds(assetlib::PNTV32Vertex const* vertices, Submesh& submesh) {
+	vertex_quantize::Bounds const bounds = vertex_quantize::compute_bounds(vertices + submesh.first_vertex, submesh.vertex_count);
+	std::copy_n(bounds.min, 3, submesh.bounds_min);
+	std::copy_n(bounds.max, 3, submesh.bounds_max);
+}
+
+// Simplifies every submesh to every requested ratio, independently from the full detail mesh so that errors do not
+// accumulate, and appends the results to the index buffer.
+static std::vector<Lod> generate_lods(ThreadPool& pool, Options const& options, std::vector<assetlib::PNTV32Vertex> const& vertices,
+									  std::vector<uint32_t>& indices, std::vector<Submesh> const& submeshes, std::ostream& log) {
+	constexpr size_t stride = sizeof(assetlib::PNTV32Vertex);
+	std::vector<float> const& ratios = options.lod_ratios;
+	size_t const task_count = ratios.size() * submeshes.size();
+
+	std::vector<std::vector<uint32_t>> results(task_count);
+	std::vector<float> errors(task_count);
+	pool.parallel_for(task_count, 1, [&](size_t begin, size_t end) {
+		for (size_t task = begin; task < end; ++task) {
+			float const ratio = ratios[task / submeshes.size()];
+			Submesh const& submesh = submeshes[task % submeshes.size()];
+			uint32_t const* source = indices.data() + submesh.first_index;
+			size_t const target = static_cast<size_t>(static_cast<double>(submesh.index_count / 3) * ratio) * 3;
+
+			std::vector<uint32_t>& result = results[task];
+			result.resize(submesh.index_count);
+			// Only uv splits are seams. Normals may differ at a position, like on flat shaded meshes.
+			size_t const count = mesh_simplify::simplify(result.data(), source, submesh.index_count, vertices.data() + submesh.first_vertex,
+														 submesh.vertex_count, stride, offsetof(assetlib::PNTV32Vertex, uv),
+														 sizeof(assetlib::PNTV32Vertex::uv), target, options.lod_error, &errors[task]);
+			result.resize(count);
+			if (options.mesh_optimization != MeshOptimization::None) {
+				mesh_optimize::optimize_vertex_cache(result.data(), result.size(), submesh.vertex_count);
+			}
+		}
+	});
+
+	std::vector<Lod> lods(ratios.size());
+	size_t const full_triangles = indices.size() / 3;
+	for (size_t l = 0; l < ratios.size(); ++l) {
+		Lod& lod = lods[l];
+		lod.ratio = ratios[l];
+		lod.ranges.resize(submeshes.size());
+		float max_error = 0.0f;
+		size_t triangles = 0;
+		for (size_t s = 0; s < submeshes.size(); ++s) {
+			std::vector<uint32_t> const& result = results[l * submeshes.size() + s];
+			LodRange& range = lod.ranges[s];
+			range.first_index = static_cast<uint32_t>(indices.size());
+			range.index_count = static_cast<uint32_t>(result.size());
+			range.error = errors[l * submeshes.size() + s];
+			indices.insert(indices.end(), result.begin(), result.end());
+			max_error = std::max(max_error, range.error);
+			triangles += result.size() / 3;
+		}
+		log << "Generated LOD " << l + 1 << ": " << full_triangles << " -> " << triangles << " triangles (target ratio " << lod.ratio
+			<< "), error " << max_error << "\n";
+		// Collapses remove two triangles at a time, allow for a little slack.
+		if (full_triangles > 0 && static_cast<double>(triangles) > static_cast<double>(full_triangles) * lod.ratio * 1.1 + 2.0 * submeshes.size()) {
+			log << "Warning: LOD " << l + 1 << " only reached ratio " << static_cast<double>(triangles) / static_cast<double>(full_triangles)
+				<< ". --lod-error, open borders or uv seams keep the mesh from being simplified further.\n";
+		}
+	}
+	return lods;
+}
+
+// Builds meshlets for every submesh of every level of detail and appends their vertex indices to the index buffer.
+static MeshletTable build_meshlets(ThreadPool& pool, std::vector<assetlib::PNTV32Vertex> const& vertices, std::vector<uint32_t>& indices,
+								   std::vector<Submesh> const& submeshes, std::vector<Lod> const& lods, std::ostream& log) {
+	constexpr size_t stride = sizeof(assetlib::PNTV32Vertex);
+	size_t const task_count = (lods.size() + 1) * submeshes.size();
+
+	std::vector<meshlet::Meshlets> results(task_count);
+	pool.parallel_for(task_count, 1, [&](size_t begin, size_t end) {
+		for (size_t task = begin; task < end; ++task) {
+			size_t const level = task / submeshes.size();
+			Submesh const& submesh = submeshes[task % submeshes.size()];
+			uint32_t first_index = submesh.first_index;
+			uint32_t index_count = submesh.index_count;
+			if (level > 0) {
+				LodRange const& range = lods[level - 1].ranges[task % submeshes.size()];
+				first_index = range.first_index;
+				index_count = range.index_count;
+			}
+			results[task] = meshlet::build(indices.data() + first_index, index_count, vertices.data() + submesh.first_vertex, submesh.vertex_count, stride);
+		}
+	});
+
+	MeshletTable table;
+	table.vertex_data_offset = static_cast<uint32_t>(indices.size());
+	for (size_t task = 0; task < task_count; ++task) {
+		meshlet::Meshlets const& result = results[task];
+		MeshletGroup group;
+		group.lod = static_cast<uint32_t>(task / submeshes.size());
+		group.submesh = static_cast<uint32_t>(task % submeshes.size());
+		group.first_meshlet = static_cast<uint32_t>(table.meshlets.size());
+		group.meshlet_count = static_cast<uint32_t>(result.meshlets.size());
+		table.groups.push_back(group);
+
+		uint32_t const vertex_base = static_cast<uint32_t>(indices.size()) - table.vertex_data_offset;
+		uint32_t const triangle_base = static_cast<uint32_t>(table.triangles.size() / 3);
+		for (meshlet::Meshlet m : result.meshlets) {
+			m.vertex_offset += vertex_base;
+			m.triangle_offset += triangle_base;
+			table.meshlets.push_back(m);
+		}
+		indices.insert(indices.end(), result.vertices.begin(), result.vertices.end());
+		table.triangles.insert(table.triangles.end(), result.triangles.begin(), result.triangles.end());
+	}
+
+	log << "Built " << table.meshlets.size() << " meshlets over " << lods.size() + 1 << " levels of detail\n";
+	return table;
+}
+
+// Copies raw bytes to the end of an index buffer, padded to whole indices.
+template<typename T>
+static void append_bytes(std::vector<T>& buffer, std::vector<uint8_t> const& bytes) {
+	size_t const offset = buffer.size();
+	buffer.resize(offset + (bytes.size() + sizeof(T) - 1) / sizeof(T), 0);
+	if (!bytes.empty()) memcpy(buffer.data() + offset, bytes.data(), bytes.size());
+}
+
+static void write_lods(JsonWriter& ext, std::vector<Lod> const& lods) {
+	ext.key("lods").begin_array();
+	for (Lod const& lod : lods) {
+		ext.begin_object();
+		ext.key("ratio").value(lod.ratio);
+		ext.key("submeshes").begin_array();
+		for (LodRange const& range : lod.ranges) {
+			ext.begin_object();
+			ext.key("first_index").value(range.first_index);
+			ext.key("index_count").value(range.index_count);
+			ext.key("error").value(range.error);
+			ext.end_object();
+		}
+		ext.end_array();
+		ext.end_object();
+	}
+	ext.end_array();
+}
+
+// Meshlet descriptors are stored as one array per field, which keeps the metadata compact for thousands of meshlets.
+static void write_meshlets(JsonWriter& ext, MeshletTable const& table, uint32_t triangle_data_offset) {
+	std::vector<uint32_t> vertex_offsets, vertex_counts, triangle_offsets, triangle_counts;
+	std::vector<float> centers, radii, cone_axes, cone_cutoffs;
+	for (meshlet::Meshlet const& m : table.meshlets) {
+		vertex_offsets.push_back(m.vertex_offset);
+		vertex_counts.push_back(m.vertex_count);
+		triangle_offsets.push_back(m.triangle_offset);
+		triangle_counts.push_back(m.triangle_count);
+		centers.insert(centers.end(), m.center, m.center + 3);
+		radii.push_back(m.radius);
+		cone_axes.insert(cone_axes.end(), m.cone_axis, m.cone_axis + 3);
+		cone_cutoffs.push_back(m.cone_cutoff);
+	}
+
+	ext.key("meshlets").begin_object();
+	ext.key("max_vertices").value(static_cast<uint32_t>(meshlet::max_vertices));
+	ext.key("max_triangles").value(static_cast<uint32_t>(meshlet::max_triangles));
+	ext.key("vertex_data_offset").value(table.vertex_data_offset);
+	ext.key("triangle_data_offset").value(triangle_data_offset);
+	ext.key("groups").begin_array();
+	for (MeshletGroup const& group : table.groups) {
+		ext.begin_object();
+		ext.key("lod").value(group.lod);
+		ext.key("submesh").value(group.submesh);
+		ext.key("first_meshlet").value(group.first_meshlet);
+		ext.key("meshlet_count").value(group.meshlet_count);
+		ext.end_object();
+	}
+	ext.end_array();
+	ext.key("vertex_offset").array(vertex_offsets.data(), vertex_offsets.size());
+	ext.key("vertex_count").array(vertex_counts.data(), vertex_counts.size());
+	ext.key("triangle_offset").array(triangle_offsets.data(), triangle_offsets.size());
+	ext.key("triangle_count").array(triangle_counts.data(), triangle_counts.size());
+	ext.key("center").array(centers.data(), centers.size());
+	ext.key("radius").array(radii.data(), radii.size());
+	ext.key("cone_axis").array(cone_axes.data(), cone_axes.size());
+	ext.key("cone_cutoff").array(cone_cutoffs.data(), cone_cutoffs.size());
+	ext.end_object();
+}
+
+static void write_submeshes(JsonWriter& ext, std::vector<Submesh> const& submeshes) {
+	ext.key("submeshes").begin_array();
+	for (Submesh const& submesh : submeshes) {
+		ext.begin_object();
+		ext.key("first_vertex").value(submesh.first_vertex);
+		ext.key("vertex_count").value(submesh.vertex_count);
+		ext.key("first_index").value(submesh.first_index);
+		ext.key("index_count").value(submesh.index_count);
+		ext.key("material").value(submesh.material);
+		ext.key("bounds_min").array(submesh.bounds_min, 3);
+		ext.key("bounds_max").array(submesh.bounds_max, 3);
+		ext.end_object();
+	}
+	ext.end_array();
+}
+
+// Compresses vertex and index data with a codec or layout assetlib cannot read, and describes it in the extension
+// metadata, or into a single LZ4HC block, which assetlib reads as LZ4. Closes the ext object.
+static bool save_compressed_mesh(ThreadPool& pool, Options const& options, asset_ext::Output& output, assetlib::MeshInfo info, void const* vertices, size_t vertex_stride,
+								 void const* indices, size_t detail_bytes, JsonWriter& ext, std::ostream& log) {
+	size_t const vertex_bytes = static_cast<size_t>(info.vertex_count) * vertex_stride;
+	size_t const index_bytes = static_cast<size_t>(info.index_count) * (info.index_bits / 8);
+
+	std::vector<codec::Section> sections;
+	std::vector<unsigned char> payload;
+	size_t max_chunk_size = codec::default_chunk_size;
+	if (options.chunked) {
+		// Levels of detail and meshlets get their own section, so readers that only draw the full mesh can skip them.
+		sections.push_back({ vertices, vertex_bytes });
+		sections.push_back({ indices, index_bytes });
+		if (detail_bytes > 0) sections.push_back({ static_cast<unsigned char const*>(indices) + index_bytes, detail_bytes });
+	} else {
+		// A single block needs contiguous input.
+		payload.resize(vertex_bytes + index_bytes + detail_bytes);
+		memcpy(payload.data(), vertices, vertex_bytes);
+		memcpy(payload.data() + vertex_bytes, indices, index_bytes + detail_bytes);
+		sections.push_back({ payload.data(), payload.size() });
+		max_chunk_size = std::numeric_limits<size_t>::max();
+	}
+
+	std::vector<char> blob;
+	std::vector<codec::Chunk> chunks;
+	{
+		profile::Scope scope("compress");
+		scope.bytes_in(vertex_bytes + index_bytes + detail_bytes);
+		if (!codec::compress_chunks(pool, options.compression, sections, max_chunk_size, blob, chunks)) {
+			log << "Error: Failed to compress mesh" << std::endl;
+			return false;
+		}
+		scope.bytes_out(blob.size());
+	}
+
+	// An unchunked LZ4HC blob is a plain LZ4 block, which keeps the header of a standard file.
+	if (asset_ext::needs_extended_compression(options.compression, options.chunked)) {
+		if (info.format == assetlib::VertexFormat::PNTV32) {
+			ext.key("vertex_format").value("PNTV32");
+			ext.key("vertex_stride").value(static_cast<uint32_t>(vertex_stride));
+		}
+		asset_ext::write_compression(ext, options.compression, chunks);
+		info.compression = assetlib::CompressionMode::None;
+		info.format = assetlib::VertexFormat::Unknown;
+	}
+	ext.end_object();
+
+	return asset_ext::save_mesh_blob(output, info, vertex_stride, detail_bytes, blob, ext, log);
+}
+
+bool convert_mesh(Assimp::Importer& importer, ThreadPool& pool, Options const& options, InputData const& in, asset_ext::Output& output,
+				  std::ostream& log) {
 	assetlib::MeshInfo info;
-	info.compression = assetlib::CompressionMode::LZ4;
+	info.compression = asset_ext::compression_mode(options.compression);
 	info.format = assetlib::VertexFormat::PNTV32;
-	info.index_bits = 32; // We will be using 32-bit indices everywhere
 
-	Assimp::Importer importer;
-	uint32_t file_size = in.size();
-	unsigned char* file_mem = new unsigned char[file_size];
-	in.read_bytes(file_mem, file_size);
-	aiScene const* scene = importer.ReadFileFromMemory(file_mem, file_size, aiProcess_CalcTangentSpace | aiProcess_GenNormals | aiProcess_Triangulate);
+	aiScene const* scene = nullptr;
+	{
+		profile::Scope scope("mesh decode");
+		scope.bytes_in(in.size);
+		scene = importer.ReadFileFromMemory(in.data, in.size, aiProcess_CalcTangentSpace | aiProcess_GenNormals | aiProcess_Triangulate);
+	}
+	if (scene == nullptr || scene->mNumMeshes == 0) {
+		log << "Error: Failed to read mesh: " << importer.GetErrorString() << std::endl;
+		return false;
+	}
+
+	// Every aiMesh becomes one submesh. Lay them out back to back, so both buffers can be sized up front.
+	std::vector<Submesh> submeshes(scene->mNumMeshes);
+	std::vector<size_t> first_vertices(scene->mNumMeshes);
+	size_t vertex_count = 0;
+	size_t index_count = 0;
+	for (size_t m = 0; m < scene->mNumMeshes; ++m) {
+		aiMesh const* mesh = scene->mMeshes[m];
+		Submesh& submesh = submeshes[m];
+		submesh.first_vertex = static_cast<uint32_t>(vertex_count);
+		submesh.vertex_count = mesh->mNumVertices;
+		submesh.first_index = static_cast<uint32_t>(index_count);
+		submesh.index_count = static_cast<uint32_t>(count_triangles(mesh) * 3);
+		submesh.material = mesh->mMaterialIndex;
+		first_vertices[m] = vertex_count;
+		vertex_count += submesh.vertex_count;
+		index_count += submesh.index_count;
+	}
+
+	if (vertex_count > std::numeric_limits<uint32_t>::max() || index_count > std::numeric_limits<uint32_t>::max()) {
+		log << "Error: Mesh is too large for 32-bit indices" << std::endl;
+		importer.FreeScene();
+		return false;
+	}
 
-	// Temporary importer only converts first mesh in the scene.
-	aiMesh const* mesh = scene->mMeshes[0];
+	profile::Scope copy_scope("mesh copy");
+	copy_scope.bytes_out(vertex_count * sizeof(assetlib::PNTV32Vertex) + index_count * sizeof(uint32_t));
+	std::vector<assetlib::PNTV32Vertex> vertices(vertex_count);
+	std::vector<uint32_t> indices(index_count);
 
-	std::vector<assetlib::PNTV32Vertex> vertices;
-	vertices.resize(mesh->mNumVertices);
-	std::vector<uint32_t> indices;
-	indices.resize(mesh->mNumFaces * 3);
+	static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "cannot memcpy aiVector3D if data is not correctly sized"); // add fail path for when this doesn't match?
+	static_assert(sizeof(unsigned int) == sizeof(uint32_t), "cannot safely memcpy indices"); // Maybe add fail path for when this does not match
 
-	for (size_t i = 0; i < mesh->mNumVertices; ++i) {
-		assetlib::PNTV32Vertex& dst = vertices[i];
-		static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "cannot memcpy aiVector3D if data is not correctly sized"); // add fail path for when this doesn't match?
-		memcpy(dst.position, &mesh->mVertices[i], 3 * sizeof(float));
-		memcpy(dst.normal, &mesh->mNormals[i], 3 * sizeof(float));
-		memcpy(dst.tangent, &mesh->mTangents[i], 3 * sizeof(float));
-		memcpy(dst.uv, &mesh->mTextureCoords[0][i], 2 * sizeof(float));
+	// Copy in large ranges across all meshes at once, so one huge mesh does not end up on a single thread.
+	pool.parallel_for(vertex_count, copy_grain, [&](size_t begin, size_t end) {
+		size_t m = find_submesh(first_vertices, begin);
+		for (size_t i = begin; i < end; ++i) {
+			while (m + 1 < first_vertices.size() && i >= first_vertices[m + 1]) ++m;
+			aiMesh const* mesh = scene->mMeshes[m];
+			size_t const local = i - first_vertices[m];
+			assetlib::PNTV32Vertex& dst = vertices[i];
+			memcpy(dst.position, &mesh->mVertices[local], 3 * sizeof(float));
+			// Not every mesh of a scene has every attribute.
+			if (mesh->mNormals) memcpy(dst.normal, &mesh->mNormals[local], 3 * sizeof(float));
+			else memset(dst.normal, 0, sizeof(dst.normal));
+			if (mesh->mTangents) memcpy(dst.tangent, &mesh->mTangents[local], 3 * sizeof(float));
+			else memset(dst.tangent, 0, sizeof(dst.tangent));
+			if (mesh->mTextureCoords[0]) memcpy(dst.uv, &mesh->mTextureCoords[0][local], 2 * sizeof(float));
+			else memset(dst.uv, 0, sizeof(dst.uv));
+		}
+	});
+
+	// Faces are copied per mesh, as skipped non-triangle faces make the position of a face in the output depend
+	// on all faces before it.
+	pool.parallel_for(scene->mNumMeshes, 1, [&](size_t begin, size_t end) {
+		for (size_t m = begin; m < end; ++m) {
+			aiMesh const* mesh = scene->mMeshes[m];
+			uint32_t* dst = indices.data() + submeshes[m].first_index;
+			for (size_t i = 0; i < mesh->mNumFaces; ++i) {
+				aiFace const& face = mesh->mFaces[i];
+				if (face.mNumIndices != 3) continue;
+				memcpy(dst, face.mIndices, 3 * sizeof(uint32_t));
+				dst += 3;
+			}
+		}
+	});
+
+	// Everything needed is copied out, release the scene before the memory hungry optimization passes.
+	importer.FreeScene();
+	copy_scope.end();
+	profile::count("vertices", vertex_count);
+	profile::count("triangles", index_count / 3);
+
+	if (options.mesh_optimization != MeshOptimization::None) {
+		profile::Scope scope("mesh optimize");
+		scope.bytes_in(vertex_count * sizeof(assetlib::PNTV32Vertex) + index_count * sizeof(uint32_t));
+		optimize_mesh(pool, options.mesh_optimization, vertices, indices, submeshes, log);
 	}
 
-	for (size_t i = 0; i < mesh->mNumFaces; ++i) {
-		uint32_t* dst_start = &indices[3 * i];
-		aiFace& face = mesh->mFaces[i];
-		static_assert(sizeof(unsigned int) == sizeof(uint32_t), "cannot safely memcpy indices"); // Maybe add fail path for when this does not match
-		assert(face.mNumIndices == 3 && "Mesh not triangulated properly");
-		memcpy(dst_start, face.mIndices, 3 * sizeof(uint32_t));
+	uint32_t largest_submesh = 0;
+	for (Submesh& submesh : submeshes) {
+		compute_bounds(vertices.data(), submesh);
+		largest_submesh = std::max(largest_submesh, submesh.vertex_count);
+	}
+
+	// Levels of detail and meshlets go behind the full detail indices, so submesh ranges stay where they are.
+	size_t const full_index_count = indices.size();
+	std::vector<Lod> lods;
+	if (!options.lod_ratios.empty()) {
+		profile::Scope scope("lods");
+		lods = generate_lods(pool, options, vertices, indices, submeshes, log);
+	}
+	MeshletTable meshlets;
+	if (options.meshlets) {
+		profile::Scope scope("meshlets");
+		meshlets = build_meshlets(pool, vertices, indices, submeshes, lods, log);
 	}
 
 	info.vertex_count = vertices.size();
-	info.index_count = indices.size();
 
-	delete[] file_mem;
+	// Use 16-bit indices whenever every vertex of each submesh can be addressed with them.
+	std::vector<uint16_t> indices16;
+	void* index_data = indices.data();
+	info.index_bits = 32;
+	uint32_t const triangle_data_offset = static_cast<uint32_t>(indices.size());
+	if (largest_submesh <= std::numeric_limits<uint16_t>::max() + uint32_t{ 1 }) {
+		indices16.resize(indices.size());
+		pool.parallel_for(indices.size(), copy_grain, [&](size_t begin, size_t end) {
+			std::copy(indices.begin() + begin, indices.begin() + end, indices16.begin() + begin);
+		});
+		append_bytes(indices16, meshlets.triangles);
+		index_data = indices16.data();
+		info.index_bits = 16;
+		// Only the 16-bit copy is written, drop the original to keep peak memory down on huge meshes.
+		std::vector<uint32_t>().swap(indices);
+	} else {
+		append_bytes(indices, meshlets.triangles);
+		index_data = indices.data();
+	}
+	// The header only counts the full detail indices, so it describes a mesh that can be drawn as is. Levels of
+	// detail and meshlets follow them as a separate section of the payload.
+	size_t const total_index_count = info.index_bits == 16 ? indices16.size() : indices.size();
+	info.index_count = full_index_count;
+	size_t const detail_index_count = total_index_count - full_index_count;
+	size_t const detail_bytes = detail_index_count * (info.index_bits / 8);
+
+	JsonWriter ext;
+	ext.begin_object();
+	write_submeshes(ext, submeshes);
+	if (!lods.empty()) write_lods(ext, lods);
+	if (options.meshlets) write_meshlets(ext, meshlets, triangle_data_offset);
+	if (detail_index_count > 0) {
+		// Offsets of levels of detail and meshlets count from the first index, and point into this section.
+		ext.key("detail_index_count").value(static_cast<uint64_t>(detail_index_count));
+	}
+	std::vector<vertex_quantize::PNTVQVertex> compact;
+	void const* vertex_data = vertices.data();
+	size_t vertex_stride = sizeof(assetlib::PNTV32Vertex);
+	if (options.vertex_format == OutputVertexFormat::Compact) {
+		profile::Scope scope("quantize");
+		scope.bytes_in(vertices.size() * sizeof(assetlib::PNTV32Vertex));
+		vertex_quantize::Bounds const bounds = vertex_quantize::compute_bounds(vertices.data(), vertices.size());
+		compact = vertex_quantize::quantize(vertices.data(), vertices.size(), bounds);
+		scope.bytes_out(compact.size() * sizeof(vertex_quantize::PNTVQVertex));
+		std::vector<assetlib::PNTV32Vertex>().swap(vertices);
+		vertex_data = compact.data();
+		vertex_stride = sizeof(vertex_quantize::PNTVQVertex);
+
+		// assetlib does not know about this format yet, so the data layout is described in the extension metadata.
+		info.format = assetlib::VertexFormat::Unknown;
+		ext.key("vertex_format").value(vertex_quantize::pntvq_name);
+		ext.key("vertex_stride").value(static_cast<uint32_t>(sizeof(vertex_quantize::PNTVQVertex)));
+		ext.key("bounds_min").array(bounds.min, 3);
+		ext.key("bounds_max").array(bounds.max, 3);
+	}
+
+	if ((detail_index_count > 0 || submeshes.size() > 1) && info.format == assetlib::VertexFormat::PNTV32) {
+		// assetlib would decode the detail section as part of the mesh, and draw every submesh after the first one
+		// against the wrong vertices, since their indices are relative to the submesh. Mark the file as needing the
+		// extension.
+		info.format = assetlib::VertexFormat::Unknown;
+		ext.key("vertex_format").value("PNTV32");
+		ext.key("vertex_stride").value(static_cast<uint32_t>(vertex_stride));
+	}
 
-	assetlib::AssetFile file = assetlib::pack_mesh(info, vertices.data(), indices.data());
-	return assetlib::save_binary_file(out, file);
+	if (asset_ext::compresses_payload(options.compression, options.chunked)) {
+		return save_compressed_mesh(pool, options, output, info, vertex_data, vertex_stride, index_data, detail_bytes, ext, log);
+	}
+	ext.end_object();
+
+	if (info.format == assetlib::VertexFormat::Unknown) {
+		return asset_ext::save_mesh(output, info, vertex_stride, vertex_data, index_data, detail_bytes, ext, log);
+	}
+	assetlib::AssetFile file;
+	{
+		// Includes LZ4 compression of the payload.
+		profile::Scope scope("pack");
+		scope.bytes_in(info.vertex_count * vertex_stride + info.index_count * (info.index_bits / 8));
+		file = assetlib::pack_mesh(info, vertices.data(), index_data);
+		asset_ext::attach_metadata(file, ext);
+		scope.bytes_out(file.binary_blob.size());
+	}
+	return asset_ext::save_binary_file(output, file, log);
 }
\ No newline at end of file
@@ -0,0 +1,344 @@
+#include <mesh_optimize.hpp>
+#include <hash.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace mesh_optimize {
+
+static constexpr uint32_t invalid_index = ~0u;
+
+Stats analyze_vertex_cache(uint32_t const* indices, size_t index_count, size_t vertex_count) {
+	Stats stats;
+	if (index_count == 0 || vertex_count == 0) return stats;
+
+	// FIFO cache, as implemented by most hardware. Entries store the time the vertex was inserted.
+	std::vector<size_t> inserted(vertex_count, 0);
+	size_t time = stats_cache_size + 1;
+	size_t misses = 0;
+	size_t unique = 0;
+	for (size_t i = 0; i < index_count; ++i) {
+		uint32_t const v = indices[i];
+		if (inserted[v] == 0) ++unique;
+		if (time - inserted[v] > stats_cache_size) {
+			inserted[v] = time++;
+			++misses;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(index_count / 3);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(std::max<size_t>(unique, 1));
+	return stats;
+}
+
+size_t deduplicate_vertices(void* vertices, size_t vertex_count, size_t stride, uint32_t* indices, size_t index_count) {
+	unsigned char* data = static_cast<unsigned char*>(vertices);
+
+	// Open addressing table with a power of two size of at least twice the vertex count.
+	size_t table_size = 1;
+	while (table_size < vertex_count * 2) table_size <<= 1;
+	std::vector<uint32_t> table(table_size, invalid_index);
+
+	std::vector<uint32_t> remap(vertex_count);
+	size_t unique = 0;
+	for (size_t v = 0; v < vertex_count; ++v) {
+		unsigned char const* vertex = data + v * stride;
+		size_t slot = hash64(vertex, stride) & (table_size - 1);
+		while (true) {
+			uint32_t const existing = table[slot];
+			if (existing == invalid_index) {
+				// New vertex, compact it towards the front of the buffer.
+				if (unique != v) memcpy(data + unique * stride, vertex, stride);
+				table[slot] = static_cast<uint32_t>(unique);
+				remap[v] = static_cast<uint32_t>(unique);
+				++unique;
+				break;
+			}
+			if (memcmp(data + existing * stride, vertex, stride) == 0) {
+				remap[v] = existing;
+				break;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+	}
+
+	for (size_t i = 0; i < index_count; ++i) {
+		indices[i] = remap[indices[i]];
+	}
+	return unique;
+}
+
+// Forsyth vertex cache optimization, see https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+
+static constexpr uint32_t forsyth_cache_size = 32;
+static constexpr uint32_t forsyth_max_valence = 32;
+
+struct ForsythTables {
+	float cache[forsyth_cache_size];
+	float valence[forsyth_max_valence + 1];
+
+	ForsythTables() {
+		constexpr float cache_decay_power = 1.5f;
+		constexpr float last_triangle_score = 0.75f;
+		constexpr float valence_boost_scale = 2.0f;
+		constexpr float valence_boost_power = 0.5f;
+
+		for (uint32_t i = 0; i < forsyth_cache_size; ++i) {
+			if (i < 3) {
+				// The vertices of the last triangle are scored lower on purpose, so the next triangle does not reuse
+				// the same edge over and over, which would leave the rest of the cache unused.
+				cache[i] = last_triangle_score;
+			} else {
+				float const scaler = 1.0f / static_cast<float>(forsyth_cache_size - 3);
+				cache[i] = std::pow(1.0f - static_cast<float>(i - 3) * scaler, cache_decay_power);
+			}
+		}
+		valence[0] = 0.0f;
+		for (uint32_t i = 1; i <= forsyth_max_valence; ++i) {
+			valence[i] = valence_boost_scale * std::pow(static_cast<float>(i), -valence_boost_power);
+		}
+	}
+
+	float score(int32_t cache_position, uint32_t live_triangles) const {
+		// Vertices without triangles left do not need to be considered at all.
+		if (live_triangles == 0) return -1.0f;
+		float s = cache_position >= 0 ? cache[cache_position] : 0.0f;
+		return s + valence[std::min(live_triangles, forsyth_max_valence)];
+	}
+};
+
+void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count) {
+	static ForsythTables const tables;
+
+	size_t const triangle_count = index_count / 3;
+	if (triangle_count == 0) return;
+
+	// Triangles adjacent to every vertex, in compressed row form. The first live_triangles entries of each
+	// vertex's range are the triangles that were not emitted yet.
+	std::vector<uint32_t> live_triangles(vertex_count, 0);
+	for (size_t i = 0; i < index_count; ++i) {
+		++live_triangles[indices[i]];
+	}
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		offsets[v + 1] = offsets[v] + live_triangles[v];
+	}
+	std::vector<uint32_t> adjacency(index_count);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < index_count; ++i) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<int32_t> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		vertex_score[v] = tables.score(-1, live_triangles[v]);
+	}
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	for (size_t t = 0; t < triangle_count; ++t) {
+		triangle_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] + vertex_score[indices[3 * t + 2]];
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(index_count);
+
+	// Holds room for the three vertices of a new triangle in front of a full cache.
+	uint32_t cache[forsyth_cache_size + 3];
+	uint32_t cache_count = 0;
+	uint32_t new_cache[forsyth_cache_size + 3];
+
+	size_t best_triangle = 0;
+	for (size_t t = 1; t < triangle_count; ++t) {
+		if (triangle_score[t] > triangle_score[best_triangle]) best_triangle = t;
+	}
+	// Fallback for when no triangle in the cache is left: the next triangle in input order.
+	size_t input_cursor = 0;
+
+	for (size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count) {
+		if (best_triangle == invalid_index) {
+			while (emitted[input_cursor]) ++input_cursor;
+			best_triangle = input_cursor;
+		}
+
+		size_t const t = best_triangle;
+		emitted[t] = true;
+		uint32_t const* tri = &indices[3 * t];
+		output.insert(output.end(), tri, tri + 3);
+
+		// Remove the triangle from the live lists of its vertices.
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t const v = tri[k];
+			uint32_t* begin = &adjacency[offsets[v]];
+			uint32_t* end = begin + live_triangles[v];
+			uint32_t* it = std::find(begin, end, static_cast<uint32_t>(t));
+			assert(it != end);
+			std::swap(*it, *(end - 1));
+			--live_triangles[v];
+		}
+
+		// The triangle's vertices move to the front of the cache, the rest keep their relative order.
+		uint32_t new_count = 0;
+		for (uint32_t k = 0; k < 3; ++k) {
+			if (std::find(new_cache, new_cache + new_count, tri[k]) == new_cache + new_count) {
+				new_cache[new_count++] = tri[k];
+			}
+		}
+		for (uint32_t i = 0; i < cache_count; ++i) {
+			uint32_t const v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				new_cache[new_count++] = v;
+			}
+		}
+
+		// Update scores of everything that was in the cache, including vertices that just fell out of it.
+		for (uint32_t i = 0; i < new_count; ++i) {
+			uint32_t const v = new_cache[i];
+			cache_position[v] = i < forsyth_cache_size ? static_cast<int32_t>(i) : -1;
+			vertex_score[v] = tables.score(cache_position[v], live_triangles[v]);
+		}
+
+		best_triangle = invalid_index;
+		float best_score = -1.0f;
+		for (uint32_t i = 0; i < new_count; ++i) {
+			uint32_t const v = new_cache[i];
+			for (uint32_t j = 0; j < live_triangles[v]; ++j) {
+				uint32_t const adjacent = adjacency[offsets[v] + j];
+				float const score = vertex_score[indices[3 * adjacent]] + vertex_score[indices[3 * adjacent + 1]] + vertex_score[indices[3 * adjacent + 2]];
+				triangle_score[adjacent] = score;
+				if (score > best_score) {
+					best_score = score;
+					best_triangle = adjacent;
+				}
+			}
+		}
+
+		cache_count = std::min(new_count, forsyth_cache_size);
+		std::copy(new_cache, new_cache + cache_count, cache);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimize_overdraw(uint32_t* indices, size_t index_count, void const* vertices, size_t vertex_count, size_t stride) {
+	size_t const triangle_count = index_count / 3;
+	if (triangle_count == 0) return;
+
+	unsigned char const* data = static_cast<unsigned char const*>(vertices);
+	auto position = [&](uint32_t v) {
+		float const* p = reinterpret_cast<float const*>(data + static_cast<size_t>(v) * stride);
+		return p;
+	};
+
+	// Split into clusters wherever a triangle misses the cache with all three vertices. At those points the
+	// cache starts over anyway, so moving the clusters around costs (almost) nothing in vertex cache efficiency.
+	// Tiny clusters are merged with the previous one, as sorting those is not worth the extra misses.
+	constexpr size_t min_cluster_size = 64;
+	std::vector<size_t> cluster_starts;
+	{
+		std::vector<size_t> inserted(vertex_count, 0);
+		size_t time = stats_cache_size + 1;
+		size_t last_start = 0;
+		cluster_starts.push_back(0);
+		for (size_t t = 0; t < triangle_count; ++t) {
+			uint32_t misses = 0;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t const v = indices[3 * t + k];
+				if (time - inserted[v] > stats_cache_size) {
+					inserted[v] = time++;
+					++misses;
+				}
+			}
+			if (misses == 3 && t - last_start >= min_cluster_size) {
+				cluster_starts.push_back(t);
+				last_start = t;
+			}
+		}
+	}
+	if (cluster_starts.size() < 2) return;
+
+	float mesh_center[3] = {};
+	for (size_t v = 0; v < vertex_count; ++v) {
+		for (uint32_t c = 0; c < 3; ++c) mesh_center[c] += position(static_cast<uint32_t>(v))[c];
+	}
+	for (uint32_t c = 0; c < 3; ++c) mesh_center[c] /= static_cast<float>(std::max<size_t>(vertex_count, 1));
+
+	// Clusters facing away from the center of the mesh are likely in front of the others, so they are drawn first.
+	struct Cluster {
+		size_t first;
+		size_t count;
+		float sort_key;
+	};
+	std::vector<Cluster> clusters;
+	for (size_t i = 0; i < cluster_starts.size(); ++i) {
+		Cluster cluster;
+		cluster.first = cluster_starts[i];
+		cluster.count = (i + 1 < cluster_starts.size() ? cluster_starts[i + 1] : triangle_count) - cluster.first;
+
+		float centroid[3] = {};
+		float normal[3] = {};
+		float area = 0.0f;
+		for (size_t t = cluster.first; t < cluster.first + cluster.count; ++t) {
+			float const* a = position(indices[3 * t]);
+			float const* b = position(indices[3 * t + 1]);
+			float const* c = position(indices[3 * t + 2]);
+			float const e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float const e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			// Cross product length is twice the area, which weighs the centroid and normal by area.
+			float const n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float const w = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (uint32_t k = 0; k < 3; ++k) {
+				centroid[k] += w * (a[k] + b[k] + c[k]) / 3.0f;
+				normal[k] += n[k];
+			}
+			area += w;
+		}
+
+		cluster.sort_key = 0.0f;
+		if (area > 0.0f) {
+			float const length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			for (uint32_t k = 0; k < 3; ++k) {
+				float const direction = length > 0.0f ? normal[k] / length : 0.0f;
+				cluster.sort_key += (centroid[k] / area - mesh_center[k]) * direction;
+			}
+		}
+		clusters.push_back(cluster);
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const& a, Cluster const& b) { return a.sort_key > b.sort_key; });
+
+	std::vector<uint32_t> output;
+	output.reserve(index_count);
+	for (Cluster const& cluster : clusters) {
+		output.insert(output.end(), indices + 3 * cluster.first, indices + 3 * (cluster.first + cluster.count));
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimize_vertex_fetch(void* vertices, size_t vertex_count, size_t stride, uint32_t* indices, size_t index_count) {
+	std::vector<uint32_t> remap(vertex_count, invalid_index);
+	uint32_t next = 0;
+	for (size_t i = 0; i < index_count; ++i) {
+		uint32_t& target = remap[indices[i]];
+		if (target == invalid_index) target = next++;
+		indices[i] = target;
+	}
+
+	unsigned char* data = static_cast<unsigned char*>(vertices);
+	std::vector<unsigned char> reordered(static_cast<size_t>(next) * stride);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		if (remap[v] != invalid_index) {
+			memcpy(reordered.data() + static_cast<size_t>(remap[v]) * stride, data + v * stride, stride);
+		}
+	}
+	memcpy(data, reordered.data(), reordered.size());
+	return next;
+}
+
+} // namespace mesh_optimize
@@ -0,0 +1,303 @@
+#include <mesh_simplify.hpp>
+#include <hash.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace mesh_simplify {
+
+static constexpr uint32_t invalid_index = ~0u;
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix.
+struct Quadric {
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+
+	// Plane through n . p + d = 0, with n normalized.
+	void add_plane(double const* n, double d) {
+		a00 += n[0] * n[0]; a01 += n[0] * n[1]; a02 += n[0] * n[2];
+		a11 += n[1] * n[1]; a12 += n[1] * n[2];
+		a22 += n[2] * n[2];
+		b0 += n[0] * d; b1 += n[1] * d; b2 += n[2] * d;
+		c += d * d;
+	}
+
+	Quadric& operator+=(Quadric const& rhs) {
+		a00 += rhs.a00; a01 += rhs.a01; a02 += rhs.a02;
+		a11 += rhs.a11; a12 += rhs.a12;
+		a22 += rhs.a22;
+		b0 += rhs.b0; b1 += rhs.b1; b2 += rhs.b2;
+		c += rhs.c;
+		return *this;
+	}
+
+	double evaluate(float const* p) const {
+		double const x = p[0], y = p[1], z = p[2];
+		double const result = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2.0 * (b0 * x + b1 * y + b2 * z)
+			+ c;
+		// Rounding can push the error of a point on all planes slightly below zero.
+		return std::max(result, 0.0);
+	}
+};
+
+// Moves every vertex at position `from` onto position `to`. Positions are identified by their first vertex.
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	// The vertex at `to` on the collapsed edge
+	uint32_t to_vertex;
+	double cost;
+};
+
+static void triangle_normal(float const* a, float const* b, float const* c, double* n) {
+	double const e1[3] = { double(b[0]) - a[0], double(b[1]) - a[1], double(b[2]) - a[2] };
+	double const e2[3] = { double(c[0]) - a[0], double(c[1]) - a[1], double(c[2]) - a[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Maps every vertex to the first vertex with a bitwise identical position.
+static std::vector<uint32_t> build_position_remap(unsigned char const* data, size_t vertex_count, size_t stride) {
+	constexpr size_t position_size = 3 * sizeof(float);
+	size_t table_size = 1;
+	while (table_size < vertex_count * 2) table_size <<= 1;
+	std::vector<uint32_t> table(table_size, invalid_index);
+
+	std::vector<uint32_t> remap(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		unsigned char const* position = data + v * stride;
+		size_t slot = hash64(position, position_size) & (table_size - 1);
+		while (true) {
+			uint32_t const existing = table[slot];
+			if (existing == invalid_index) {
+				table[slot] = static_cast<uint32_t>(v);
+				remap[v] = static_cast<uint32_t>(v);
+				break;
+			}
+			if (memcmp(data + existing * stride, position, position_size) == 0) {
+				remap[v] = existing;
+				break;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+	}
+	return remap;
+}
+
+size_t simplify(uint32_t* destination, uint32_t const* indices, size_t index_count, void const* vertices, size_t vertex_count, size_t stride,
+				size_t seam_offset, size_t seam_size, size_t target_index_count, float target_error, float* result_error) {
+	unsigned char const* data = static_cast<unsigned char const*>(vertices);
+	auto position = [&](uint32_t v) {
+		return reinterpret_cast<float const*>(data + static_cast<size_t>(v) * stride);
+	};
+
+	std::vector<uint32_t> result(indices, indices + index_count);
+	if (result_error) *result_error = 0.0f;
+
+	// Vertices sharing a position (duplicates, or splits by normals or uvs) form one corner of the surface and move
+	// together. Quadrics, borders, seams and adjacency are tracked per position.
+	std::vector<uint32_t> const position_id = build_position_remap(data, vertex_count, stride);
+	std::vector<uint32_t> wedge_offsets(vertex_count + 1, 0);
+	std::vector<uint32_t> wedges(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v) ++wedge_offsets[position_id[v] + 1];
+	for (size_t v = 0; v < vertex_count; ++v) wedge_offsets[v + 1] += wedge_offsets[v];
+	{
+		std::vector<uint32_t> fill(wedge_offsets.begin(), wedge_offsets.end() - 1);
+		for (size_t v = 0; v < vertex_count; ++v) wedges[fill[position_id[v]]++] = static_cast<uint32_t>(v);
+	}
+
+	// Lock seams: positions whose vertices differ in the seam attributes. Differences in other attributes, like the
+	// per face normals of flat shaded meshes, do not lock anything.
+	std::vector<bool> locked(vertex_count, false);
+	if (seam_size > 0) {
+		for (size_t v = 0; v < vertex_count; ++v) {
+			size_t const first = position_id[v];
+			if (memcmp(data + v * stride + seam_offset, data + first * stride + seam_offset, seam_size) != 0) locked[first] = true;
+		}
+	}
+
+	// Lock open borders and non-manifold edges: every edge not shared by exactly two triangles.
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(index_count);
+		for (size_t i = 0; i + 2 < index_count; i += 3) {
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint64_t const a = position_id[result[i + k]];
+				uint64_t const b = position_id[result[i + (k + 1) % 3]];
+				edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();) {
+			size_t run = i + 1;
+			while (run < edges.size() && edges[run] == edges[i]) ++run;
+			if (run - i != 2) {
+				locked[edges[i] >> 32] = true;
+				locked[edges[i] & 0xFFFFFFFF] = true;
+			}
+			i = run;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertex_count);
+	float bounds_min[3] = { INFINITY, INFINITY, INFINITY };
+	float bounds_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (size_t i = 0; i + 2 < index_count; i += 3) {
+		float const* p[3] = { position(result[i]), position(result[i + 1]), position(result[i + 2]) };
+		for (uint32_t k = 0; k < 3; ++k) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				bounds_min[c] = std::min(bounds_min[c], p[k][c]);
+				bounds_max[c] = std::max(bounds_max[c], p[k][c]);
+			}
+		}
+
+		double n[3];
+		triangle_normal(p[0], p[1], p[2], n);
+		double const length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0) continue;
+		for (double& x : n) x /= length;
+		double const d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+
+		Quadric plane;
+		plane.add_plane(n, d);
+		for (uint32_t k = 0; k < 3; ++k) quadrics[position_id[result[i + k]]] += plane;
+	}
+
+	size_t count = index_count - index_count % 3;
+	double extent = 0.0;
+	for (uint32_t c = 0; c < 3 && count > 0; ++c) {
+		double const size = double(bounds_max[c]) - bounds_min[c];
+		extent += size * size;
+	}
+	extent = std::sqrt(extent);
+	// The quadric error is a sum of squared distances, so this is conservative compared to the actual deviation.
+	double const max_cost = double(target_error) * extent * double(target_error) * extent;
+	double max_accepted_cost = 0.0;
+
+	std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(vertex_count);
+	std::vector<bool> touched(vertex_count);
+
+	// Every pass collapses a set of independent edges in order of increasing cost, until the target is reached.
+	while (count > target_index_count && extent > 0.0) {
+		size_t const triangle_count = count / 3;
+
+		// Triangles around every position
+		std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+		for (size_t i = 0; i < count; ++i) ++adjacency_offsets[position_id[result[i]] + 1];
+		for (size_t v = 0; v < vertex_count; ++v) adjacency_offsets[v + 1] += adjacency_offsets[v];
+		adjacency.resize(count);
+		{
+			std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+			for (size_t i = 0; i < count; ++i) adjacency[fill[position_id[result[i]]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t const a = result[i];
+			uint32_t const b = result[i - i % 3 + (i + 1) % 3];
+			uint32_t const ends[2][2] = { { a, b }, { b, a } };
+			for (auto const& end : ends) {
+				uint32_t const from = position_id[end[0]];
+				uint32_t const to = position_id[end[1]];
+				if (from == to || locked[from]) continue;
+				Quadric q = quadrics[from];
+				q += quadrics[to];
+				double const cost = q.evaluate(position(to));
+				if (cost <= max_cost) collapses.push_back({ from, to, end[1], cost });
+			}
+		}
+		if (collapses.empty()) break;
+		std::sort(collapses.begin(), collapses.end(), [](Collapse const& lhs, Collapse const& rhs) { return lhs.cost < rhs.cost; });
+
+		for (size_t v = 0; v < vertex_count; ++v) remap[v] = static_cast<uint32_t>(v);
+		std::fill(touched.begin(), touched.end(), false);
+
+		// A collapse of an interior edge removes two triangles.
+		size_t const triangles_needed = (count - target_index_count + 2) / 3;
+		size_t triangles_removed = 0;
+		for (Collapse const& collapse : collapses) {
+			if (touched[collapse.from] || touched[collapse.to]) continue;
+
+			// Reject collapses that flip a triangle around `from`. Triangles on the collapsed edge disappear.
+			bool valid = true;
+			for (uint32_t t = adjacency_offsets[collapse.from]; t < adjacency_offsets[collapse.from + 1] && valid; ++t) {
+				uint32_t const* triangle = result.data() + 3 * adjacency[t];
+				if (position_id[triangle[0]] == collapse.to || position_id[triangle[1]] == collapse.to || position_id[triangle[2]] == collapse.to) {
+					continue;
+				}
+
+				float const* before[3];
+				float const* after[3];
+				for (uint32_t k = 0; k < 3; ++k) {
+					uint32_t const v = triangle[k];
+					before[k] = position(v);
+					after[k] = position(position_id[v] == collapse.from ? collapse.to : v);
+				}
+				double n_before[3], n_after[3];
+				triangle_normal(before[0], before[1], before[2], n_before);
+				triangle_normal(after[0], after[1], after[2], n_after);
+				// Also reject rotations close to 90 degrees, those leave slivers that flip in the next pass.
+				double const dot = n_before[0] * n_after[0] + n_before[1] * n_after[1] + n_before[2] * n_after[2];
+				double const lengths = std::sqrt((n_before[0] * n_before[0] + n_before[1] * n_before[1] + n_before[2] * n_before[2])
+												 * (n_after[0] * n_after[0] + n_after[1] * n_after[1] + n_after[2] * n_after[2]));
+				if (dot <= 0.25 * lengths) valid = false;
+			}
+			if (!valid) continue;
+
+			// Every vertex at `from` moves onto the vertex at `to` it shares a triangle with, so attributes stay
+			// continuous across the collapsed edge. Vertices without one take the vertex of the collapsed edge.
+			for (uint32_t w = wedge_offsets[collapse.from]; w < wedge_offsets[collapse.from + 1]; ++w) {
+				uint32_t const vertex = wedges[w];
+				uint32_t target = collapse.to_vertex;
+				for (uint32_t t = adjacency_offsets[collapse.from]; t < adjacency_offsets[collapse.from + 1]; ++t) {
+					uint32_t const* triangle = result.data() + 3 * adjacency[t];
+					if (triangle[0] != vertex && triangle[1] != vertex && triangle[2] != vertex) continue;
+					for (uint32_t k = 0; k < 3; ++k) {
+						if (position_id[triangle[k]] == collapse.to) target = triangle[k];
+					}
+				}
+				remap[vertex] = target;
+			}
+			quadrics[collapse.to] += quadrics[collapse.from];
+			max_accepted_cost = std::max(max_accepted_cost, collapse.cost);
+
+			// Keep the neighbourhood fixed for the rest of this pass, so the checks above stay valid.
+			touched[collapse.to] = true;
+			for (uint32_t t = adjacency_offsets[collapse.from]; t < adjacency_offsets[collapse.from + 1]; ++t) {
+				for (uint32_t k = 0; k < 3; ++k) touched[position_id[result[3 * adjacency[t] + k]]] = true;
+			}
+
+			triangles_removed += 2;
+			if (triangles_removed >= triangles_needed) break;
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < triangle_count; ++t) {
+			uint32_t const a = remap[result[3 * t]];
+			uint32_t const b = remap[result[3 * t + 1]];
+			uint32_t const c = remap[result[3 * t + 2]];
+			// Two corners at one position leave no area, even when they are different vertices.
+			if (position_id[a] == position_id[b] || position_id[b] == position_id[c] || position_id[a] == position_id[c]) continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		if (write == count) break;
+		count = write;
+	}
+
+	std::copy_n(result.begin(), count, destination);
+	if (result_error && extent > 0.0) *result_error = static_cast<float>(std::sqrt(max_accepted_cost) / extent);
+	return count;
+}
+
+} // namespace mesh_simplify
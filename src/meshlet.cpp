@@ -0,0 +1,136 @@
+#include <meshlet.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace meshlet {
+
+static constexpr uint8_t unused_slot = 0xFF;
+
+static float distance_squared(float const* a, float const* b) {
+	float const x = a[0] - b[0], y = a[1] - b[1], z = a[2] - b[2];
+	return x * x + y * y + z * z;
+}
+
+// Ritter's bounding sphere: start from two distant points and grow the sphere over all points outside of it.
+// Within 5-20% of the optimal radius, which is plenty for culling.
+template<typename Position>
+static void compute_sphere(Meshlet& meshlet, uint32_t const* vertices, Position&& position) {
+	float const* first = position(vertices[0]);
+	float const* a = first;
+	for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+		if (distance_squared(position(vertices[i]), first) > distance_squared(a, first)) a = position(vertices[i]);
+	}
+	float const* b = a;
+	for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+		if (distance_squared(position(vertices[i]), a) > distance_squared(b, a)) b = position(vertices[i]);
+	}
+
+	float center[3] = { (a[0] + b[0]) * 0.5f, (a[1] + b[1]) * 0.5f, (a[2] + b[2]) * 0.5f };
+	float radius = std::sqrt(distance_squared(a, b)) * 0.5f;
+	for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+		float const* p = position(vertices[i]);
+		float const distance = std::sqrt(distance_squared(p, center));
+		if (distance <= radius) continue;
+		// Move the center towards p, just far enough to include it.
+		float const new_radius = (radius + distance) * 0.5f;
+		float const shift = (new_radius - radius) / distance;
+		for (uint32_t c = 0; c < 3; ++c) center[c] += (p[c] - center[c]) * shift;
+		radius = new_radius;
+	}
+
+	std::copy_n(center, 3, meshlet.center);
+	meshlet.radius = radius;
+}
+
+template<typename Position>
+static void compute_cone(Meshlet& meshlet, uint32_t const* vertices, uint8_t const* triangles, Position&& position) {
+	std::vector<float> normals;
+	normals.reserve(meshlet.triangle_count * 3);
+	float axis[3] = {};
+	for (uint32_t t = 0; t < meshlet.triangle_count; ++t) {
+		float const* a = position(vertices[triangles[3 * t]]);
+		float const* b = position(vertices[triangles[3 * t + 1]]);
+		float const* c = position(vertices[triangles[3 * t + 2]]);
+		float const e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float const e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		float const length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		// Degenerate triangles are never visible, they do not constrain the cone.
+		if (length == 0.0f) continue;
+		for (uint32_t k = 0; k < 3; ++k) {
+			n[k] /= length;
+			axis[k] += n[k];
+			normals.push_back(n[k]);
+		}
+	}
+
+	float const axis_length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (normals.empty() || axis_length == 0.0f) return;
+	for (float& x : axis) x /= axis_length;
+
+	float min_dot = 1.0f;
+	for (size_t i = 0; i < normals.size(); i += 3) {
+		min_dot = std::min(min_dot, normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]);
+	}
+	std::copy_n(axis, 3, meshlet.cone_axis);
+	// Normals spread over more than a hemisphere: the meshlet always has front facing triangles.
+	if (min_dot <= 0.0f) return;
+	// sin of the spread angle, so the test in the header becomes a cone versus sphere test.
+	meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+Meshlets build(uint32_t const* indices, size_t index_count, void const* vertices, size_t vertex_count, size_t stride) {
+	unsigned char const* data = static_cast<unsigned char const*>(vertices);
+	auto position = [&](uint32_t v) {
+		return reinterpret_cast<float const*>(data + static_cast<size_t>(v) * stride);
+	};
+
+	Meshlets result;
+	size_t const triangle_count = index_count / 3;
+	result.meshlets.reserve(triangle_count / max_triangles + 1);
+	result.vertices.reserve(triangle_count);
+	result.triangles.reserve(triangle_count * 3);
+
+	// Slot of every vertex in the current meshlet.
+	std::vector<uint8_t> slots(vertex_count, unused_slot);
+	Meshlet current;
+
+	auto finish = [&]() {
+		if (current.triangle_count == 0) return;
+		uint32_t const* meshlet_vertices = result.vertices.data() + current.vertex_offset;
+		compute_sphere(current, meshlet_vertices, position);
+		compute_cone(current, meshlet_vertices, result.triangles.data() + 3 * size_t{ current.triangle_offset }, position);
+		for (uint32_t i = 0; i < current.vertex_count; ++i) slots[meshlet_vertices[i]] = unused_slot;
+		result.meshlets.push_back(current);
+
+		current = Meshlet{};
+		current.vertex_offset = static_cast<uint32_t>(result.vertices.size());
+		current.triangle_offset = static_cast<uint32_t>(result.triangles.size() / 3);
+	};
+
+	for (size_t t = 0; t < triangle_count; ++t) {
+		uint32_t const* triangle = indices + 3 * t;
+		uint32_t new_vertices = 0;
+		for (uint32_t k = 0; k < 3; ++k) {
+			if (slots[triangle[k]] == unused_slot) ++new_vertices;
+		}
+		// Repeated indices within the triangle are counted twice here, which only ever splits a meshlet early.
+		if (current.vertex_count + new_vertices > max_vertices || current.triangle_count + 1 > max_triangles) finish();
+
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t const v = triangle[k];
+			if (slots[v] == unused_slot) {
+				slots[v] = static_cast<uint8_t>(current.vertex_count++);
+				result.vertices.push_back(v);
+			}
+			result.triangles.push_back(slots[v]);
+		}
+		++current.triangle_count;
+	}
+	finish();
+
+	return result;
+}
+
+} // namespace meshlet
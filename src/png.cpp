@@ -0,0 +1,537 @@
+#include <png.hpp>
+#include <image_rows.hpp>
+#include <profile.hpp>
+#include <thread_pool.hpp>
+
+#include <libdeflate.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define PNG_SSE2 1
+#endif
+
+namespace png {
+
+// Same limit as stb_image
+static constexpr uint32_t max_extent = 1 << 24;
+// Largest buffer the decoder allocates. The extents alone allow headers that claim petabytes.
+static constexpr uint64_t max_buffer_size = uint64_t(1) << 34;
+// Deflate expands data by at most about 1032:1, image data needing more than that cannot be valid.
+static constexpr uint64_t max_deflate_ratio = 1032;
+
+static uint32_t read_u32(unsigned char const* p) {
+	return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static uint32_t read_u16(unsigned char const* p) {
+	return (static_cast<uint32_t>(p[0]) << 8) | p[1];
+}
+
+bool check_signature(unsigned char const* data, uint64_t size) {
+	// From the PNG spec (https://www.w3.org/TR/2003/REC-PNG-20031110/#5PNG-file-signature)
+	// The first eight bytes of a PNG datastream always contain the following (decimal) values:
+	//  137 80 78 71 13 10 26 10
+	constexpr unsigned char signature[]{ 137, 80, 78, 71, 13, 10, 26, 10 };
+	return size >= sizeof(signature) && memcmp(signature, data, sizeof(signature)) == 0;
+}
+
+struct Chunk {
+	unsigned char const* type = nullptr;
+	unsigned char const* data = nullptr;
+	uint32_t size = 0;
+
+	bool is(const char* name) const { return memcmp(type, name, 4) == 0; }
+	// Chunks a decoder must understand have an uppercase first letter.
+	bool critical() const { return (type[0] & 0x20) == 0; }
+};
+
+// Reads the chunk at offset and moves offset past it. Returns false at the end of the data, or if the chunk does not fit.
+static bool next_chunk(unsigned char const* data, uint64_t size, uint64_t& offset, Chunk& chunk) {
+	// Length, type and CRC take 12 bytes around the contents.
+	if (offset > size || size - offset < 12) return false;
+	uint32_t const length = read_u32(data + offset);
+	if (length > size - offset - 12) return false;
+	chunk.type = data + offset + 4;
+	chunk.data = data + offset + 8;
+	chunk.size = length;
+	offset += 12 + static_cast<uint64_t>(length);
+	return true;
+}
+
+static uint32_t sample_count(ColorType type) {
+	switch (type) {
+		case ColorType::Grey: return 1;
+		case ColorType::RGB: return 3;
+		case ColorType::Palette: return 1;
+		case ColorType::GreyAlpha: return 2;
+		case ColorType::RGBA: return 4;
+	}
+	return 0;
+}
+
+static bool valid_bit_depth(ColorType type, uint32_t depth) {
+	switch (type) {
+		case ColorType::Grey: return depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+		case ColorType::Palette: return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+		case ColorType::RGB:
+		case ColorType::GreyAlpha:
+		case ColorType::RGBA: return depth == 8 || depth == 16;
+	}
+	return false;
+}
+
+// gAMA stores the encoding gamma times 100000, so 1/2.2 is 45455. Allow for rounding and approximate sRGB curves.
+static assetlib::ColorSpace gamma_colorspace(uint32_t gamma) {
+	if (gamma >= 43000 && gamma <= 48000) return assetlib::ColorSpace::sRGB;
+	if (gamma >= 95000 && gamma <= 105000) return assetlib::ColorSpace::RGB;
+	return assetlib::ColorSpace::Unknown;
+}
+
+bool read_info(unsigned char const* data, uint64_t size, Info& info) {
+	if (!check_signature(data, size)) return false;
+
+	uint64_t offset = 8;
+	Chunk chunk;
+	if (!next_chunk(data, size, offset, chunk) || !chunk.is("IHDR") || chunk.size != 13) return false;
+	info.width = read_u32(chunk.data);
+	info.height = read_u32(chunk.data + 4);
+	info.bit_depth = chunk.data[8];
+	info.color_type = static_cast<ColorType>(chunk.data[9]);
+	// Compression and filter method 0 are the only ones defined.
+	if (chunk.data[10] != 0 || chunk.data[11] != 0 || chunk.data[12] > 1) return false;
+	info.interlaced = chunk.data[12] == 1;
+	if (info.width == 0 || info.height == 0 || info.width > max_extent || info.height > max_extent) return false;
+	if (sample_count(info.color_type) == 0 || !valid_bit_depth(info.color_type, info.bit_depth)) return false;
+
+	// Color information has to come before the image data.
+	bool srgb = false;
+	bool icc_profile = false;
+	uint32_t gamma = 0;
+	while (next_chunk(data, size, offset, chunk) && !chunk.is("IDAT")) {
+		if (chunk.is("sRGB")) srgb = true;
+		else if (chunk.is("iCCP")) icc_profile = true;
+		else if (chunk.is("gAMA") && chunk.size == 4) gamma = read_u32(chunk.data);
+	}
+	// An sRGB chunk overrides the others, and an ICC profile overrides gAMA.
+	if (srgb) info.colorspace = assetlib::ColorSpace::sRGB;
+	else if (!icc_profile && gamma != 0) info.colorspace = gamma_colorspace(gamma);
+	else info.colorspace = assetlib::ColorSpace::Unknown;
+	return true;
+}
+
+// Sub-image of an interlaced file. Files without interlacing have a single pass covering the whole image.
+struct Pass {
+	uint32_t x0 = 0, y0 = 0;
+	uint32_t dx = 1, dy = 1;
+	uint32_t width = 0, height = 0;
+	// Bytes per row, without the filter byte in front of every row
+	size_t row_size = 0;
+	// First filter byte of the pass in the inflated data
+	size_t offset = 0;
+};
+
+static std::vector<Pass> passes(Info const& info) {
+	uint32_t const bits_per_pixel = info.bit_depth * sample_count(info.color_type);
+	// Adam7 start and step of every pass
+	constexpr uint32_t adam7[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+	std::vector<Pass> result;
+	size_t offset = 0;
+	for (uint32_t i = 0; i < (info.interlaced ? 7u : 1u); ++i) {
+		Pass pass;
+		if (info.interlaced) {
+			pass.x0 = adam7[i][0];
+			pass.y0 = adam7[i][1];
+			pass.dx = adam7[i][2];
+			pass.dy = adam7[i][3];
+		}
+		pass.width = info.width > pass.x0 ? (info.width - pass.x0 + pass.dx - 1) / pass.dx : 0;
+		pass.height = info.height > pass.y0 ? (info.height - pass.y0 + pass.dy - 1) / pass.dy : 0;
+		// Empty passes have no rows, not even filter bytes.
+		if (pass.width == 0 || pass.height == 0) continue;
+		pass.row_size = (static_cast<size_t>(pass.width) * bits_per_pixel + 7) / 8;
+		pass.offset = offset;
+		offset += (pass.row_size + 1) * pass.height;
+		result.push_back(pass);
+	}
+	return result;
+}
+
+static unsigned char paeth(int a, int b, int c) {
+	int const p = a + b - c;
+	int const pa = std::abs(p - a);
+	int const pb = std::abs(p - b);
+	int const pc = std::abs(p - c);
+	if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+	if (pb <= pc) return static_cast<unsigned char>(b);
+	return static_cast<unsigned char>(c);
+}
+
+#ifdef PNG_SSE2
+// Loads and stores a single pixel of 3 or 4 bytes. Pixels of 3 bytes are assembled in a register, a copy through
+// memory would stall on store forwarding.
+template<uint32_t bpp>
+static __m128i load_pixel(unsigned char const* p) {
+	if constexpr (bpp == 4) {
+		int32_t value;
+		memcpy(&value, p, 4);
+		return _mm_cvtsi32_si128(value);
+	} else {
+		return _mm_cvtsi32_si128(static_cast<int32_t>(p[0] | (p[1] << 8) | (p[2] << 16)));
+	}
+}
+
+template<uint32_t bpp>
+static void store_pixel(unsigned char* p, __m128i value) {
+	uint32_t const bytes = static_cast<uint32_t>(_mm_cvtsi128_si32(value));
+	if constexpr (bpp == 4) {
+		memcpy(p, &bytes, 4);
+	} else {
+		p[0] = static_cast<unsigned char>(bytes);
+		p[1] = static_cast<unsigned char>(bytes >> 8);
+		p[2] = static_cast<unsigned char>(bytes >> 16);
+	}
+}
+
+// SSE2 has no 16-bit abs.
+static __m128i abs_i16(__m128i x) {
+	__m128i const negative = _mm_cmplt_epi16(x, _mm_setzero_si128());
+	return _mm_sub_epi16(_mm_xor_si128(x, negative), negative);
+}
+
+static __m128i if_then_else(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Sub, Avg and Paeth depend on the pixel to the left, so these work on one pixel at a time, with every byte of it in
+// its own lane. The same approach as libpng's SSE2 filters.
+template<uint32_t bpp>
+static void unfilter_sub_sse2(unsigned char* row, size_t size) {
+	__m128i a = _mm_setzero_si128();
+	for (size_t i = 0; i < size; i += bpp) {
+		a = _mm_add_epi8(load_pixel<bpp>(row + i), a);
+		store_pixel<bpp>(row + i, a);
+	}
+}
+
+template<uint32_t bpp>
+static void unfilter_avg_sse2(unsigned char* row, unsigned char const* prior, size_t size) {
+	__m128i const one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	for (size_t i = 0; i < size; i += bpp) {
+		__m128i const b = load_pixel<bpp>(prior + i);
+		// The PNG average rounds down, _mm_avg_epu8 rounds up when a + b is odd.
+		__m128i average = _mm_avg_epu8(a, b);
+		average = _mm_sub_epi8(average, _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(load_pixel<bpp>(row + i), average);
+		store_pixel<bpp>(row + i, a);
+	}
+}
+
+template<uint32_t bpp>
+static void unfilter_paeth_sse2(unsigned char* row, unsigned char const* prior, size_t size) {
+	__m128i const zero = _mm_setzero_si128();
+	// The first pixel has no left neighbours, a and c are zero and the predictor picks b.
+	__m128i a = zero;
+	__m128i c = zero;
+	for (size_t i = 0; i < size; i += bpp) {
+		__m128i const b = _mm_unpacklo_epi8(load_pixel<bpp>(prior + i), zero);
+		// p - a = b - c, p - b = a - c and p - c = (b - c) + (a - c)
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = abs_i16(_mm_add_epi16(pa, pb));
+		pa = abs_i16(pa);
+		pb = abs_i16(pb);
+		__m128i const smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		// Ties prefer a over b over c.
+		__m128i const nearest = if_then_else(_mm_cmpeq_epi16(smallest, pa), a, if_then_else(_mm_cmpeq_epi16(smallest, pb), b, c));
+		// Adding bytes wraps modulo 256 in the low byte, and leaves the zero high byte alone.
+		a = _mm_add_epi8(_mm_unpacklo_epi8(load_pixel<bpp>(row + i), zero), nearest);
+		store_pixel<bpp>(row + i, _mm_packus_epi16(a, a));
+		c = b;
+	}
+}
+#endif
+
+// Undoes the filter of one row in place. prior is the unfiltered row above, all zeros for the first row of a pass.
+static bool unfilter_row(unsigned char filter, unsigned char* row, unsigned char const* prior, size_t size, uint32_t bpp) {
+	switch (filter) {
+		case 0: // None
+			return true;
+		case 1: // Sub
+#ifdef PNG_SSE2
+			if (bpp == 3) { unfilter_sub_sse2<3>(row, size); return true; }
+			if (bpp == 4) { unfilter_sub_sse2<4>(row, size); return true; }
+#endif
+			for (size_t i = bpp; i < size; ++i) row[i] = static_cast<unsigned char>(row[i] + row[i - bpp]);
+			return true;
+		case 2: { // Up
+			size_t i = 0;
+#ifdef PNG_SSE2
+			for (; i + 16 <= size; i += 16) {
+				__m128i const sum = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(row + i)),
+												 _mm_loadu_si128(reinterpret_cast<__m128i const*>(prior + i)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), sum);
+			}
+#endif
+			for (; i < size; ++i) row[i] = static_cast<unsigned char>(row[i] + prior[i]);
+			return true;
+		}
+		case 3: // Average
+#ifdef PNG_SSE2
+			if (bpp == 3) { unfilter_avg_sse2<3>(row, prior, size); return true; }
+			if (bpp == 4) { unfilter_avg_sse2<4>(row, prior, size); return true; }
+#endif
+			for (size_t i = 0; i < std::min<size_t>(bpp, size); ++i) row[i] = static_cast<unsigned char>(row[i] + (prior[i] >> 1));
+			for (size_t i = bpp; i < size; ++i) row[i] = static_cast<unsigned char>(row[i] + ((row[i - bpp] + prior[i]) >> 1));
+			return true;
+		case 4: // Paeth
+#ifdef PNG_SSE2
+			if (bpp == 3) { unfilter_paeth_sse2<3>(row, prior, size); return true; }
+			if (bpp == 4) { unfilter_paeth_sse2<4>(row, prior, size); return true; }
+#endif
+			for (size_t i = 0; i < std::min<size_t>(bpp, size); ++i) row[i] = static_cast<unsigned char>(row[i] + prior[i]);
+			for (size_t i = bpp; i < size; ++i) row[i] = static_cast<unsigned char>(row[i] + paeth(row[i - bpp], prior[i], prior[i - bpp]));
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Everything needed to turn unfiltered rows into 8-bit texels.
+struct Texels {
+	Info info;
+	// RGBA entries, opaque unless tRNS says otherwise
+	unsigned char palette[256 * 4] = {};
+	// Channels of a palette entry: 4 with a tRNS chunk, 3 without
+	uint32_t palette_channels = 3;
+	// Color key of a tRNS chunk in grey and RGB images. Pixels matching it get alpha 0, all others alpha 255.
+	bool color_key = false;
+	uint16_t key16[3] = {};
+	unsigned char key8[3] = {};
+
+	// Channels of a row after expand(), before the conversion to the requested channel count.
+	uint32_t expanded_channels() const {
+		if (info.color_type == ColorType::Palette) return palette_channels;
+		return sample_count(info.color_type) + (color_key ? 1 : 0);
+	}
+
+	// Expands count pixels of an unfiltered row to 8 bits per channel.
+	void expand(unsigned char const* row, uint32_t count, unsigned char* out) const {
+		uint32_t const samples = sample_count(info.color_type);
+		uint32_t const depth = info.bit_depth;
+		if (info.color_type == ColorType::Palette) {
+			uint32_t const mask = (1u << depth) - 1;
+			for (uint32_t x = 0; x < count; ++x, out += palette_channels) {
+				size_t const bit = static_cast<size_t>(x) * depth;
+				uint32_t const index = depth == 8 ? row[x] : (row[bit / 8] >> (8 - depth - bit % 8)) & mask;
+				memcpy(out, palette + index * 4, palette_channels);
+			}
+		} else if (depth == 16) {
+			// Only the high byte is kept, but the color key applies to the whole sample.
+			for (uint32_t x = 0; x < count; ++x, row += samples * 2) {
+				bool keyed = color_key;
+				for (uint32_t s = 0; s < samples; ++s) {
+					*out++ = row[s * 2];
+					keyed = keyed && read_u16(row + s * 2) == key16[s];
+				}
+				if (color_key) *out++ = keyed ? 0 : 255;
+			}
+		} else if (depth == 8) {
+			if (!color_key) {
+				memcpy(out, row, static_cast<size_t>(count) * samples);
+				return;
+			}
+			for (uint32_t x = 0; x < count; ++x, row += samples) {
+				bool keyed = true;
+				for (uint32_t s = 0; s < samples; ++s) {
+					*out++ = row[s];
+					keyed = keyed && row[s] == key8[s];
+				}
+				*out++ = keyed ? 0 : 255;
+			}
+		} else {
+			// Grey below 8 bits is scaled to the full range, like 0b11 to 255 for 2 bits.
+			uint32_t const mask = (1u << depth) - 1;
+			uint32_t const scale = 255 / mask;
+			for (uint32_t x = 0; x < count; ++x) {
+				size_t const bit = static_cast<size_t>(x) * depth;
+				unsigned char const value = static_cast<unsigned char>(((row[bit / 8] >> (8 - depth - bit % 8)) & mask) * scale);
+				*out++ = value;
+				if (color_key) *out++ = value == key8[0] ? 0 : 255;
+			}
+		}
+	}
+};
+
+// 16-bit color straight to grey, for the one conversion where dropping the low byte first changes the result:
+// stb_image computes the luminance of 16-bit images at 16 bits.
+static bool needs_grey16(Texels const& texels, uint32_t channels) {
+	return texels.info.bit_depth == 16 && sample_count(texels.info.color_type) >= 3 && channels <= 2;
+}
+
+static void expand_grey16(Texels const& texels, unsigned char const* row, uint32_t count, uint32_t channels, unsigned char* out) {
+	bool const alpha = texels.info.color_type == ColorType::RGBA;
+	for (uint32_t x = 0; x < count; ++x, row += alpha ? 8 : 6, out += channels) {
+		uint32_t const r = read_u16(row), g = read_u16(row + 2), b = read_u16(row + 4);
+		out[0] = static_cast<unsigned char>(((r * 77 + g * 150 + b * 29) >> 8) >> 8);
+		if (channels == 1) continue;
+		bool const keyed = texels.color_key && r == texels.key16[0] && g == texels.key16[1] && b == texels.key16[2];
+		out[1] = alpha ? row[6] : keyed ? 0 : 255;
+	}
+}
+
+// Reads PLTE and tRNS, and gathers the IDAT chunks.
+static bool read_chunks(unsigned char const* data, uint64_t size, Texels& texels, std::vector<Chunk>& image_data) {
+	uint64_t offset = 8;
+	Chunk chunk;
+	bool has_palette = false;
+	bool has_end = false;
+	while (!has_end && next_chunk(data, size, offset, chunk)) {
+		if (chunk.is("IHDR")) {
+			continue;
+		} else if (chunk.is("PLTE")) {
+			if (chunk.size % 3 != 0 || chunk.size > 256 * 3) return false;
+			for (uint32_t i = 0; i < chunk.size / 3; ++i) {
+				texels.palette[i * 4 + 0] = chunk.data[i * 3 + 0];
+				texels.palette[i * 4 + 1] = chunk.data[i * 3 + 1];
+				texels.palette[i * 4 + 2] = chunk.data[i * 3 + 2];
+				texels.palette[i * 4 + 3] = 255;
+			}
+			has_palette = true;
+		} else if (chunk.is("tRNS")) {
+			uint32_t const samples = sample_count(texels.info.color_type);
+			if (texels.info.color_type == ColorType::Palette) {
+				if (chunk.size > 256) return false;
+				for (uint32_t i = 0; i < chunk.size; ++i) texels.palette[i * 4 + 3] = chunk.data[i];
+				texels.palette_channels = 4;
+			} else if (texels.info.color_type == ColorType::Grey || texels.info.color_type == ColorType::RGB) {
+				if (chunk.size != samples * 2) return false;
+				texels.color_key = true;
+				uint32_t const scale = texels.info.bit_depth < 8 ? 255 / ((1u << texels.info.bit_depth) - 1) : 1;
+				for (uint32_t s = 0; s < samples; ++s) {
+					texels.key16[s] = static_cast<uint16_t>(read_u16(chunk.data + s * 2));
+					// Compared after scaling to 8 bits, truncated like stb_image does.
+					texels.key8[s] = static_cast<unsigned char>((texels.key16[s] & 0xFF) * scale);
+				}
+			} else {
+				// Images with an alpha channel cannot have a tRNS chunk.
+				return false;
+			}
+		} else if (chunk.is("IDAT")) {
+			image_data.push_back(chunk);
+		} else if (chunk.is("IEND")) {
+			has_end = true;
+		} else if (chunk.critical()) {
+			// Includes Apple's CgBI, whose image data is not a zlib stream.
+			return false;
+		}
+	}
+	if (texels.info.color_type == ColorType::Palette && !has_palette) return false;
+	return !image_data.empty();
+}
+
+// Inflates the concatenated IDAT contents into exactly size bytes.
+static bool inflate(std::vector<Chunk> const& image_data, unsigned char* output, size_t size) {
+	std::vector<unsigned char> joined;
+	unsigned char const* stream = image_data[0].data;
+	size_t stream_size = image_data[0].size;
+	// Encoders split the stream over many small IDAT chunks, which have to be joined for a single call to libdeflate.
+	if (image_data.size() > 1) {
+		size_t total = 0;
+		for (Chunk const& chunk : image_data) total += chunk.size;
+		joined.reserve(total);
+		for (Chunk const& chunk : image_data) joined.insert(joined.end(), chunk.data, chunk.data + chunk.size);
+		stream = joined.data();
+		stream_size = joined.size();
+	}
+
+	std::unique_ptr<libdeflate_decompressor, void (*)(libdeflate_decompressor*)> decompressor(libdeflate_alloc_decompressor(), &libdeflate_free_decompressor);
+	if (!decompressor) return false;
+	return libdeflate_zlib_decompress(decompressor.get(), stream, stream_size, output, size, nullptr) == LIBDEFLATE_SUCCESS;
+}
+
+bool decode(ThreadPool& pool, unsigned char const* data, uint64_t size, uint32_t channels, bool flip_vertically, Info& info,
+			std::unique_ptr<unsigned char[]>& pixels) {
+	if (channels < 1 || channels > 4 || !read_info(data, size, info)) return false;
+
+	Texels texels;
+	texels.info = info;
+	std::vector<Chunk> image_data;
+	if (!read_chunks(data, size, texels, image_data)) return false;
+
+	std::vector<Pass> const image_passes = passes(info);
+	size_t const filtered_size = image_passes.back().offset + (image_passes.back().row_size + 1) * image_passes.back().height;
+	uint64_t const pixels_size = static_cast<uint64_t>(info.width) * info.height * channels;
+	uint64_t compressed_size = 0;
+	for (Chunk const& chunk : image_data) compressed_size += chunk.size;
+	// Checked before allocating, so corrupt or hostile headers fail instead of throwing bad_alloc.
+	if (filtered_size > max_buffer_size || pixels_size > max_buffer_size || filtered_size > compressed_size * max_deflate_ratio + 64) return false;
+	std::unique_ptr<unsigned char[]> filtered(new (std::nothrow) unsigned char[filtered_size]);
+	if (!filtered) return false;
+	{
+		profile::Scope scope("inflate");
+		scope.bytes_out(filtered_size);
+		if (!inflate(image_data, filtered.get(), filtered_size)) return false;
+	}
+
+	{
+		// Every row depends on the one above it, so this part is serial.
+		profile::Scope scope("unfilter");
+		scope.bytes_in(filtered_size);
+		// Filters work on whole bytes, so pixels below 8 bits act as one byte.
+		uint32_t const bpp = std::max(info.bit_depth * sample_count(info.color_type) / 8, 1u);
+		size_t widest = 0;
+		for (Pass const& pass : image_passes) widest = std::max(widest, pass.row_size);
+		std::vector<unsigned char> const zeros(widest, 0);
+		for (Pass const& pass : image_passes) {
+			unsigned char const* prior = zeros.data();
+			for (uint32_t y = 0; y < pass.height; ++y) {
+				unsigned char* row = filtered.get() + pass.offset + y * (pass.row_size + 1);
+				if (!unfilter_row(row[0], row + 1, prior, pass.row_size, bpp)) return false;
+				prior = row + 1;
+			}
+		}
+	}
+
+	pixels.reset(new (std::nothrow) unsigned char[pixels_size]);
+	if (!pixels) return false;
+	uint32_t const expanded_channels = texels.expanded_channels();
+	for (Pass const& pass : image_passes) {
+		// Rows of a pass land in different rows of the image, so they can be converted in any order.
+		size_t const grain = std::max<size_t>(1, (64 * 1024) / (static_cast<size_t>(pass.width) * channels));
+		pool.parallel_for(pass.height, grain, [&](size_t begin, size_t end) {
+			std::vector<unsigned char> expanded(static_cast<size_t>(pass.width) * expanded_channels);
+			std::vector<unsigned char> converted(pass.dx > 1 ? static_cast<size_t>(pass.width) * channels : 0);
+			for (size_t y = begin; y < end; ++y) {
+				uint32_t const image_y = pass.y0 + static_cast<uint32_t>(y) * pass.dy;
+				uint32_t const out_y = flip_vertically ? info.height - 1 - image_y : image_y;
+				unsigned char* out_row = pixels.get() + static_cast<size_t>(out_y) * info.width * channels;
+				unsigned char const* row = filtered.get() + pass.offset + y * (pass.row_size + 1) + 1;
+
+				// Rows of interlaced passes are converted next to the image, and then spread over their columns.
+				unsigned char* converted_row = pass.dx == 1 ? out_row : converted.data();
+				if (needs_grey16(texels, channels)) {
+					expand_grey16(texels, row, pass.width, channels, converted_row);
+				} else if (expanded_channels == channels) {
+					texels.expand(row, pass.width, converted_row);
+				} else {
+					texels.expand(row, pass.width, expanded.data());
+					image_rows::convert_channels(expanded.data(), expanded_channels, converted_row, channels, pass.width);
+				}
+				if (pass.dx == 1) continue;
+				for (uint32_t x = 0; x < pass.width; ++x) {
+					memcpy(out_row + (static_cast<size_t>(pass.x0) + x * pass.dx) * channels, converted.data() + x * channels, channels);
+				}
+			}
+		});
+	}
+	return true;
+}
+
+} // namespace png
@@ -0,0 +1,247 @@
+#include <profile.hpp>
+#include <json_writer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#	include <psapi.h>
+#else
+#	include <cstdio>
+#	include <sys/resource.h>
+#	include <unistd.h>
+#endif
+
+namespace profile {
+
+using clock = std::chrono::steady_clock;
+
+struct Event {
+	const char* name;
+	std::string detail;
+	uint32_t thread;
+	// Microseconds since the profile started, the unit of the trace-event format
+	int64_t start_us;
+	int64_t duration_us;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t rss;
+};
+
+static std::atomic<bool> g_enabled = false;
+static std::mutex g_mutex;
+static clock::time_point g_epoch = clock::now();
+static std::vector<Event> g_events;
+static std::vector<std::pair<std::string, uint64_t>> g_counters;
+
+// Small sequential ids read better in trace viewers than std::thread::id hashes.
+static uint32_t thread_index() {
+	static std::atomic<uint32_t> next = 0;
+	thread_local uint32_t const index = next.fetch_add(1);
+	return index;
+}
+
+static int64_t microseconds_since_epoch(clock::time_point time) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(time - g_epoch).count();
+}
+
+void enable() {
+	g_enabled = true;
+}
+
+bool enabled() {
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+void reset() {
+	std::lock_guard lock(g_mutex);
+	g_events.clear();
+	g_counters.clear();
+	g_epoch = clock::now();
+}
+
+Scope::Scope(const char* name) : name(name) {
+	if (!enabled()) return;
+	active = true;
+	start = clock::now();
+}
+
+Scope::Scope(const char* name, std::string detail) : name(name) {
+	if (!enabled()) return;
+	this->detail = std::move(detail);
+	active = true;
+	start = clock::now();
+}
+
+Scope::~Scope() {
+	end();
+}
+
+void Scope::end() {
+	if (!active) return;
+	active = false;
+	clock::time_point const now = clock::now();
+	uint64_t const rss = current_rss();
+
+	std::lock_guard lock(g_mutex);
+	int64_t const start_us = microseconds_since_epoch(start);
+	g_events.push_back({ name, std::move(detail), thread_index(), start_us, microseconds_since_epoch(now) - start_us, in, out, rss });
+}
+
+void count(const char* name, uint64_t value) {
+	if (!enabled()) return;
+	std::lock_guard lock(g_mutex);
+	auto it = std::find_if(g_counters.begin(), g_counters.end(), [name](auto const& counter) { return counter.first == name; });
+	if (it == g_counters.end()) g_counters.emplace_back(name, value);
+	else it->second += value;
+}
+
+std::vector<StageSummary> summarize() {
+	std::lock_guard lock(g_mutex);
+	std::vector<StageSummary> stages;
+	std::unordered_map<std::string, size_t> lookup;
+	for (Event const& event : g_events) {
+		auto [it, inserted] = lookup.try_emplace(event.name, stages.size());
+		if (inserted) {
+			stages.emplace_back();
+			stages.back().name = event.name;
+		}
+		StageSummary& stage = stages[it->second];
+		double const ms = static_cast<double>(event.duration_us) / 1000.0;
+		stage.calls += 1;
+		stage.total_ms += ms;
+		stage.max_ms = std::max(stage.max_ms, ms);
+		stage.bytes_in += event.bytes_in;
+		stage.bytes_out += event.bytes_out;
+		stage.max_rss = std::max(stage.max_rss, event.rss);
+	}
+	return stages;
+}
+
+uint64_t current_rss() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.WorkingSetSize;
+#elif defined(__linux__)
+	// The second field of statm is the resident size in pages.
+	FILE* file = std::fopen("/proc/self/statm", "r");
+	if (file == nullptr) return 0;
+	unsigned long long size = 0, resident = 0;
+	int const read = std::fscanf(file, "%llu %llu", &size, &resident);
+	std::fclose(file);
+	if (read != 2) return 0;
+	return static_cast<uint64_t>(resident) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+	return 0;
+#endif
+}
+
+uint64_t peak_rss() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#	ifdef __APPLE__
+	return static_cast<uint64_t>(usage.ru_maxrss); // bytes
+#	else
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#	endif
+#endif
+}
+
+static double megabytes(uint64_t bytes) {
+	return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+static void write_trace_events(JsonWriter& json) {
+	json.key("traceEvents").begin_array();
+	for (Event const& event : g_events) {
+		json.begin_object();
+		json.key("name").value(event.name);
+		json.key("cat").value("assettool");
+		json.key("ph").value("X");
+		json.key("ts").value(event.start_us);
+		json.key("dur").value(event.duration_us);
+		json.key("pid").value(uint32_t{ 1 });
+		json.key("tid").value(event.thread);
+		json.key("args").begin_object();
+		if (!event.detail.empty()) json.key("detail").value(event.detail);
+		if (event.bytes_in != 0) json.key("bytes_in").value(event.bytes_in);
+		if (event.bytes_out != 0) json.key("bytes_out").value(event.bytes_out);
+		json.end_object();
+		json.end_object();
+
+		// Counter track of the resident memory, sampled whenever a stage ends.
+		if (event.rss == 0) continue;
+		json.begin_object();
+		json.key("name").value("memory");
+		json.key("ph").value("C");
+		json.key("ts").value(event.start_us + event.duration_us);
+		json.key("pid").value(uint32_t{ 1 });
+		json.key("args").begin_object().key("resident MB").value(megabytes(event.rss)).end_object();
+		json.end_object();
+	}
+	json.end_array();
+}
+
+static void write_summary(JsonWriter& json, std::vector<StageSummary> const& stages) {
+	json.key("assettool").begin_object();
+	json.key("peak_rss").value(peak_rss());
+	json.key("stages").begin_array();
+	for (StageSummary const& stage : stages) {
+		json.begin_object();
+		json.key("name").value(stage.name);
+		json.key("calls").value(stage.calls);
+		json.key("total_ms").value(stage.total_ms);
+		json.key("max_ms").value(stage.max_ms);
+		json.key("bytes_in").value(stage.bytes_in);
+		json.key("bytes_out").value(stage.bytes_out);
+		if (stage.total_ms > 0.0 && stage.bytes_in != 0) json.key("mb_per_s").value(megabytes(stage.bytes_in) / (stage.total_ms / 1000.0));
+		json.key("max_rss").value(stage.max_rss);
+		json.end_object();
+	}
+	json.end_array();
+	json.key("counters").begin_object();
+	for (auto const& [name, value] : g_counters) {
+		json.key(name).value(value);
+	}
+	json.end_object();
+	json.end_object();
+}
+
+bool write(fs::path const& path, std::string& error) {
+	std::vector<StageSummary> const stages = summarize();
+
+	JsonWriter json;
+	json.begin_object();
+	{
+		std::lock_guard lock(g_mutex);
+		write_trace_events(json);
+		json.key("displayTimeUnit").value("ms");
+		write_summary(json, stages);
+	}
+	json.end_object();
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file || !file.write(json.str().data(), static_cast<std::streamsize>(json.str().size()))) {
+		error = "Failed to write profile " + path.generic_string();
+		return false;
+	}
+	return true;
+}
+
+} // namespace profile
@@ -1,116 +1,21 @@
 #include <texture_convert.hpp>
+#include <cpu_mipgen.hpp>
+#include <block_compress.hpp>
+#include <asset_ext.hpp>
+#include <image_rows.hpp>
+#include <png.hpp>
 #include <assetlib/texture.hpp>
+#include <assetlib/versions.hpp>
 #include <stb_image.h>
 #include <options.hpp>
+#include <profile.hpp>
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
-#include <unordered_map>
-
-namespace png {
-
-	static bool check_signature(std::ifstream& file) {
-		// From the PNG spec (https://www.w3.org/TR/2003/REC-PNG-20031110/#5PNG-file-signature)
-		// The first eight bytes of a PNG datastream always contain the following (decimal) values:
-		//  137 80 78 71 13 10 26 10
-		constexpr unsigned char signature[]{ 137, 80, 78, 71, 13, 10, 26, 10 };
-		constexpr size_t signature_size = sizeof(signature); // dividing by sizeof(byte) would be a bit silly
-		unsigned char buffer[signature_size];
-		// Attempt to read, and if not enough bytes were read, return an error
-		if (!file.read(reinterpret_cast<char*>(&buffer), signature_size)) {
-			return false;
-		}
-
-		// Verify that the signature matches
-		if (memcmp(signature, buffer, signature_size) != 0) {
-			return false;
-		}
-
-		return true;
-	}
-
-	enum class ChunkType {
-		// These chunks are required to be present in a valid PNG file
-		IHDR, // Header
-		PLTE, // Palette
-		IDAT, // Data
-		IEND, // End
-		// These chunks are optional
-		sRGB, // srgb information
-		gAma, // gamma information
-		pHYs, // Intended pixel size/aspect ratio. Ignored when parsing
-		Invalid // Invalid or unsupported chunk type
-	};
-
-	struct ChunkInfo {
-		ChunkType type = ChunkType::Invalid;
-		uint32_t size = 0;
-
-		// Amount of bytes the ChunkInfo struct takes up in a file
-		static constexpr size_t file_bytes = 8;
-	};
-
-	struct ChunkHeader {
-		static constexpr size_t size = 4;
-		const unsigned char data[4];
-	};
-
-	static std::unordered_map<ChunkType, ChunkHeader> chunk_headers{
-		{ ChunkType::IHDR, {{ 73, 72, 68, 82 }} },
-		{ ChunkType::sRGB, {{ 115, 82, 71, 66 }} },
-		{ ChunkType::gAma, {{ 103, 65, 77, 65 }} },
-		{ ChunkType::pHYs, {{ 112, 72, 89, 115 }} },
-		{ ChunkType::IDAT, {{ 73, 68, 65, 84 }} }
-	};
-
-	static ChunkInfo next_chunk_info(std::ifstream& file) {
-		ChunkInfo info;
-		if (!file.read(reinterpret_cast<char*>(&info.size), sizeof(uint32_t))) {
-			return info;
-		}
-
-		unsigned char header_buffer[ChunkHeader::size];
-		// Attempt to read the chunk header.
-		if (!file.read(reinterpret_cast<char*>(&header_buffer), ChunkHeader::size)) {
-			return info; // type is initialized to invalid
-		}
-
-		for (auto const& [type, header] : chunk_headers) {
-			if (memcmp(header_buffer, header.data, ChunkHeader::size) == 0) {
-				info.type = type;
-				return info;
-			}
-		}
-
-		return info;
-	}
-
-	// Ignores count bytes from the file
-	static bool ignore_bytes(std::ifstream& file, size_t count) {
-		return file.seekg(count, std::ios::cur).good();
-	}
-
-	static void skip_chunk_contents(std::ifstream& file, ChunkInfo const& info) {
-		ignore_bytes(file, info.size);
-	}
-
-	static assetlib::ColorSpace get_color_space(std::ifstream& file) {
-		bool valid_png = check_signature(file);
-		assert(valid_png && "Corrupt PNG file detected.");
-
-		// Skip through chunks until we find an sRGB chunk.
-		ChunkInfo next_chunk = next_chunk_info(file);
-		while (next_chunk.type != ChunkType::Invalid) {
-			if (next_chunk.type == ChunkType::sRGB) {
-				return assetlib::ColorSpace::sRGB;
-			}
-			skip_chunk_contents(file, next_chunk);
-			next_chunk = next_chunk_info(file);
-		}
-		return assetlib::ColorSpace::RGB;
-	}
-
-} // namespace png
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <vector>
 
 mipgen::ImageFormat mip_format(assetlib::TextureFormat fmt, assetlib::ColorSpace space) {
     if (space == assetlib::ColorSpace::RGB) {
@@ -153,45 +58,454 @@ assetlib::TextureFormat get_format(int channels) {
     return assetlib::TextureFormat::Unknown;
 }
 
-bool convert_texture(mipgen::Context& mipgen_ctx, plib::binary_input_stream& in, plib::binary_output_stream& out, std::ostream& log) {
-	int width, height, channels;
+DecodedTexture::~DecodedTexture() {
+	if (!png_pixels) stbi_image_free(pixels);
+}
+
+bool decode_texture(ThreadPool& pool, Options const& options, InputData const& in, DecodedTexture& texture) {
+	profile::Scope scope("texture decode");
+	scope.bytes_in(in.size);
+	png::Info info;
+	if (png::decode(pool, in.data, in.size, options.channels, true, info, texture.png_pixels)) {
+		texture.width = info.width;
+		texture.height = info.height;
+		texture.pixels = texture.png_pixels.get();
+	} else {
+		// Also catches the PNG files the decoder rejects, so stb_image reports the error or handles the odd variant.
+		texture.png_pixels.reset();
+		// stb_image takes the length of its input as an int, larger files are only supported by the PNG decoder.
+		if (in.size > static_cast<uint64_t>(std::numeric_limits<int>::max())) return false;
+		// The flip is per thread, so it cannot leak into other users of stb_image in the process.
+		stbi_set_flip_vertically_on_load_thread(1);
+		int width, height, channels;
+		texture.pixels = stbi_load_from_memory(in.data, static_cast<int>(in.size), &width, &height, &channels, options.channels);
+		if (texture.pixels == nullptr) return false;
+		texture.width = static_cast<uint32_t>(width);
+		texture.height = static_cast<uint32_t>(height);
+	}
+	scope.bytes_out(static_cast<uint64_t>(texture.width) * texture.height * options.channels);
+	return true;
+}
+
+assetlib::ColorSpace texture_colorspace(Options const& options, InputData const& in) {
+	if (options.colorspace != assetlib::ColorSpace::Unknown) return options.colorspace;
+	png::Info info;
+	if (png::read_info(in.data, in.size, info) && info.colorspace != assetlib::ColorSpace::Unknown) return info.colorspace;
+	return assetlib::ColorSpace::RGB;
+}
 
-	uint32_t const file_size = in.size();
-	unsigned char* in_file = new unsigned char[file_size];
-	in.read(in_file, file_size);
+// Size of every level of a mip chain laid out like mipgen's output, largest first.
+static std::vector<size_t> mip_level_sizes(uint32_t width, uint32_t height, uint32_t mip_levels, uint32_t channels, block_compress::Format block_format) {
+	std::vector<size_t> sizes(mip_levels);
+	for (uint32_t level = 0; level < mip_levels; ++level) {
+		uint32_t const w = std::max(width >> level, 1u);
+		uint32_t const h = std::max(height >> level, 1u);
+		sizes[level] = block_format == block_compress::Format::None ? static_cast<size_t>(w) * h * channels
+																	: block_compress::compressed_size(block_format, w, h, 1);
+	}
+	return sizes;
+}
 
-	unsigned char* pixels = stbi_load_from_memory(in_file, file_size, &width, &height, &channels, g_options.channels);
-	if (pixels == nullptr) {
+// Extents of the image without decoding it. Also works for files too large for stb_image, if they are PNG files or
+// have a row reader.
+static bool image_extents(Options const& options, InputData const& in, uint32_t& width, uint32_t& height) {
+	png::Info info;
+	if (png::read_info(in.data, in.size, info)) {
+		width = info.width;
+		height = info.height;
+		return true;
+	}
+	if (std::unique_ptr<image_rows::Reader> reader = image_rows::open(in.data, in.size, options.channels, false, false)) {
+		width = reader->width();
+		height = reader->height();
+		return true;
+	}
+	int info_width, info_height, info_channels;
+	if (in.size > static_cast<uint64_t>(std::numeric_limits<int>::max())
+		|| !stbi_info_from_memory(in.data, static_cast<int>(in.size), &info_width, &info_height, &info_channels)) {
+		return false;
+	}
+	// stb_image reports the height of top-down BMP files as negative.
+	width = static_cast<uint32_t>(info_width);
+	height = static_cast<uint32_t>(std::abs(info_height));
+	return true;
+}
+
+// Rough peak memory of converting a texture in one piece: the decoded image, the mip chain, the packed copy of the
+// chain and its compressed form.
+static uint64_t full_conversion_memory(uint32_t width, uint32_t height, uint32_t channels) {
+	uint64_t const base = static_cast<uint64_t>(width) * height * channels;
+	// The mip chain adds a third on top of the base level.
+	return base + 3 * (base + base / 3);
+}
+
+// Rows per strip of a streamed conversion. Every row of a strip is held as bytes, as floats in the window of the
+// first mip level and as pending payload, which together take about eight times the size of the row.
+static uint32_t strip_rows(uint64_t budget, size_t row_size, uint32_t height) {
+	uint64_t const rows = budget / (8 * static_cast<uint64_t>(row_size));
+	// Not std::clamp, images shorter than 4 rows would pass it a lower bound above the upper one.
+	return static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(rows, 4), height));
+}
+
+// Payload of one mip level of a streamed texture.
+struct StreamedLevel {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	// Size of the level in the payload
+	size_t size = 0;
+	uint32_t rows_received = 0;
+	// Texel rows waiting for a full row of blocks, only used with block compression
+	std::vector<unsigned char> texels;
+	// Payload waiting to be compressed, and the amount of payload compressed before it
+	std::vector<unsigned char> pending;
+	size_t compressed = 0;
+	std::vector<codec::Chunk> chunks;
+};
+
+static JsonWriter streamed_texture_ext(Options const& options, assetlib::TextureFormat format, std::vector<codec::Chunk> const& chunks) {
+	JsonWriter ext;
+	ext.begin_object();
+	if (options.block_format != block_compress::Format::None) {
+		ext.key("block_format").value(block_compress::format_name(options.block_format));
+		ext.key("channels").value(static_cast<uint32_t>(options.channels));
+	}
+	asset_ext::write_compression(ext, options.compression, chunks);
+	if (options.block_format == block_compress::Format::None) ext.key("format").value(asset_ext::texture_format_name(format));
+	ext.end_object();
+	return ext;
+}
+
+// Converts a texture a strip of rows at a time, for textures whose conversion in one piece would exceed the memory
+// budget. Mips are generated with cpu_mipgen, and each level is block compressed, compressed and written as its rows
+// are produced. The payload is always chunked, as a single compressed block cannot be written a piece at a time.
+static bool convert_texture_streamed(ThreadPool& pool, Options const& options, InputData const& in, uint32_t width, uint32_t height,
+									 assetlib::ColorSpace colorspace, asset_ext::Output& output, std::ostream& log) {
+	uint32_t const channels = static_cast<uint32_t>(options.channels);
+	assetlib::TextureFormat const format = get_format(options.channels);
+	// The header claims raw data, so readers without the extension must not accept the format.
+	assetlib::TextureInfo info;
+	info.extents[0] = width;
+	info.extents[1] = height;
+	info.format = assetlib::TextureFormat::Unknown;
+	info.colorspace = colorspace;
+	info.compression = assetlib::CompressionMode::None;
+
+	mipgen::ImageInfo img_info;
+	img_info.extents[0] = width;
+	img_info.extents[1] = height;
+	img_info.format = mip_format(format, info.colorspace);
+	img_info.pixels = nullptr;
+	info.mip_levels = cpu_mipgen::get_mip_count(img_info);
+
+	std::vector<size_t> const sizes = mip_level_sizes(width, height, info.mip_levels, channels, options.block_format);
+	std::vector<StreamedLevel> levels(info.mip_levels);
+	size_t payload_size = 0;
+	size_t chunk_count = 0;
+	for (uint32_t i = 0; i < info.mip_levels; ++i) {
+		levels[i].width = std::max(width >> i, 1u);
+		levels[i].height = std::max(height >> i, 1u);
+		levels[i].size = sizes[i];
+		payload_size += sizes[i];
+		chunk_count += (sizes[i] + codec::default_chunk_size - 1) / codec::default_chunk_size;
+	}
+	if (payload_size > std::numeric_limits<uint32_t>::max()) {
+		log << "Error: Texture is too large for the asset file format" << std::endl;
+		return false;
+	}
+	info.byte_size = static_cast<uint32_t>(payload_size);
+
+	// Formats without a row reader are decoded in one piece. That still saves the full mip chain and its packed copy.
+	std::unique_ptr<image_rows::Reader> reader = image_rows::open(in.data, in.size, channels, true, in.mapped);
+	if (reader && (reader->width() != width || reader->height() != height)) reader.reset();
+	DecodedTexture decoded;
+	if (!reader) {
+		if (!decode_texture(pool, options, in, decoded) || decoded.width != width || decoded.height != height) {
+			log << "Error: Failed to read texture" << std::endl;
+			return false;
+		}
+		if (in.mapped) release_pages(in.data, in.size);
+	}
+
+	// The header goes in front of the payload, so reserve room for the largest chunk table it can hold.
+	std::vector<codec::Chunk> const largest_chunks(chunk_count, codec::Chunk{ std::numeric_limits<uint32_t>::max(), std::numeric_limits<uint64_t>::max(),
+																			  std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max() });
+	std::string error;
+	asset_ext::StreamedAssetWriter writer;
+	if (!writer.open(output, asset_ext::texture_header(info, streamed_texture_ext(options, format, largest_chunks)).size(), error)) {
+		log << "Error: " << error << std::endl;
+		return false;
+	}
+
+	// Compresses every whole chunk of pending payload, and the rest too once the level is complete.
+	bool failed = false;
+	auto flush = [&](uint32_t index, bool complete) {
+		StreamedLevel& level = levels[index];
+		size_t const size = complete ? level.pending.size() : level.pending.size() / codec::default_chunk_size * codec::default_chunk_size;
+		if (size == 0) return;
+
+		std::vector<char> blob;
+		std::vector<codec::Chunk> chunks;
+		{
+			profile::Scope scope("compress");
+			scope.bytes_in(size);
+			if (!codec::compress_chunks(pool, options.compression, { { level.pending.data(), size } }, codec::default_chunk_size, blob, chunks)) {
+				log << "Error: Failed to compress texture" << std::endl;
+				failed = true;
+				return;
+			}
+			scope.bytes_out(blob.size());
+		}
+
+		uint64_t offset = 0;
+		{
+			profile::Scope scope("save");
+			scope.bytes_out(blob.size());
+			if (!writer.append(blob.data(), blob.size(), offset, error)) {
+				log << "Error: " << error << std::endl;
+				failed = true;
+				return;
+			}
+		}
+		for (codec::Chunk& chunk : chunks) {
+			chunk.section = index;
+			chunk.compressed_offset += offset;
+			level.chunks.push_back(chunk);
+		}
+		level.pending.erase(level.pending.begin(), level.pending.begin() + size);
+		level.compressed += size;
+	};
+
+	auto sink = [&](uint32_t index, unsigned char const* rows, uint32_t row_count) {
+		if (failed) return;
+		StreamedLevel& level = levels[index];
+		size_t const row_size = static_cast<size_t>(level.width) * channels;
+		level.rows_received += row_count;
+		bool const complete = level.rows_received == level.height;
+		if (options.block_format == block_compress::Format::None) {
+			level.pending.insert(level.pending.end(), rows, rows + row_count * row_size);
+		} else {
+			// Blocks need four rows, only the bottom of a level may have fewer.
+			level.texels.insert(level.texels.end(), rows, rows + row_count * row_size);
+			uint32_t const buffered = static_cast<uint32_t>(level.texels.size() / row_size);
+			uint32_t const band = complete ? buffered : buffered / 4 * 4;
+			if (band > 0) {
+				profile::Scope scope("block compress");
+				scope.bytes_in(band * row_size);
+				size_t const start = level.pending.size();
+				level.pending.resize(start + block_compress::compressed_size(options.block_format, level.width, band, 1));
+				block_compress::compress_rows(pool, level.texels.data(), channels, level.width, band, options.block_format,
+											  options.block_quality, level.pending.data() + start);
+				level.texels.erase(level.texels.begin(), level.texels.begin() + band * row_size);
+				scope.bytes_out(level.pending.size() - start);
+			}
+		}
+		flush(index, complete);
+	};
+
+	size_t const row_size = static_cast<size_t>(width) * channels;
+	uint32_t const rows_per_strip = strip_rows(static_cast<uint64_t>(options.memory_budget_mb) * 1024 * 1024, row_size, height);
+	std::vector<unsigned char> strip(reader ? rows_per_strip * row_size : 0);
+	cpu_mipgen::MipStream stream(img_info, options.mip_filter);
+	for (uint32_t y = 0; y < height && !failed; y += rows_per_strip) {
+		uint32_t const count = std::min(rows_per_strip, height - y);
+		unsigned char const* rows = strip.data();
+		if (!reader) {
+			rows = decoded.pixels + y * row_size;
+		} else {
+			profile::Scope scope("texture decode");
+			scope.bytes_out(count * row_size);
+			if (!reader->read(strip.data(), count)) {
+				log << "Error: Texture file is truncated" << std::endl;
+				failed = true;
+				break;
+			}
+		}
+		// Includes the stages the new rows feed into.
+		profile::Scope scope("mipgen");
+		stream.push(pool, rows, count, sink);
+	}
+	if (failed) return false;
+
+	std::vector<codec::Chunk> chunks;
+	for (StreamedLevel const& level : levels) {
+		assert(level.compressed == level.size && "Every mip level is complete");
+		chunks.insert(chunks.end(), level.chunks.begin(), level.chunks.end());
+	}
+
+	if (!writer.finish("ITEX", assetlib::itex_version, asset_ext::texture_header(info, streamed_texture_ext(options, format, chunks)), error)) {
+		log << "Error: " << error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool convert_texture(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, InputData const& in, asset_ext::Output& output,
+					 std::ostream& log) {
+	// Textures too large for the memory budget are converted in strips, with mips generated on the CPU.
+	uint32_t width, height;
+	if (options.memory_budget_mb > 0 && image_extents(options, in, width, height)) {
+		uint64_t const budget = static_cast<uint64_t>(options.memory_budget_mb) * 1024 * 1024;
+		if (full_conversion_memory(width, height, options.channels) > budget) {
+			return convert_texture_streamed(pool, options, in, width, height, texture_colorspace(options, in), output, log);
+		}
+	}
+
+	DecodedTexture decoded;
+	if (!decode_texture(pool, options, in, decoded)) {
 		log << "Error: Failed to read texture" << std::endl;
-		delete[] in_file;
 		return false;
 	}
 
+	TextureLayers texture;
+	texture.width = decoded.width;
+	texture.height = decoded.height;
+	texture.colorspace = texture_colorspace(options, in);
+	texture.layers = { decoded.pixels };
+	return encode_texture(mipgen_ctx, pool, options, texture, output, log);
+}
+
+bool encode_texture(mipgen::Context* mipgen_ctx, ThreadPool& pool, Options const& options, TextureLayers const& texture, asset_ext::Output& output,
+					std::ostream& log) {
+	uint32_t const width = texture.width;
+	uint32_t const height = texture.height;
+	size_t const layer_count = texture.layers.size();
+
     assetlib::TextureInfo info;
 
     info.extents[0] = width;
     info.extents[1] = height;
 
-    info.compression = assetlib::CompressionMode::LZ4;
-    info.format = get_format(g_options.channels);
-    info.colorspace = g_options.colorspace;
+    info.compression = asset_ext::compression_mode(options.compression);
+    info.format = get_format(options.channels);
+    info.colorspace = texture.colorspace;
 
 	mipgen::ImageInfo img_info;
 	img_info.extents[0] = width;
 	img_info.extents[1] = height;
 	img_info.format = mip_format(info.format, info.colorspace);
-	img_info.pixels = pixels;
+	img_info.pixels = nullptr;
+
+	uint32_t const full_chain_size = mipgen::output_buffer_size(img_info);
+	if (options.mip_method == MipMethod::CPU && cpu_mipgen::output_buffer_size(img_info) != full_chain_size) {
+		log << "Error: CPU mip chain layout does not match mipgen" << std::endl;
+		return false;
+	}
+
+	uint32_t const full_mip_levels = mipgen::get_mip_count(img_info);
+	info.mip_levels = texture.max_mip_levels == 0 ? full_mip_levels : std::min(texture.max_mip_levels, full_mip_levels);
+	std::vector<size_t> const level_sizes = mip_level_sizes(width, height, info.mip_levels, options.channels, block_compress::Format::None);
+	size_t chain_size = 0;
+	for (size_t size : level_sizes) chain_size += size;
+	if (chain_size * layer_count > std::numeric_limits<uint32_t>::max()) {
+		log << "Error: Texture is too large for the asset file format" << std::endl;
+		return false;
+	}
 
-	uint32_t output_byte_size = mipgen::output_buffer_size(img_info);
-	unsigned char* pixels_with_mipmaps = new unsigned char[output_byte_size];
-	mipgen_ctx.generate_mipmap(img_info, pixels_with_mipmaps);
+	// Layers follow each other, every one with its own mip chain.
+	unsigned char* pixels_with_mipmaps = new unsigned char[chain_size * layer_count];
+	{
+		profile::Scope scope("mipgen");
+		scope.bytes_in(static_cast<uint64_t>(width) * height * options.channels * layer_count);
+		scope.bytes_out(chain_size * layer_count);
+		// mipgen always generates the full chain. A shortened chain is its first levels.
+		std::unique_ptr<unsigned char[]> full_chain(chain_size < full_chain_size ? new unsigned char[full_chain_size] : nullptr);
+		for (size_t layer = 0; layer < layer_count; ++layer) {
+			img_info.pixels = const_cast<unsigned char*>(texture.layers[layer]);
+			unsigned char* chain = full_chain ? full_chain.get() : pixels_with_mipmaps + layer * chain_size;
+			if (options.mip_method == MipMethod::CPU) {
+				cpu_mipgen::generate_mipmap(pool, img_info, options.mip_filter, chain);
+			} else {
+				assert(mipgen_ctx && "GPU mip generation requires a mipgen context");
+				mipgen_ctx->generate_mipmap(img_info, chain);
+			}
+			if (full_chain) memcpy(pixels_with_mipmaps + layer * chain_size, chain, chain_size);
+		}
+	}
 
-    info.byte_size = output_byte_size;
-    info.mip_levels = mipgen::get_mip_count(img_info);
-	assetlib::AssetFile converted = assetlib::pack_texture(info, pixels_with_mipmaps);
+    info.byte_size = static_cast<uint32_t>(chain_size * layer_count);
+
+	JsonWriter ext;
+	ext.begin_object();
+	if (options.block_format != block_compress::Format::None) {
+		size_t const compressed_size = block_compress::compressed_size(options.block_format, width, height, info.mip_levels);
+		unsigned char* blocks = new unsigned char[compressed_size * layer_count];
+		{
+			profile::Scope scope("block compress");
+			scope.bytes_in(info.byte_size);
+			scope.bytes_out(compressed_size * layer_count);
+			for (size_t layer = 0; layer < layer_count; ++layer) {
+				block_compress::compress_mip_chain(pool, pixels_with_mipmaps + layer * chain_size, options.channels, width, height, info.mip_levels,
+												   options.block_format, options.block_quality, blocks + layer * compressed_size);
+			}
+		}
+		delete[] pixels_with_mipmaps;
+		pixels_with_mipmaps = blocks;
+
+		// assetlib has no block compressed formats yet. Mark the format as unknown, so readers that do not
+		// understand the extension metadata reject the texture instead of misinterpreting it.
+		info.format = assetlib::TextureFormat::Unknown;
+		info.byte_size = static_cast<uint32_t>(compressed_size * layer_count);
+		ext.key("block_format").value(block_compress::format_name(options.block_format));
+		ext.key("channels").value(static_cast<uint32_t>(options.channels));
+	}
+	if (layer_count > 1) ext.key("layers").value(static_cast<uint32_t>(layer_count));
+
+	std::vector<char> blob;
+	bool const extended_compression = asset_ext::needs_extended_compression(options.compression, options.chunked);
+	bool const compress_payload = asset_ext::compresses_payload(options.compression, options.chunked);
+	if (compress_payload) {
+		// Each mip level is its own section, so a reader can decode just the levels it streams in.
+		std::vector<codec::Section> sections;
+		if (options.chunked) {
+			unsigned char const* level = pixels_with_mipmaps;
+			std::vector<size_t> const sizes = mip_level_sizes(width, height, info.mip_levels, options.channels, options.block_format);
+			for (size_t layer = 0; layer < layer_count; ++layer) {
+				for (size_t size : sizes) {
+					sections.push_back({ level, size });
+					level += size;
+				}
+			}
+		} else {
+			sections.push_back({ pixels_with_mipmaps, info.byte_size });
+		}
+		size_t const max_chunk_size = options.chunked ? codec::default_chunk_size : std::numeric_limits<size_t>::max();
+		std::vector<codec::Chunk> chunks;
+		profile::Scope scope("compress");
+		scope.bytes_in(info.byte_size);
+		if (!codec::compress_chunks(pool, options.compression, sections, max_chunk_size, blob, chunks)) {
+			log << "Error: Failed to compress texture" << std::endl;
+			delete[] pixels_with_mipmaps;
+			return false;
+		}
+		scope.bytes_out(blob.size());
+		// An unchunked LZ4HC blob is a plain LZ4 block, which keeps the header of a standard file.
+		if (extended_compression) {
+			asset_ext::write_compression(ext, options.compression, chunks);
+			info.compression = assetlib::CompressionMode::None;
+		}
+	}
+	// The header claims raw data of a single image, so readers without the extension must not accept the format.
+	if (extended_compression || layer_count > 1) {
+		if (info.format != assetlib::TextureFormat::Unknown) ext.key("format").value(asset_ext::texture_format_name(info.format));
+		info.format = assetlib::TextureFormat::Unknown;
+	}
+	ext.end_object();
+
+	if (compress_payload) {
+		delete[] pixels_with_mipmaps;
+		return asset_ext::save_texture_blob(output, info, blob, ext, log);
+	}
+
+	assetlib::AssetFile converted;
+	{
+		// Includes LZ4 compression.
+		profile::Scope scope("pack");
+		scope.bytes_in(info.byte_size);
+		converted = assetlib::pack_texture(info, pixels_with_mipmaps);
+		asset_ext::attach_metadata(converted, ext);
+		scope.bytes_out(converted.binary_blob.size());
+	}
 	delete[] pixels_with_mipmaps;
-	delete[] in_file;
-	stbi_image_free(pixels);
 
-	return assetlib::save_binary_file(out, converted);
-}
\ No newline at end of file
+	return asset_ext::save_binary_file(output, converted, log);
+}
@@ -0,0 +1,158 @@
+#include <thread_pool.hpp>
+
+#include <algorithm>
+#include <cassert>
+
+// Index of the pool worker running on this thread, or -1 for threads that are not part of a pool.
+static thread_local size_t current_worker = static_cast<size_t>(-1);
+static thread_local ThreadPool const* current_pool = nullptr;
+
+ThreadPool::ThreadPool(size_t workers) {
+	if (workers == 0) {
+		workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	queues.reserve(workers);
+	for (size_t i = 0; i < workers; ++i) {
+		queues.push_back(std::make_unique<Queue>());
+	}
+
+	threads.reserve(workers);
+	for (size_t i = 0; i < workers; ++i) {
+		threads.emplace_back([this, i]() { run(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(sleep_mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+size_t ThreadPool::size() const {
+	return threads.size();
+}
+
+void ThreadPool::push(Task task) {
+	size_t target;
+	if (current_pool == this) {
+		target = current_worker;
+	} else {
+		target = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+	}
+
+	pending.fetch_add(1);
+	{
+		// Taking the sleep lock here makes sure a worker that just found every queue empty cannot miss this wakeup.
+		// The counter is bumped before the task is visible, so it can never drop below zero.
+		std::lock_guard lock(sleep_mutex);
+		queued.fetch_add(1);
+	}
+	{
+		std::lock_guard lock(queues[target]->mutex);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::wait() {
+	assert(current_pool != this && "ThreadPool::wait() called from inside a task");
+	std::unique_lock lock(sleep_mutex);
+	idle.wait(lock, [this]() { return pending.load() == 0; });
+}
+
+void ThreadPool::parallel_for(size_t count, size_t grain, std::function<void(size_t begin, size_t end)> const& fn) {
+	if (count == 0) return;
+	grain = std::max<size_t>(grain, 1);
+	size_t const ranges = (count + grain - 1) / grain;
+	if (ranges == 1) {
+		fn(0, count);
+		return;
+	}
+
+	// Ranges are claimed from a shared counter instead of being queued one by one. Helpers that only start after
+	// everything was claimed find nothing left and return immediately, so they never touch fn after this returns.
+	struct Shared {
+		std::atomic<size_t> next = 0;
+		std::atomic<size_t> done = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto shared = std::make_shared<Shared>();
+
+	auto work = [shared, count, grain, ranges, &fn]() {
+		size_t range;
+		while ((range = shared->next.fetch_add(1)) < ranges) {
+			size_t const begin = range * grain;
+			fn(begin, std::min(begin + grain, count));
+			if (shared->done.fetch_add(1, std::memory_order_acq_rel) + 1 == ranges) {
+				std::lock_guard lock(shared->mutex);
+				shared->finished.notify_all();
+			}
+		}
+	};
+
+	size_t const helpers = std::min(ranges, size()) - 1;
+	for (size_t i = 0; i < helpers; ++i) {
+		push([work](size_t) { work(); });
+	}
+
+	work();
+	// Every range is claimed now. Sleep until the ones still running on other workers are done, instead of
+	// keeping a core busy.
+	std::unique_lock lock(shared->mutex);
+	shared->finished.wait(lock, [&shared, ranges]() { return shared->done.load(std::memory_order_acquire) == ranges; });
+}
+
+bool ThreadPool::try_pop(size_t worker, Task& task) {
+	// Own queue first, newest task first so that recently pushed (cache-hot) work runs next.
+	{
+		Queue& own = *queues[worker];
+		std::lock_guard lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+
+	// Steal the oldest task from another worker.
+	for (size_t offset = 1; offset < queues.size(); ++offset) {
+		Queue& victim = *queues[(worker + offset) % queues.size()];
+		std::lock_guard lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::run(size_t worker) {
+	current_worker = worker;
+	current_pool = this;
+
+	while (true) {
+		Task task;
+		if (try_pop(worker, task)) {
+			queued.fetch_sub(1);
+			task(worker);
+			if (pending.fetch_sub(1) == 1) {
+				std::lock_guard lock(sleep_mutex);
+				idle.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock lock(sleep_mutex);
+		wake.wait(lock, [this]() { return stop || queued.load() > 0; });
+		if (stop) return;
+	}
+}
@@ -0,0 +1,113 @@
+#include <vertex_quantize.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace vertex_quantize {
+
+Bounds compute_bounds(assetlib::PNTV32Vertex const* vertices, size_t count) {
+	Bounds bounds;
+	if (count == 0) return bounds;
+
+	for (uint32_t c = 0; c < 3; ++c) {
+		bounds.min[c] = std::numeric_limits<float>::max();
+		bounds.max[c] = std::numeric_limits<float>::lowest();
+	}
+	for (size_t v = 0; v < count; ++v) {
+		for (uint32_t c = 0; c < 3; ++c) {
+			bounds.min[c] = std::min(bounds.min[c], vertices[v].position[c]);
+			bounds.max[c] = std::max(bounds.max[c], vertices[v].position[c]);
+		}
+	}
+	return bounds;
+}
+
+uint16_t float_to_half(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t const sign = (bits >> 16) & 0x8000;
+	int32_t const exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (((bits >> 23) & 0xFF) == 0xFF) {
+		// Infinity or NaN
+		return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 31) {
+		// Too large, clamp to infinity
+		return static_cast<uint16_t>(sign | 0x7C00);
+	}
+	if (exponent <= 0) {
+		// Denormal or zero
+		if (exponent < -10) return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000;
+		uint32_t const shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		// Round to nearest even
+		uint32_t const remainder = mantissa & ((1u << shift) - 1);
+		uint32_t const halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) ++half;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t const remainder = mantissa & 0x1FFF;
+	// Round to nearest even. A carry into the exponent is correct, up to and including infinity.
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) ++half;
+	return static_cast<uint16_t>(half);
+}
+
+static int16_t to_snorm16(float value) {
+	return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// Maps the unit sphere onto an octahedron, unfolded into the [-1, 1] square.
+// See "A Survey of Efficient Representations for Independent Unit Vectors" (Cigolle et al. 2014).
+void encode_octahedral(float const* direction, int16_t* encoded) {
+	float const l1 = std::abs(direction[0]) + std::abs(direction[1]) + std::abs(direction[2]);
+	if (l1 == 0.0f) {
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float x = direction[0] / l1;
+	float y = direction[1] / l1;
+	if (direction[2] < 0.0f) {
+		float const folded_x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float const folded_y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = folded_x;
+		y = folded_y;
+	}
+	encoded[0] = to_snorm16(x);
+	encoded[1] = to_snorm16(y);
+}
+
+std::vector<PNTVQVertex> quantize(assetlib::PNTV32Vertex const* vertices, size_t count, Bounds const& bounds) {
+	float scale[3];
+	for (uint32_t c = 0; c < 3; ++c) {
+		float const extent = bounds.max[c] - bounds.min[c];
+		scale[c] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+	}
+
+	std::vector<PNTVQVertex> result(count);
+	for (size_t v = 0; v < count; ++v) {
+		assetlib::PNTV32Vertex const& src = vertices[v];
+		PNTVQVertex& dst = result[v];
+		for (uint32_t c = 0; c < 3; ++c) {
+			float const q = (src.position[c] - bounds.min[c]) * scale[c];
+			dst.position[c] = static_cast<uint16_t>(std::clamp(std::lround(q), 0l, 65535l));
+		}
+		encode_octahedral(src.normal, dst.normal);
+		encode_octahedral(src.tangent, dst.tangent);
+		dst.uv[0] = float_to_half(src.uv[0]);
+		dst.uv[1] = float_to_half(src.uv[1]);
+		dst.padding = 0;
+	}
+	return result;
+}
+
+} // namespace vertex_quantize